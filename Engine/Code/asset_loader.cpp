@@ -0,0 +1,430 @@
+#include "asset_loader.h"
+#include "assimpImport.h"
+#include "model_cache.h"
+#include "obj_loader.h"
+#include "gltf_loader.h"
+#include "mesh_optimizer.h"
+#include "vertex_quantization.h"
+#include "geometry.h"
+#include "engine.h"
+#include "job_system.h"
+#include "mpmc_queue.h"
+#include <stb_image.h>
+#include <thread>
+#include <chrono>
+#include <float.h>
+#include <ctype.h>
+#include <string.h>
+
+enum AssetType
+{
+	AssetType_Model,
+	AssetType_Texture,
+};
+
+// Lives on the heap from the request until the main thread has uploaded it
+struct AssetRequest
+{
+	AssetType     type;
+	u32           index;     // model or texture index in the App
+	std::string   filepath;
+	bool          succeeded;
+	Image         image;
+	ImportedModel model;
+	GeometryRetention retention;
+
+	std::chrono::steady_clock::time_point requestTime;
+};
+
+static MPMCQueue<AssetRequest*, ASSET_QUEUE_CAPACITY> FinishedAssets;
+static JobCounter        AssetJobs;
+static std::atomic<bool> CancelAssetJobs(false);
+static u32               PendingAssetLoads = 0; // main thread only
+
+static u32 GetMeshBufferSize(const ImportedModel& model)
+{
+	if (model.mappedFile.data)
+		return model.vertexDataSize + model.indexDataSize;
+
+	u32 size = 0;
+	for (const Submesh& submesh : model.mesh.submeshes)
+		size += (u32)(submesh.vertices.size() * sizeof(float) + submesh.indices.size() * sizeof(u32) + submesh.indices16.size() * sizeof(u16));
+	return size;
+}
+
+// Unit cube with positions, normals and texture coordinates, so any mesh program can draw it
+static void CreatePlaceholderModel(App* app)
+{
+	Submesh submesh = {};
+	submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });                 // 3D positions
+	submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) }); // normals
+	submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, 6 * sizeof(float) }); // tex coordinates
+	submesh.vertexBufferLayout.stride = 8 * sizeof(float);
+
+	const vec3 faceNormals[] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+	const vec2 corners[] = { vec2(0, 0), vec2(1, 0), vec2(1, 1), vec2(0, 1) };
+
+	for (const vec3& normal : faceNormals)
+	{
+		// counter-clockwise seen from outside: cross(u, v) == normal
+		const vec3 u = vec3(normal.y, normal.z, normal.x);
+		const vec3 v = glm::cross(normal, u);
+
+		const u32 firstVertex = (u32)(submesh.vertices.size() / 8);
+		for (const vec2& corner : corners) {
+			const vec3 position = (normal + u * (corner.x * 2.0f - 1.0f) + v * (corner.y * 2.0f - 1.0f)) * 0.5f;
+			submesh.vertices.insert(submesh.vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, corner.x, corner.y });
+		}
+
+		const u32 faceIndices[] = { 0, 1, 2, 0, 2, 3 };
+		for (u32 index : faceIndices)
+			submesh.indices.push_back(firstVertex + index);
+	}
+
+	submesh.vertexCount = (u32)(submesh.vertices.size() / 8);
+	submesh.indexCount = (u32)submesh.indices.size();
+	submesh.indexType = GL_UNSIGNED_INT;
+	ComputeSubmeshBounds(submesh);
+
+	app->meshes.push_back(Mesh{});
+	Mesh& mesh = app->meshes.back();
+	mesh.submeshes.push_back(submesh);
+	OptimizeMesh(mesh, "<placeholder>");
+	QuantizeMesh(mesh, "<placeholder>");
+	NarrowMeshIndices(mesh, "<placeholder>");
+	UploadMeshBuffers(app, mesh, GeometryRetention_Drop);
+
+	app->materials.push_back(Material());
+
+	app->models.push_back(Model{});
+	Model& model = app->models.back();
+	model.meshIdx = (u32)app->meshes.size() - 1u;
+	model.materialIdx.push_back((u32)app->materials.size() - 1u);
+
+	app->placeholderModelIdx = (u32)app->models.size() - 1u;
+}
+
+void InitAssetLoader(App* app)
+{
+	ASSERT(app->textures.empty(), "The placeholder texture has to be the first one");
+
+	// set once here: the flag is global in stb_image and the decoding jobs run concurrently
+	stbi_set_flip_vertically_on_load(true);
+
+	u8 whitePixel[] = { 255, 255, 255, 255 };
+	Image image = {};
+	image.pixels = whitePixel;
+	image.size = ivec2(1, 1);
+	image.nchannels = 4;
+	image.stride = 4;
+
+	Texture placeholder = {};
+	placeholder.handle = CreateTexture2DFromImage(image);
+	placeholder.filepath = "<placeholder>";
+	app->textures.push_back(placeholder);
+	app->placeholderTextureIdx = 0;
+
+	CreatePlaceholderModel(app);
+}
+
+// Drops a request that will never be uploaded
+static void FreeAssetRequest(AssetRequest* request)
+{
+	if (request->image.pixels) FreeImage(request->image);
+	UnmapFile(request->model.mappedFile);
+	delete request;
+}
+
+void ShutdownAssetLoader()
+{
+	// the jobs drop their requests instead of waiting for room in the queue
+	CancelAssetJobs = true;
+	WaitForCounter(AssetJobs);
+
+	AssetRequest* request;
+	while (FinishedAssets.Pop(request))
+		FreeAssetRequest(request);
+	PendingAssetLoads = 0;
+}
+
+static f64 MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool HasExtension(const char* filename, const char* extension)
+{
+	const size_t length = strlen(filename);
+	const size_t extensionLength = strlen(extension);
+	if (length < extensionLength) return false;
+
+	for (size_t i = 0; i < extensionLength; ++i)
+		if (tolower(filename[length - extensionLength + i]) != extension[i])
+			return false;
+	return true;
+}
+
+// Reads the model cache if it is up to date, otherwise imports the source and writes the cache.
+// OBJ files go through the native parser, everything else through Assimp. GLB files are already
+// laid out for the GL buffers and are not cached.
+static bool ImportModelCached(const char* filename, ImportedModel& model)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (HasExtension(filename, ".glb")) {
+		if (!ImportGlb(filename, model))
+			return false;
+		ILOG("%s: loaded through the GLB parser in %.2f ms", filename, MillisecondsSince(start));
+		return true;
+	}
+
+	if (ReadModelCache(filename, model)) {
+		ILOG("%s: warm load from the model cache in %.2f ms", filename, MillisecondsSince(start));
+		return true;
+	}
+
+	const bool isObj = HasExtension(filename, ".obj");
+	if (!(isObj ? ImportObj(filename, model) : ImportModel(filename, model)))
+		return false;
+
+	// cooked once: the cache keeps the optimized order, the compact vertices and the narrow indices
+	OptimizeMesh(model.mesh, filename);
+	QuantizeMesh(model.mesh, filename);
+	NarrowMeshIndices(model.mesh, filename);
+
+	const f64 importMilliseconds = MillisecondsSince(start);
+	const std::chrono::steady_clock::time_point writeStart = std::chrono::steady_clock::now();
+
+	if (!WriteModelCache(filename, model))
+		ELOG("%s: could not write the model cache", filename);
+
+	ILOG("%s: cold load through %s in %.2f ms (model cache written in %.2f ms)", filename, isObj ? "the OBJ parser" : "Assimp", importMilliseconds, MillisecondsSince(writeStart));
+	return true;
+}
+
+static void LoadAssetJob(void* data, u32 begin, u32 end)
+{
+	AssetRequest* request = (AssetRequest*)data;
+
+	if (!CancelAssetJobs)
+	{
+		if (request->type == AssetType_Model) {
+			request->succeeded = ImportModelCached(request->filepath.c_str(), request->model);
+		}
+		else {
+			request->image = LoadImage(request->filepath.c_str());
+			request->succeeded = request->image.pixels != NULL;
+		}
+	}
+
+	// the main thread empties the queue every frame, but not anymore once it is shutting down
+	while (!FinishedAssets.Push(request))
+	{
+		if (CancelAssetJobs) {
+			FreeAssetRequest(request);
+			return;
+		}
+		std::this_thread::yield();
+	}
+}
+
+static void RequestAsset(AssetType type, u32 index, const char* filepath, GeometryRetention retention)
+{
+	AssetRequest* request = new AssetRequest();
+	request->type = type;
+	request->index = index;
+	request->filepath = filepath;
+	request->retention = retention;
+	request->requestTime = std::chrono::steady_clock::now();
+
+	Job job = {};
+	job.function = LoadAssetJob;
+	job.data = request;
+	job.counter = &AssetJobs;
+	RunBackgroundJob(job);
+
+	PendingAssetLoads++;
+}
+
+// Creates the materials, textures and buffers of an imported model into the model slot
+static void FinishModel(App* app, u32 modelIdx, ImportedModel& imported, GeometryRetention retention, bool asyncTextures)
+{
+	const u32 baseMaterialIdx = (u32)app->materials.size();
+	for (const ImportedMaterial& importedMaterial : imported.materials)
+	{
+		u32 textureIdx[MaterialTexture_Count];
+		for (u32 i = 0; i < MaterialTexture_Count; ++i)
+		{
+			const std::string& path = importedMaterial.texturePaths[i];
+			textureIdx[i] = app->placeholderTextureIdx;
+			if (path.empty()) continue;
+
+			textureIdx[i] = asyncTextures ? LoadTexture2DAsync(app, path.c_str()) : LoadTexture2D(app, path.c_str());
+			if (textureIdx[i] == UINT32_MAX) textureIdx[i] = app->placeholderTextureIdx;
+		}
+
+		Material material = importedMaterial.material;
+		material.albedoTextureIdx = textureIdx[MaterialTexture_Albedo];
+		material.emissiveTextureIdx = textureIdx[MaterialTexture_Emissive];
+		material.specularTextureIdx = textureIdx[MaterialTexture_Specular];
+		material.normalsTextureIdx = textureIdx[MaterialTexture_Normals];
+		material.bumpTextureIdx = textureIdx[MaterialTexture_Bump];
+		app->materials.push_back(material);
+	}
+
+	Model& model = app->models[modelIdx];
+	model.materialIdx.clear();
+	for (u32 submeshMaterialIdx : imported.submeshMaterialIndices)
+		model.materialIdx.push_back(baseMaterialIdx + submeshMaterialIdx);
+
+	// the geometry it replaces: the placeholder it shares, or the previous load of the model
+	Mesh& mesh = app->meshes[model.meshIdx];
+	FreeMeshGeometry(app, mesh);
+	mesh.submeshes.swap(imported.mesh.submeshes);
+
+	if (imported.mappedFile.data) {
+		// the offsets in the submeshes point into the data of the cache or the GLB file
+		UploadMappedMeshBuffers(app, mesh, imported.vertexData, imported.vertexDataSize, imported.indexData, imported.indexDataSize, retention);
+		UnmapFile(imported.mappedFile);
+	}
+	else {
+		UploadMeshBuffers(app, mesh, retention);
+	}
+
+	// the objects of the model were added with the bounds of the placeholder
+	vec3 boundsMin, boundsMax;
+	GetModelBounds(app, modelIdx, boundsMin, boundsMax);
+
+	GameObjectStore& gameObjects = app->scene.gameObjects;
+	for (u32 i = 0; i < GetCount(gameObjects.handles); ++i) {
+		if (gameObjects.modelIDs[i] != modelIdx) continue;
+		gameObjects.boundsMin[i] = boundsMin;
+		gameObjects.boundsMax[i] = boundsMax;
+	}
+}
+
+u32 LoadModel(App* app, const char* filename, GeometryRetention retention)
+{
+	ImportedModel imported = {};
+	if (!ImportModelCached(filename, imported))
+		return UINT32_MAX;
+
+	app->meshes.push_back(Mesh{});
+	app->models.push_back(Model{});
+	Model& model = app->models.back();
+	model.meshIdx = (u32)app->meshes.size() - 1u;
+	model.filepath = filename;
+	u32 modelIdx = (u32)app->models.size() - 1u;
+
+	FinishModel(app, modelIdx, imported, retention, false);
+
+	return modelIdx;
+}
+
+u32 LoadModelAsync(App* app, const char* filename, GeometryRetention retention)
+{
+	// a copy of the placeholder, sharing its buffers, until the real mesh replaces it
+	const Model& placeholder = app->models[app->placeholderModelIdx];
+	app->meshes.push_back(app->meshes[placeholder.meshIdx]);
+	app->meshes.back().sharesGeometry = true;
+
+	Model model = {};
+	model.meshIdx = (u32)app->meshes.size() - 1u;
+	model.materialIdx = placeholder.materialIdx;
+	model.filepath = filename;
+	app->models.push_back(model);
+	u32 modelIdx = (u32)app->models.size() - 1u;
+
+	RequestAsset(AssetType_Model, modelIdx, filename, retention);
+
+	return modelIdx;
+}
+
+bool ReloadModelAsync(App* app, u32 modelIdx, GeometryRetention retention)
+{
+	const Model& model = app->models[modelIdx];
+	if (model.filepath.empty()) {
+		ELOG("The model %u was built in code and cannot be reloaded", modelIdx);
+		return false;
+	}
+
+	RequestAsset(AssetType_Model, modelIdx, model.filepath.c_str(), retention);
+	return true;
+}
+
+u32 LoadTexture2DAsync(App* app, const char* filepath)
+{
+	for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+		if (app->textures[texIdx].filepath == filepath)
+			return texIdx;
+
+	Texture tex = {};
+	tex.handle = app->textures[app->placeholderTextureIdx].handle;
+	tex.filepath = filepath;
+
+	u32 texIdx = app->textures.size();
+	app->textures.push_back(tex);
+
+	RequestAsset(AssetType_Texture, texIdx, filepath, GeometryRetention_Drop);
+
+	return texIdx;
+}
+
+// Returns the bytes uploaded to OpenGL
+static u32 FinishAsset(App* app, AssetRequest& request)
+{
+	// a failed load keeps the placeholder, the error was already logged by the job
+	if (!request.succeeded)
+		return 0;
+
+	const std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+	u32 uploadedBytes = 0;
+
+	if (request.type == AssetType_Model) {
+		uploadedBytes = GetMeshBufferSize(request.model);
+		FinishModel(app, request.index, request.model, request.retention, true);
+	}
+	else {
+		uploadedBytes = request.image.size.x * request.image.size.y * request.image.nchannels;
+		app->textures[request.index].handle = CreateTexture2DFromImage(request.image);
+		FreeImage(request.image);
+	}
+
+	ILOG("Loaded %s in %.1f ms (upload %.2f ms)", request.filepath.c_str(), MillisecondsSince(request.requestTime), MillisecondsSince(uploadStart));
+
+	return uploadedBytes;
+}
+
+static void FinishAssets(App* app, u32 budget)
+{
+	u32 uploadedBytes = 0;
+	AssetRequest* request;
+
+	while (uploadedBytes < budget && FinishedAssets.Pop(request))
+	{
+		uploadedBytes += FinishAsset(app, *request);
+		PendingAssetLoads--;
+		delete request;
+	}
+}
+
+void ProcessAssetUploads(App* app)
+{
+	FinishAssets(app, ASSET_UPLOAD_BUDGET);
+}
+
+void WaitForAssetLoads(App* app)
+{
+	// finishing a model requests its textures, so the count can grow while waiting
+	while (PendingAssetLoads > 0)
+	{
+		FinishAssets(app, UINT32_MAX);
+		if (PendingAssetLoads > 0)
+			std::this_thread::yield();
+	}
+}
+
+u32 GetPendingAssetLoadCount()
+{
+	return PendingAssetLoads;
+}
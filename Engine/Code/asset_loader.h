@@ -0,0 +1,82 @@
+//
+// asset_loader.h: Asynchronous model and texture loading. Files are imported and decoded by
+// background jobs, and the finished CPU data comes back to the main thread through a lock-free
+// queue. ProcessAssetUploads() creates the OpenGL objects at the start of every Update(), within
+// a byte budget per frame. Until then the returned indices refer to placeholders, so models and
+// textures can be used as soon as they are requested.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+struct App;
+
+// Bytes uploaded to OpenGL per frame before the rest of the finished assets wait for the next one
+#define ASSET_UPLOAD_BUDGET MB(16)
+
+// Finished assets waiting for the main thread (a power of two)
+#define ASSET_QUEUE_CAPACITY 256
+
+enum MaterialTexture
+{
+	MaterialTexture_Albedo,
+	MaterialTexture_Emissive,
+	MaterialTexture_Specular,
+	MaterialTexture_Normals,
+	MaterialTexture_Bump,
+	MaterialTexture_Count
+};
+
+struct ImportedMaterial
+{
+	Material    material;
+	std::string texturePaths[MaterialTexture_Count]; // empty for the textures the material does not have
+};
+
+// A model as read from disk, before any OpenGL object or App resource is created for it
+struct ImportedModel
+{
+	Mesh                          mesh;
+	std::vector<ImportedMaterial> materials;
+	std::vector<u32>              submeshMaterialIndices; // into materials
+
+	// Set when the model comes from the model cache or a GLB file: the submeshes have no CPU copy
+	// of their geometry and the buffers are filled straight from the mapped file
+	MappedFile                    mappedFile;
+	const u8*                     vertexData;
+	u32                           vertexDataSize;
+	const u8*                     indexData;
+	u32                           indexDataSize;
+};
+
+// Assimp import, see assimpImport.h. It runs on any thread, like ImportObj() (obj_loader.h) and ImportGlb() (gltf_loader.h).
+bool ImportModel(const char* filename, ImportedModel& model);
+
+// Creates the placeholder texture (index 0, so it is also the default of every material) and model
+void InitAssetLoader(App* app);
+
+// Cancels the loads that have not started and waits for the running ones
+void ShutdownAssetLoader();
+
+// Blocks until the model and its textures are loaded. The retention says what geometry stays in CPU memory after the upload.
+u32 LoadModel(App* app, const char* filename, GeometryRetention retention);
+
+// Return immediately. The model is drawn as a placeholder cube and the texture is white until they are loaded.
+u32 LoadModelAsync(App* app, const char* filename, GeometryRetention retention);
+/**
+ * Loads the file of a model again, with another retention for instance. The model keeps its
+ * current geometry until the new one is uploaded, which then returns the old one to its pools.
+ * Returns false for the models built in code.
+ */
+bool ReloadModelAsync(App* app, u32 modelIdx, GeometryRetention retention);
+
+u32 LoadTexture2DAsync(App* app, const char* filepath);
+
+void ProcessAssetUploads(App* app);
+
+// Uploads every requested asset, waiting for the background jobs as needed
+void WaitForAssetLoads(App* app);
+
+u32 GetPendingAssetLoadCount();
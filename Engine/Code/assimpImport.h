@@ -1,7 +1,8 @@
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include "resources.h"
+#include "asset_loader.h"
+#include "culling.h"
 
 void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
 {
@@ -86,10 +87,15 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 bas
 	submesh.vertexBufferLayout = vertexBufferLayout;
 	submesh.vertices.swap(vertices);
 	submesh.indices.swap(indices);
+	submesh.vertexCount = mesh->mNumVertices;
+	submesh.indexCount = (u32)submesh.indices.size();
+	submesh.indexType = GL_UNSIGNED_INT;
+	ComputeSubmeshBounds(submesh);
 	myMesh->submeshes.push_back(submesh);
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+// Texture paths are only recorded: the textures are loaded on the GL thread once the import is done
+void ProcessAssimpMaterial(aiMaterial* material, ImportedMaterial& myMaterial, const std::string& directory)
 {
 	aiString name;
 	aiColor3D diffuseColor;
@@ -102,46 +108,23 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
 	material->Get(AI_MATKEY_COLOR_SPECULAR, specularColor);
 	material->Get(AI_MATKEY_SHININESS, shininess);
 
-	myMaterial.name = name.C_Str();
-	myMaterial.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
-	myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
-	myMaterial.smoothness = shininess / 256.0f;
+	myMaterial.material.name = name.C_Str();
+	myMaterial.material.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
+	myMaterial.material.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
+	myMaterial.material.smoothness = shininess / 256.0f;
+
+	const aiTextureType textureTypes[MaterialTexture_Count] = {
+		aiTextureType_DIFFUSE, aiTextureType_EMISSIVE, aiTextureType_SPECULAR, aiTextureType_NORMALS, aiTextureType_HEIGHT
+	};
 
 	aiString aiFilename;
-	if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-	{
-		material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-		String filename = MakeString(aiFilename.C_Str());
-		String filepath = MakePath(directory, filename);
-		myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
-	}
-	if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-	{
-		material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-		String filename = MakeString(aiFilename.C_Str());
-		String filepath = MakePath(directory, filename);
-		myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
-	}
-	if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
-	{
-		material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-		String filename = MakeString(aiFilename.C_Str());
-		String filepath = MakePath(directory, filename);
-		myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
-	}
-	if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+	for (u32 i = 0; i < MaterialTexture_Count; ++i)
 	{
-		material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-		String filename = MakeString(aiFilename.C_Str());
-		String filepath = MakePath(directory, filename);
-		myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
-	}
-	if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
-	{
-		material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-		String filename = MakeString(aiFilename.C_Str());
-		String filepath = MakePath(directory, filename);
-		myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+		if (material->GetTextureCount(textureTypes[i]) > 0)
+		{
+			material->GetTexture(textureTypes[i], 0, &aiFilename);
+			myMaterial.texturePaths[i] = directory + "/" + aiFilename.C_Str();
+		}
 	}
 
 	//myMaterial.createNormalFromBump();
@@ -163,7 +146,9 @@ void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 bas
 	}
 }
 
-u32 LoadModel(App* app, const char* filename)
+// Reads the file and builds the submeshes and materials without touching OpenGL or the App,
+// so it can run on any thread
+bool ImportModel(const char* filename, ImportedModel& model)
 {
 	const aiScene* scene = aiImportFile(filename,
 		aiProcess_Triangulate |
@@ -171,77 +156,30 @@ u32 LoadModel(App* app, const char* filename)
 		aiProcess_CalcTangentSpace |
 		aiProcess_JoinIdenticalVertices |
 		aiProcess_PreTransformVertices |
-		aiProcess_ImproveCacheLocality |
 		aiProcess_OptimizeMeshes |
 		aiProcess_SortByPType);
 
 	if (!scene)
 	{
 		ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-		return UINT32_MAX;
+		return false;
 	}
 
-	app->meshes.push_back(Mesh{});
-	Mesh& mesh = app->meshes.back();
-	u32 meshIdx = (u32)app->meshes.size() - 1u;
-
-	app->models.push_back(Model{});
-	Model& model = app->models.back();
-	model.meshIdx = meshIdx;
-	u32 modelIdx = (u32)app->models.size() - 1u;
-
-	String directory = GetDirectoryPart(MakeString(filename));
+	// the frame arena is not thread safe, so no String helpers here
+	std::string directory = filename;
+	const size_t separator = directory.find_last_of("/\\");
+	directory = separator != std::string::npos ? directory.substr(0, separator) : std::string(".");
 
 	// Create a list of materials
-	u32 baseMeshMaterialIndex = (u32)app->materials.size();
+	model.materials.resize(scene->mNumMaterials);
 	for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
 	{
-		app->materials.push_back(Material{});
-		Material& material = app->materials.back();
-		ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+		ProcessAssimpMaterial(scene->mMaterials[i], model.materials[i], directory);
 	}
 
-	ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+	ProcessAssimpNode(scene, scene->mRootNode, &model.mesh, 0, model.submeshMaterialIndices);
 
 	aiReleaseImport(scene);
 
-	u32 vertexBufferSize = 0;
-	u32 indexBufferSize = 0;
-
-	for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-	{
-		vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-		indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
-	}
-
-	glGenBuffers(1, &mesh.vertexBufferHandle);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-	glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
-
-	glGenBuffers(1, &mesh.indexBufferHandle);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
-
-	u32 indicesOffset = 0;
-	u32 verticesOffset = 0;
-
-	for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-	{
-		const void* verticesData = mesh.submeshes[i].vertices.data();
-		const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-		glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-		mesh.submeshes[i].vertexOffset = verticesOffset;
-		verticesOffset += verticesSize;
-
-		const void* indicesData = mesh.submeshes[i].indices.data();
-		const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-		mesh.submeshes[i].indexOffset = indicesOffset;
-		indicesOffset += indicesSize;
-	}
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	return modelIdx;
-}
\ No newline at end of file
+	return true;
+}
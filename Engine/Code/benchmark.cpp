@@ -0,0 +1,547 @@
+#include "benchmark.h"
+#include "scene.h"
+#include "obj_loader.h"
+#include "software_occlusion.h"
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <string.h>
+#include <stdlib.h>
+
+bool ParseBenchmarkArguments(Benchmark& benchmark, int argc, char** argv)
+{
+	benchmark.enabled = false;
+	benchmark.frameCount = 1000;
+	benchmark.warmupFrames = 60;
+	benchmark.frameDeltaTime = 1.0f / 60.0f;
+	benchmark.windowSize = glm::ivec2(0, 0);
+	benchmark.reportFile = "benchmark_report.json";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "--benchmark") == 0 && hasValue) {
+			benchmark.enabled = true;
+			benchmark.cameraPathFile = argv[++i];
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue) {
+			benchmark.frameCount = (u32)atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--warmup") == 0 && hasValue) {
+			benchmark.warmupFrames = (u32)atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--scene-benchmark") == 0) {
+			benchmark.sceneBenchmark = true;
+		}
+		else if (strcmp(arg, "--obj-benchmark") == 0) {
+			const bool hasFile = hasValue && strncmp(argv[i + 1], "--", 2) != 0;
+			benchmark.objBenchmarkFile = hasFile ? argv[++i] : "benchmark_grid.obj";
+		}
+		else if (strcmp(arg, "--occlusion-benchmark") == 0) {
+			benchmark.occlusionBenchmark = true;
+		}
+		else if (strcmp(arg, "--report") == 0 && hasValue) {
+			benchmark.reportFile = argv[++i];
+		}
+		else if (strcmp(arg, "--size") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &benchmark.windowSize.x, &benchmark.windowSize.y) != 2) {
+				ELOG("Invalid --size argument %s, expected WIDTHxHEIGHT", argv[i]);
+				return false;
+			}
+		}
+		else {
+			ELOG("Unknown or incomplete argument %s", arg);
+			return false;
+		}
+	}
+
+	if (benchmark.enabled && benchmark.frameCount == 0) {
+		ELOG("--frames must be greater than 0");
+		return false;
+	}
+
+	return true;
+}
+
+bool LoadCameraPath(Benchmark& benchmark, const char* filepath)
+{
+	FILE* file = fopen(filepath, "r");
+	if (!file) {
+		ELOG("fopen() failed reading camera path %s", filepath);
+		return false;
+	}
+
+	benchmark.cameraPath.clear();
+
+	char line[256];
+	u32 lineNumber = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		lineNumber++;
+
+		const char* cursor = line;
+		while (*cursor == ' ' || *cursor == '\t') cursor++;
+		if (*cursor == '#' || *cursor == '\n' || *cursor == '\r' || *cursor == '\0')
+			continue;
+
+		CameraKeyframe keyframe = {};
+		int read = sscanf(cursor, "%f %f %f %f %f %f %f", &keyframe.time,
+			&keyframe.position.x, &keyframe.position.y, &keyframe.position.z,
+			&keyframe.rotation.x, &keyframe.rotation.y, &keyframe.rotation.z);
+
+		if (read != 7) {
+			ELOG("%s:%u: expected \"time px py pz rx ry rz\"", filepath, lineNumber);
+			fclose(file);
+			return false;
+		}
+
+		if (!benchmark.cameraPath.empty() && keyframe.time < benchmark.cameraPath.back().time) {
+			ELOG("%s:%u: keyframe times must be increasing", filepath, lineNumber);
+			fclose(file);
+			return false;
+		}
+
+		benchmark.cameraPath.push_back(keyframe);
+	}
+
+	fclose(file);
+
+	if (benchmark.cameraPath.empty()) {
+		ELOG("Camera path %s has no keyframes", filepath);
+		return false;
+	}
+
+	return true;
+}
+
+void SampleCameraPath(const Benchmark& benchmark, f32 time, glm::vec3& position, glm::vec3& rotation)
+{
+	const std::vector<CameraKeyframe>& path = benchmark.cameraPath;
+
+	// the path loops when the benchmark runs for longer than the recording
+	const f32 duration = path.back().time;
+	if (duration > 0.0f) {
+		time = fmodf(time, duration);
+	}
+
+	u32 next = 0;
+	while (next < path.size() && path[next].time < time) next++;
+
+	if (next == 0 || next == path.size()) {
+		const CameraKeyframe& keyframe = next == 0 ? path.front() : path.back();
+		position = keyframe.position;
+		rotation = keyframe.rotation;
+		return;
+	}
+
+	const CameraKeyframe& a = path[next - 1];
+	const CameraKeyframe& b = path[next];
+	const f32 t = (time - a.time) / (b.time - a.time);
+	position = glm::mix(a.position, b.position, t);
+	rotation = glm::mix(a.rotation, b.rotation, t);
+}
+
+void InitBenchmark(Benchmark& benchmark)
+{
+	glGenQueries(BENCHMARK_GPU_QUERY_COUNT, benchmark.gpuQueries);
+	for (u32 i = 0; i < BENCHMARK_GPU_QUERY_COUNT; ++i)
+		benchmark.gpuQueryFrame[i] = UINT32_MAX;
+
+	benchmark.frames.reserve(benchmark.frameCount);
+	benchmark.frameIndex = 0;
+}
+
+void ShutdownBenchmark(Benchmark& benchmark)
+{
+	glDeleteQueries(BENCHMARK_GPU_QUERY_COUNT, benchmark.gpuQueries);
+}
+
+bool IsRecordingFrame(const Benchmark& benchmark)
+{
+	return benchmark.frameIndex >= benchmark.warmupFrames;
+}
+
+bool IsBenchmarkFinished(const Benchmark& benchmark)
+{
+	return benchmark.frames.size() >= benchmark.frameCount;
+}
+
+static void ResolveGpuQuery(Benchmark& benchmark, u32 slot)
+{
+	if (benchmark.gpuQueryFrame[slot] == UINT32_MAX)
+		return;
+
+	// blocks only if the GPU is more than BENCHMARK_GPU_QUERY_COUNT frames behind
+	GLuint64 elapsedNs = 0;
+	glGetQueryObjectui64v(benchmark.gpuQueries[slot], GL_QUERY_RESULT, &elapsedNs);
+
+	benchmark.frames[benchmark.gpuQueryFrame[slot]].gpuRenderMs = (f32)((f64)elapsedNs / 1.0e6);
+	benchmark.gpuQueryFrame[slot] = UINT32_MAX;
+}
+
+void BeginGpuTimer(Benchmark& benchmark)
+{
+	const u32 slot = benchmark.frameIndex % BENCHMARK_GPU_QUERY_COUNT;
+	ResolveGpuQuery(benchmark, slot);
+	glBeginQuery(GL_TIME_ELAPSED, benchmark.gpuQueries[slot]);
+}
+
+void EndGpuTimer(Benchmark& benchmark)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+
+	// the frame timing is pushed by RecordBenchmarkFrame() right after this frame
+	const u32 slot = benchmark.frameIndex % BENCHMARK_GPU_QUERY_COUNT;
+	benchmark.gpuQueryFrame[slot] = IsRecordingFrame(benchmark) && !IsBenchmarkFinished(benchmark) ? (u32)benchmark.frames.size() : UINT32_MAX;
+}
+
+void RecordBenchmarkFrame(Benchmark& benchmark, const FrameTiming& timing)
+{
+	if (IsRecordingFrame(benchmark) && !IsBenchmarkFinished(benchmark)) {
+		benchmark.frames.push_back(timing);
+	}
+	benchmark.frameIndex++;
+}
+
+static void WriteJsonString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\') fputc('\\', file);
+		fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+struct TimingStats
+{
+	f32 min, avg, p95, p99, max;
+};
+
+static TimingStats ComputeStats(const std::vector<FrameTiming>& frames, f32 FrameTiming::* field)
+{
+	TimingStats stats = {};
+	if (frames.empty())
+		return stats;
+
+	std::vector<f32> values;
+	values.reserve(frames.size());
+	f64 sum = 0.0;
+	for (const FrameTiming& frame : frames) {
+		values.push_back(frame.*field);
+		sum += frame.*field;
+	}
+	std::sort(values.begin(), values.end());
+
+	// nearest-rank percentiles
+	const u32 count = (u32)values.size();
+	const u32 p95 = (u32)ceilf(0.95f * count) - 1;
+	const u32 p99 = (u32)ceilf(0.99f * count) - 1;
+
+	stats.min = values.front();
+	stats.max = values.back();
+	stats.avg = (f32)(sum / count);
+	stats.p95 = values[p95];
+	stats.p99 = values[p99];
+	return stats;
+}
+
+bool WriteBenchmarkReport(Benchmark& benchmark, const char* gpuName)
+{
+	for (u32 slot = 0; slot < BENCHMARK_GPU_QUERY_COUNT; ++slot)
+		ResolveGpuQuery(benchmark, slot);
+
+	FILE* file = fopen(benchmark.reportFile.c_str(), "w");
+	if (!file) {
+		ELOG("fopen() failed writing benchmark report %s", benchmark.reportFile.c_str());
+		return false;
+	}
+
+	struct Metric { const char* name; f32 FrameTiming::* field; };
+	const Metric metrics[] = {
+		{ "frame_ms",      &FrameTiming::frameMs },
+		{ "cpu_update_ms", &FrameTiming::cpuUpdateMs },
+		{ "cpu_render_ms", &FrameTiming::cpuRenderMs },
+		{ "gpu_render_ms", &FrameTiming::gpuRenderMs },
+	};
+
+	const std::string& path = benchmark.reportFile;
+	const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+
+	if (json)
+	{
+		fprintf(file, "{\n");
+		fprintf(file, "  \"camera_path\": ");
+		WriteJsonString(file, benchmark.cameraPathFile.c_str());
+		fprintf(file, ",\n  \"renderer\": ");
+		WriteJsonString(file, gpuName);
+		fprintf(file, ",\n");
+		fprintf(file, "  \"frames\": %u,\n", (u32)benchmark.frames.size());
+		fprintf(file, "  \"summary\": {\n");
+		for (u32 i = 0; i < ARRAY_COUNT(metrics); ++i) {
+			TimingStats stats = ComputeStats(benchmark.frames, metrics[i].field);
+			fprintf(file, "    \"%s\": { \"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+				metrics[i].name, stats.min, stats.avg, stats.p95, stats.p99, stats.max,
+				i + 1 < ARRAY_COUNT(metrics) ? "," : "");
+		}
+		fprintf(file, "  },\n");
+		fprintf(file, "  \"per_frame\": [\n");
+		for (u32 i = 0; i < benchmark.frames.size(); ++i) {
+			const FrameTiming& frame = benchmark.frames[i];
+			fprintf(file, "    [%.4f, %.4f, %.4f, %.4f]%s\n", frame.frameMs, frame.cpuUpdateMs, frame.cpuRenderMs, frame.gpuRenderMs,
+				i + 1 < benchmark.frames.size() ? "," : "");
+		}
+		fprintf(file, "  ],\n");
+		fprintf(file, "  \"per_frame_columns\": [\"frame_ms\", \"cpu_update_ms\", \"cpu_render_ms\", \"gpu_render_ms\"]\n");
+		fprintf(file, "}\n");
+	}
+	else
+	{
+		fprintf(file, "metric,min,avg,p95,p99,max\n");
+		for (u32 i = 0; i < ARRAY_COUNT(metrics); ++i) {
+			TimingStats stats = ComputeStats(benchmark.frames, metrics[i].field);
+			fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f,%.4f\n", metrics[i].name, stats.min, stats.avg, stats.p95, stats.p99, stats.max);
+		}
+	}
+
+	fclose(file);
+
+	TimingStats frameStats = ComputeStats(benchmark.frames, &FrameTiming::frameMs);
+	ILOG("Benchmark: %u frames, frame time min %.3f ms, avg %.3f ms, p95 %.3f ms, p99 %.3f ms. Report written to %s",
+		(u32)benchmark.frames.size(), frameStats.min, frameStats.avg, frameStats.p95, frameStats.p99, path.c_str());
+
+	return true;
+}
+
+static f64 ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<f64, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void RunSceneUpdateBenchmark()
+{
+	const u32 objectCounts[] = { 10000, 100000 };
+	const u32 frames = 100;
+	const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f, 1000.0f)
+		* glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	for (u32 objectCount : objectCounts)
+	{
+		std::vector<GameObject> aos(objectCount);
+		GameObjectStore soa = {};
+		std::vector<glm::mat4> worldViewProjections(objectCount);
+
+		for (u32 i = 0; i < objectCount; ++i) {
+			GameObject& gameObject = aos[i];
+			gameObject.modelID = 0;
+			gameObject.programID = 0;
+			gameObject.transform.setPosition(glm::vec3((f32)(i % 100), (f32)(i / 100 % 100), (f32)(i / 10000)));
+			gameObject.transform.setRotation(glm::vec3((f32)(i % 360), 0.0f, 0.0f));
+			AddGameObject(soa, gameObject, glm::vec3(-1.0f), glm::vec3(1.0f));
+		}
+
+		for (u32 moving = 0; moving < 2; ++moving)
+		{
+			const glm::vec3 step = moving ? glm::vec3(0.001f, 0.0f, 0.0f) : glm::vec3(0.0f);
+
+			// AoS: one Transform per object, as the scene stored them before
+			auto start = std::chrono::high_resolution_clock::now();
+			for (u32 frame = 0; frame < frames; ++frame) {
+				for (u32 i = 0; i < objectCount; ++i) {
+					Transform& transform = aos[i].transform;
+					if (moving) transform.setPosition(transform.getPosition() + step);
+					worldViewProjections[i] = viewProjection * transform.getTransformationMatrix();
+				}
+			}
+			const f64 aosMs = ElapsedMs(start) / frames;
+
+			// SoA: the same work on the dense arrays of the store
+			start = std::chrono::high_resolution_clock::now();
+			for (u32 frame = 0; frame < frames; ++frame) {
+				TransformArrays& transforms = soa.transforms;
+				if (moving)
+					for (u32 i = 0; i < objectCount; ++i)
+						SetPosition(transforms, i, transforms.positions[i] + step);
+				UpdateWorldMatrices(transforms);
+				for (u32 i = 0; i < objectCount; ++i)
+					worldViewProjections[i] = viewProjection * transforms.worldMatrices[i];
+			}
+			const f64 soaMs = ElapsedMs(start) / frames;
+
+			ILOG("Scene update, %u %s objects: AoS %.3f ms/frame, SoA %.3f ms/frame (%.2fx)",
+				objectCount, moving ? "moving" : "static", aosMs, soaMs, aosMs / soaMs);
+		}
+	}
+}
+
+// Height field of columns x rows quads with positions, texture coordinates and normals, split in four materials
+static bool WriteGridObj(const char* filepath, u32 columns, u32 rows)
+{
+	FILE* file = fopen(filepath, "w");
+	if (!file) {
+		ELOG("fopen() failed writing %s", filepath);
+		return false;
+	}
+
+	for (u32 z = 0; z <= rows; ++z) {
+		for (u32 x = 0; x <= columns; ++x) {
+			const f32 height = sinf(x * 0.1f) * cosf(z * 0.1f);
+			const glm::vec3 normal = glm::normalize(glm::vec3(-0.1f * cosf(x * 0.1f) * cosf(z * 0.1f), 1.0f, 0.1f * sinf(x * 0.1f) * sinf(z * 0.1f)));
+			fprintf(file, "v %f %f %f\n", (f32)x * 0.1f, height, (f32)z * 0.1f);
+			fprintf(file, "vt %f %f\n", (f32)x / columns, (f32)z / rows);
+			fprintf(file, "vn %f %f %f\n", normal.x, normal.y, normal.z);
+		}
+	}
+
+	for (u32 z = 0; z < rows; ++z) {
+		if (z % (rows / 4) == 0)
+			fprintf(file, "usemtl band%u\n", z / (rows / 4));
+
+		for (u32 x = 0; x < columns; ++x) {
+			const u32 a = z * (columns + 1) + x + 1;
+			const u32 b = a + 1;
+			const u32 c = a + columns + 2;
+			const u32 d = a + columns + 1;
+			fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, d, d, d, c, c, c, b, b, b);
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+void RunObjLoaderBenchmark(const char* filepath)
+{
+	FILE* existing = fopen(filepath, "rb");
+	if (existing) {
+		fclose(existing);
+	}
+	else {
+		ILOG("Writing a %u triangle grid to %s", 1024 * 512 * 2, filepath);
+		if (!WriteGridObj(filepath, 1024, 512)) return;
+	}
+
+	typedef bool (*Importer)(const char*, ImportedModel&);
+	const Importer importers[] = { ImportModel, ImportObj };
+	const char* importerNames[] = { "Assimp", "OBJ parser" };
+	const u32 runs = 3;
+
+	f64 bestMs[2] = { DBL_MAX, DBL_MAX };
+	u32 vertexCount[2] = {};
+	u32 triangleCount[2] = {};
+
+	for (u32 run = 0; run < runs; ++run)
+	{
+		for (u32 i = 0; i < 2; ++i)
+		{
+			ImportedModel model = {};
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!importers[i](filepath, model)) return;
+			bestMs[i] = std::min(bestMs[i], ElapsedMs(start));
+
+			vertexCount[i] = triangleCount[i] = 0;
+			for (const Submesh& submesh : model.mesh.submeshes) {
+				vertexCount[i] += submesh.vertexCount;
+				triangleCount[i] += submesh.indexCount / 3;
+			}
+		}
+	}
+
+	ILOG("OBJ import of %s, best of %u runs, %u job workers:", filepath, runs, GetJobWorkerCount());
+	for (u32 i = 0; i < 2; ++i)
+		ILOG("  %-10s %9.1f ms, %u triangles, %u vertices", importerNames[i], bestMs[i], triangleCount[i], vertexCount[i]);
+	ILOG("  speedup %.2fx", bestMs[0] / bestMs[1]);
+}
+
+void RunSoftwareOcclusionBenchmark()
+{
+	// a street seen from eye height: a ground plane, two rows of house walls and the objects behind them
+	const u32 frames = 100;
+	const glm::vec3 eye(0.0f, 1.7f, 0.0f);
+	const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f)
+		* glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	const glm::vec3 boxPositions[] = {
+		{ -1, -1, -1 }, { 1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 }, { -1, -1, 1 }, { 1, -1, 1 }, { -1, 1, 1 }, { 1, 1, 1 } };
+	const u32 boxIndices[] = {
+		0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	const glm::vec3 planePositions[] = { { -1, 0, -1 }, { 1, 0, -1 }, { -1, 0, 1 }, { 1, 0, 1 } };
+	const u32 planeIndices[] = { 0, 2, 1, 1, 2, 3 };
+
+	std::vector<glm::mat4> walls;
+	for (u32 side = 0; side < 2; ++side)
+		for (u32 i = 0; i < 20; ++i)
+			walls.push_back(glm::translate(glm::vec3(side ? 6.0f : -6.0f, 3.0f, -8.0f - 10.0f * i)) * glm::scale(glm::vec3(4.0f, 3.0f, 4.5f)));
+	// the end of the street
+	walls.push_back(glm::translate(glm::vec3(0.0f, 4.0f, -210.0f)) * glm::scale(glm::vec3(12.0f, 4.0f, 1.0f)));
+	const glm::mat4 ground = glm::scale(glm::vec3(250.0f, 1.0f, 250.0f));
+
+	// a gate across the street tessellated like an imported mesh, its triangles a few pixels wide
+	const u32 gateCells = 16;
+	std::vector<glm::vec3> gatePositions;
+	std::vector<u32> gateIndices;
+	for (u32 y = 0; y <= gateCells; ++y)
+		for (u32 x = 0; x <= gateCells; ++x)
+			gatePositions.push_back(glm::vec3(-1.0f + 2.0f * x / gateCells, -1.0f + 2.0f * y / gateCells, 0.0f));
+	for (u32 y = 0; y < gateCells; ++y) {
+		for (u32 x = 0; x < gateCells; ++x) {
+			const u32 v = y * (gateCells + 1) + x;
+			const u32 quad[] = { v, v + 1, v + gateCells + 2, v, v + gateCells + 2, v + gateCells + 1 };
+			gateIndices.insert(gateIndices.end(), quad, quad + 6);
+		}
+	}
+	const glm::mat4 gate = glm::translate(glm::vec3(0.0f, 3.0f, -20.0f)) * glm::scale(glm::vec3(4.0f, 3.0f, 1.0f));
+
+	// boxes completely hidden by the gate: a crack between its triangles lets some through
+	std::vector<glm::vec3> gateOccludees;
+	for (u32 y = 0; y < 5; ++y)
+		for (u32 x = 0; x < 7; ++x)
+			gateOccludees.push_back(glm::vec3(-3.0f + x, 0.5f + y, -22.0f));
+
+	// occludees on a jittered grid, the same every run
+	std::vector<glm::vec3> occludees;
+	u32 seed = 12345;
+	for (u32 z = 0; z < 64; ++z) {
+		for (u32 x = 0; x < 64; ++x) {
+			seed = seed * 1664525u + 1013904223u;
+			const f32 jitter = (seed >> 8) / (f32)(1 << 24);
+			occludees.push_back(glm::vec3(-40.0f + x * 1.25f + jitter, 0.5f + jitter, -4.0f - z * 3.5f));
+		}
+	}
+
+	SoftwareOcclusionBuffer buffer = {};
+	f64 rasterizeMs = 0.0, testMs = 0.0;
+	u32 culledCount = 0;
+	u32 gateCulledCount = 0;
+
+	for (u32 frame = 0; frame < frames; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		BeginSoftwareOcclusion(buffer, viewProjection, 16.0f / 9.0f);
+		AddOccluderTriangles(buffer, ground, planePositions, planeIndices, ARRAY_COUNT(planeIndices));
+		for (const glm::mat4& wall : walls)
+			AddOccluderTriangles(buffer, wall, boxPositions, boxIndices, ARRAY_COUNT(boxIndices));
+		AddOccluderTriangles(buffer, gate, gatePositions.data(), gateIndices.data(), (u32)gateIndices.size());
+		RasterizeOccluders(buffer);
+		rasterizeMs += ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		culledCount = 0;
+		for (const glm::vec3& position : occludees)
+			culledCount += IsOccludedBySoftware(buffer, position - glm::vec3(0.5f), position + glm::vec3(0.5f)) ? 1 : 0;
+		testMs += ElapsedMs(start);
+
+		gateCulledCount = 0;
+		for (const glm::vec3& position : gateOccludees)
+			gateCulledCount += IsOccludedBySoftware(buffer, position - glm::vec3(0.25f), position + glm::vec3(0.25f)) ? 1 : 0;
+	}
+
+	ILOG("Software occlusion, %ux%u, %u job workers: %u occluders, %u triangles (%u skipped)",
+		buffer.width, buffer.height, GetJobWorkerCount(), buffer.occluderCount, buffer.triangleCount, buffer.skippedTriangleCount);
+	ILOG("  rasterization %.3f ms/frame, %u box tests %.3f ms/frame, %u occluded",
+		rasterizeMs / frames, (u32)occludees.size(), testMs / frames, culledCount);
+	ILOG("  %u of the %u boxes behind the tessellated gate occluded", gateCulledCount, (u32)gateOccludees.size());
+}
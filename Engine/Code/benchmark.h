@@ -0,0 +1,103 @@
+//
+// benchmark.h: Headless benchmark mode. It replays a recorded camera path through Update()
+// and Render() for a fixed number of frames and writes frame time statistics to a report.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define BENCHMARK_GPU_QUERY_COUNT 4
+
+struct CameraKeyframe
+{
+	f32       time;     // seconds since the start of the path
+	glm::vec3 position;
+	glm::vec3 rotation; // degrees
+};
+
+struct FrameTiming
+{
+	f32 frameMs;     // wall time of the whole frame (update + render + present)
+	f32 cpuUpdateMs;
+	f32 cpuRenderMs;
+	f32 gpuRenderMs;
+};
+
+struct Benchmark
+{
+	bool        enabled;
+	bool        sceneBenchmark; // runs RunSceneUpdateBenchmark() instead of the engine
+	std::string objBenchmarkFile; // runs RunObjLoaderBenchmark() on it instead of the engine
+	bool        occlusionBenchmark; // runs RunSoftwareOcclusionBenchmark() instead of the engine
+	u32         frameCount;     // frames recorded in the report
+	u32         warmupFrames;   // frames rendered before recording starts
+	f32         frameDeltaTime; // fixed timestep fed to the engine
+	glm::ivec2  windowSize;
+	std::string cameraPathFile;
+	std::string reportFile;
+
+	std::vector<CameraKeyframe> cameraPath;
+	std::vector<FrameTiming>    frames;
+
+	// GPU timer queries are used as a ring so reading them back never waits on the current frame
+	GLuint gpuQueries[BENCHMARK_GPU_QUERY_COUNT];
+	u32    gpuQueryFrame[BENCHMARK_GPU_QUERY_COUNT];
+	u32    frameIndex;
+};
+
+/**
+ * Parses the command line. Returns false if the arguments are malformed.
+ * --benchmark <camera_path.txt> [--frames N] [--warmup N] [--report file.json|file.csv] [--size WxH]
+ * --scene-benchmark
+ * --obj-benchmark [file.obj]
+ * --occlusion-benchmark
+ */
+bool ParseBenchmarkArguments(Benchmark& benchmark, int argc, char** argv);
+
+/**
+ * Camera paths are text files with one keyframe per line: "time px py pz rx ry rz".
+ * Empty lines and lines starting with '#' are ignored.
+ */
+bool LoadCameraPath(Benchmark& benchmark, const char* filepath);
+
+void SampleCameraPath(const Benchmark& benchmark, f32 time, glm::vec3& position, glm::vec3& rotation);
+
+void InitBenchmark(Benchmark& benchmark);
+void ShutdownBenchmark(Benchmark& benchmark);
+
+bool IsRecordingFrame(const Benchmark& benchmark);
+bool IsBenchmarkFinished(const Benchmark& benchmark);
+
+void BeginGpuTimer(Benchmark& benchmark);
+void EndGpuTimer(Benchmark& benchmark);
+
+void RecordBenchmarkFrame(Benchmark& benchmark, const FrameTiming& timing);
+
+/**
+ * Writes min/avg/p95/p99/max of every timing to the report file. The format is chosen
+ * from the file extension: ".json" also includes every recorded frame, anything else is CSV.
+ */
+bool WriteBenchmarkReport(Benchmark& benchmark, const char* gpuName);
+
+/**
+ * Microbenchmark of the per-frame object update (world and world-view-projection matrices)
+ * with 10k and 100k objects, comparing the AoS GameObject layout against the SoA scene store.
+ * Each case runs with every object moving and with every object static. Results are logged.
+ */
+void RunSceneUpdateBenchmark();
+
+/**
+ * Imports an OBJ file with Assimp and with the native OBJ parser and logs the best time of each.
+ * If the file does not exist, a height field of about a million triangles is written there first.
+ */
+void RunObjLoaderBenchmark(const char* filepath);
+
+/**
+ * Rasterizes the walls of a street and a tessellated gate across it, and tests a few thousand boxes
+ * behind them with the software occlusion culling, without a window or a GPU. Every box behind the
+ * gate is hidden, so fewer occluded ones than boxes means cracks between its triangles. The scene is the same every run, so the logged
+ * counts can be compared between machines.
+ */
+void RunSoftwareOcclusionBenchmark();
@@ -1,11 +1,12 @@
 #include "bloom.h"
+#include "gl_state.h"
 
 void BloomResources::Init(const int& screenWidth, const int& screenHeight)
 {
 	// bloom mipmap
-	if (rtBright != 0) { glDeleteTextures(1, &rtBright); }
+	if (rtBright != 0) { DeleteTexture(rtBright); }
 	glGenTextures(1, &rtBright);
-	glBindTexture(GL_TEXTURE_2D, rtBright);
+	BindTexture2D(0, rtBright);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -20,9 +21,9 @@ void BloomResources::Init(const int& screenWidth, const int& screenHeight)
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	// bloom mipmap
-	if (rtBloomH != 0) { glDeleteTextures(1, &rtBloomH); }
+	if (rtBloomH != 0) { DeleteTexture(rtBloomH); }
 	glGenTextures(1, &rtBloomH);
-	glBindTexture(GL_TEXTURE_2D, rtBloomH);
+	BindTexture2D(0, rtBloomH);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -1,4 +1,15 @@
 #include "buffer.h"
+#include "gl_state.h"
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP PFNBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+static PFNBUFFERSTORAGEPROC BufferStorage = NULL;
 
 bool IsPowerOf2(u32 value)
 {
@@ -28,6 +39,110 @@ Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
 #define CreateStaticVertexBuffer(size) CreateBuffer(size, GL_ARRAY_BUFFER, GL_STATIC_DRAW)
 #define CreateStaticIndexBuffer(size) CreateBuffer(size, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW)
 
+void LoadBufferStorageExtension(GLADloadproc load)
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool supported = major > 4 || (major == 4 && minor >= 4);
+
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount && !supported; ++i) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		supported = strcmp(extension, "GL_ARB_buffer_storage") == 0;
+	}
+
+	BufferStorage = supported ? (PFNBUFFERSTORAGEPROC)load("glBufferStorage") : NULL;
+
+	if (!BufferStorage) {
+		ILOG("glBufferStorage not available, ring buffers will use unsynchronized mapping");
+	}
+}
+
+Buffer CreateRingBuffer(u32 regionSize, GLenum type, u32 alignment)
+{
+	Buffer buffer = {};
+	buffer.type = type;
+	buffer.regionSize = Align(regionSize, alignment);
+	buffer.size = buffer.regionSize * BUFFER_RING_REGION_COUNT;
+	buffer.regionIndex = BUFFER_RING_REGION_COUNT - 1; // the first BeginRingFrame() moves to region 0
+
+	glGenBuffers(1, &buffer.handle);
+	glBindBuffer(type, buffer.handle);
+
+	if (BufferStorage)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		BufferStorage(type, buffer.size, NULL, flags);
+		buffer.persistentData = (u8*)glMapBufferRange(type, 0, buffer.size, flags);
+	}
+	else
+	{
+		glBufferData(type, buffer.size, NULL, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(type, 0);
+
+	return buffer;
+}
+
+void BeginRingFrame(Buffer& buffer)
+{
+	ASSERT(buffer.regionSize > 0, "The buffer must be created with CreateRingBuffer()");
+
+	buffer.regionIndex = (buffer.regionIndex + 1) % BUFFER_RING_REGION_COUNT;
+	buffer.regionBase = buffer.regionIndex * buffer.regionSize;
+	buffer.head = buffer.regionBase;
+
+	// wait until the GPU is done with the draws that read this region BUFFER_RING_REGION_COUNT frames ago
+	GLsync& fence = buffer.fences[buffer.regionIndex];
+	if (fence)
+	{
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			buffer.stallCount++;
+			do {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	if (buffer.persistentData)
+	{
+		buffer.data = buffer.persistentData + buffer.regionBase;
+	}
+	else
+	{
+		// the fence already guarantees the region is free, so the driver must not synchronize
+		glBindBuffer(buffer.type, buffer.handle);
+		buffer.data = glMapBufferRange(buffer.type, buffer.regionBase, buffer.regionSize,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		glBindBuffer(buffer.type, 0);
+	}
+}
+
+void EndRingFrame(Buffer& buffer)
+{
+	if (!buffer.persistentData)
+	{
+		glBindBuffer(buffer.type, buffer.handle);
+		glUnmapBuffer(buffer.type);
+		glBindBuffer(buffer.type, 0);
+		buffer.data = NULL;
+	}
+}
+
+void FenceRingFrame(Buffer& buffer)
+{
+	GLsync& fence = buffer.fences[buffer.regionIndex];
+	if (fence) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
 void BindBuffer(const Buffer& buffer)
 {
 	glBindBuffer(buffer.type, buffer.handle);
@@ -46,6 +161,113 @@ void UnmapBuffer(Buffer& buffer)
 	glBindBuffer(buffer.type, 0);
 }
 
+UniformArena CreateUniformArena(u32 pageSize, u32 alignment)
+{
+	UniformArena arena = {};
+	arena.pageSize = Align(pageSize, alignment);
+	arena.alignment = alignment;
+	arena.pages.push_back(CreateRingBuffer(arena.pageSize, GL_UNIFORM_BUFFER, alignment));
+	return arena;
+}
+
+void BeginUniformArenaFrame(UniformArena& arena)
+{
+	arena.currentPage = 0;
+	arena.usedPages = 1;
+	arena.frameBytes = 0;
+	BeginRingFrame(arena.pages[0]);
+}
+
+Buffer& BeginUniformBlock(UniformArena& arena, UniformBlock& block, u32 maxSize)
+{
+	ASSERT(maxSize <= arena.pageSize, "Uniform blocks cannot be larger than a page");
+
+	Buffer* page = &arena.pages[arena.currentPage];
+	AlignHead(*page, arena.alignment);
+
+	if (page->head + maxSize > page->regionBase + page->regionSize)
+	{
+		arena.currentPage++;
+		if (arena.currentPage == arena.pages.size())
+		{
+			arena.pages.push_back(CreateRingBuffer(arena.pageSize, GL_UNIFORM_BUFFER, arena.alignment));
+		}
+		arena.usedPages++;
+
+		page = &arena.pages[arena.currentPage];
+		BeginRingFrame(*page);
+	}
+
+	block.page = arena.currentPage;
+	block.offset = page->head;
+	block.size = 0;
+	return *page;
+}
+
+void EndUniformBlock(UniformArena& arena, UniformBlock& block)
+{
+	block.size = arena.pages[block.page].head - block.offset;
+}
+
+u8* ReserveUniformBlock(UniformArena& arena, UniformBlock& block, u32 size)
+{
+	Buffer& page = BeginUniformBlock(arena, block, size);
+	u8* data = (u8*)page.data + (page.head - page.regionBase);
+	page.head += size;
+	EndUniformBlock(arena, block);
+	return data;
+}
+
+void EndUniformArenaFrame(UniformArena& arena)
+{
+	for (u32 i = 0; i < arena.usedPages; ++i)
+	{
+		Buffer& page = arena.pages[i];
+		arena.frameBytes += page.head - page.regionBase;
+		EndRingFrame(page);
+	}
+
+	if (arena.frameBytes > arena.highWaterMark)
+		arena.highWaterMark = arena.frameBytes;
+}
+
+void FenceUniformArenaFrame(UniformArena& arena)
+{
+	for (u32 i = 0; i < arena.usedPages; ++i)
+		FenceRingFrame(arena.pages[i]);
+}
+
+void BindUniformBlock(const UniformArena& arena, const UniformBlock& block, u32 bindingPoint)
+{
+	BindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, arena.pages[block.page].handle, block.offset, block.size);
+}
+
+void BindStorageBlock(const UniformArena& arena, const UniformBlock& block, u32 bindingPoint)
+{
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, bindingPoint, arena.pages[block.page].handle, block.offset, block.size);
+}
+
+void BindStoragePage(const UniformArena& arena, u32 page, u32 bindingPoint)
+{
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, bindingPoint, arena.pages[page].handle, 0, arena.pages[page].size);
+}
+
+u32 GetUniformArenaStallCount(const UniformArena& arena)
+{
+	u32 stallCount = 0;
+	for (const Buffer& page : arena.pages)
+		stallCount += page.stallCount;
+	return stallCount;
+}
+
+u32 GetUniformArenaOverflowCount(const UniformArena& arena)
+{
+	u32 overflowCount = 0;
+	for (const Buffer& page : arena.pages)
+		overflowCount += page.overflowCount;
+	return overflowCount;
+}
+
 void AlignHead(Buffer& buffer, u32 alignment)
 {
 	ASSERT(IsPowerOf2(alignment), "The alignment must be a power of 2");
@@ -56,6 +278,15 @@ void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 {
 	ASSERT(buffer.data != NULL, "The buffer must be mapped first");
 	AlignHead(buffer, alignment);
-	memcpy((u8*)buffer.data + buffer.head, data, size);
+
+	const u32 limit = buffer.regionSize > 0 ? buffer.regionBase + buffer.regionSize : buffer.size;
+	if (buffer.head + size > limit)
+	{
+		ASSERT(false, "Trying to push more data than the buffer can hold");
+		buffer.overflowCount++;
+		return;
+	}
+
+	memcpy((u8*)buffer.data + (buffer.head - buffer.regionBase), data, size);
 	buffer.head += size;
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "platform.h"
 #include <glad/glad.h>
 
+#define BUFFER_RING_REGION_COUNT 3
+
 struct Buffer 
 {
 	GLuint handle;
@@ -10,6 +12,43 @@ struct Buffer
 	u32 size;
 	u32 head;
 	void* data; // mapped data
+
+	// Ring mode: the buffer is split in regions that are written on consecutive frames.
+	// Each region is guarded by a fence, so the CPU never overwrites data the GPU still reads.
+	u32    regionSize;
+	u32    regionIndex;
+	u32    regionBase; // offset of the region being written (always 0 for regular buffers)
+	GLsync fences[BUFFER_RING_REGION_COUNT];
+	u8*    persistentData; // whole buffer mapping, NULL if glBufferStorage is not available
+
+	u32    stallCount; // frames in which the CPU had to wait for the GPU to release a region
+
+	u32    overflowCount; // pushes dropped because they did not fit in the buffer (or ring region)
+};
+
+// Location of a block of uniforms written into a UniformArena
+struct UniformBlock
+{
+	u32 page;   // index of the arena page holding the block
+	u32 offset; // byte offset inside the page buffer
+	u32 size;
+};
+
+/**
+ * Growable allocator for per-frame uniforms. It chains as many ring buffer pages as the
+ * frame needs, so the amount of uniforms is not bounded by a single buffer allocation.
+ * A single block can never be larger than a page.
+ */
+struct UniformArena
+{
+	std::vector<Buffer> pages;
+	u32 pageSize;
+	u32 alignment;
+	u32 currentPage;
+	u32 usedPages;     // pages written this frame
+
+	u32 frameBytes;    // bytes written this frame (including alignment padding)
+	u32 highWaterMark; // largest frameBytes seen so far
 };
 
 bool IsPowerOf2(u32 value);
@@ -18,11 +57,54 @@ u32 Align(u32 value, u32 alignment);
 
 Buffer CreateBuffer(u32 size, GLenum type, GLenum usage);
 
+/**
+ * glad is generated for OpenGL 4.3, so glBufferStorage (4.4 or ARB_buffer_storage) is loaded here
+ * once there is a current context. Without it ring buffers map each region unsynchronized instead.
+ */
+void LoadBufferStorageExtension(GLADloadproc load);
+
+/**
+ * Creates a buffer of BUFFER_RING_REGION_COUNT regions, persistently mapped when possible.
+ * regionSize is rounded up to alignment so every region starts at a valid binding offset.
+ */
+Buffer CreateRingBuffer(u32 regionSize, GLenum type, u32 alignment);
+
+void BeginRingFrame(Buffer& buffer); // waits for the next region to be free and maps it
+void EndRingFrame(Buffer& buffer);   // finishes the writes of this frame
+void FenceRingFrame(Buffer& buffer); // call after the draws reading this frame's region are submitted
+
 void BindBuffer(const Buffer& buffer);
 
 void MapBuffer(Buffer& buffer, GLenum access);
 void UnmapBuffer(Buffer& buffer);
 
+UniformArena CreateUniformArena(u32 pageSize, u32 alignment);
+
+void BeginUniformArenaFrame(UniformArena& arena);
+
+/**
+ * Starts a block of at most maxSize bytes and returns the page it must be pushed into.
+ * Moves on to the next page (creating it if needed) when the current one has no room left.
+ */
+Buffer& BeginUniformBlock(UniformArena& arena, UniformBlock& block, u32 maxSize);
+void EndUniformBlock(UniformArena& arena, UniformBlock& block);
+
+/**
+ * Reserves a block of size bytes and returns where its data goes. The memory stays mapped
+ * until EndUniformArenaFrame(), so blocks can be filled later and from other threads.
+ */
+u8* ReserveUniformBlock(UniformArena& arena, UniformBlock& block, u32 size);
+
+void EndUniformArenaFrame(UniformArena& arena);
+void FenceUniformArenaFrame(UniformArena& arena);
+
+void BindUniformBlock(const UniformArena& arena, const UniformBlock& block, u32 bindingPoint);
+void BindStorageBlock(const UniformArena& arena, const UniformBlock& block, u32 bindingPoint);
+void BindStoragePage(const UniformArena& arena, u32 page, u32 bindingPoint); // the whole page buffer, all its regions
+
+u32 GetUniformArenaStallCount(const UniformArena& arena);
+u32 GetUniformArenaOverflowCount(const UniformArena& arena);
+
 void AlignHead(Buffer& buffer, u32 alignment);
 
 void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
@@ -33,7 +115,8 @@ void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
 
 #define PushData(buffer, data, size) PushAlignedData(buffer, data, size, 1)
 #define PushUInt(buffer, value) { u32 v = value; PushAlignedData(buffer, &v, sizeof(v), 4); }
-#define PushVec3(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushVec4(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat3(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat4(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
\ No newline at end of file
+#define PushFloat(buffer, value) { f32 v = value; PushAlignedData(buffer, &v, sizeof(v), 4); }
+#define PushVec3(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(glm::vec4))
+#define PushVec4(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(glm::vec4))
+#define PushMat3(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(glm::vec4))
+#define PushMat4(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(glm::vec4))
\ No newline at end of file
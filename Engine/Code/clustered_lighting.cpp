@@ -0,0 +1,192 @@
+#include "clustered_lighting.h"
+#include "gl_state.h"
+#include <float.h>
+#include <algorithm>
+
+void InitLightClusters(LightClusters& clusters, u32 storageBufferAlignment)
+{
+	// std430 Light: type, radius, color, direction, position -> 64 bytes
+	clusters.lightsBuffer = CreateRingBuffer(MAX_CLUSTERED_LIGHTS * 4 * sizeof(glm::vec4), GL_SHADER_STORAGE_BUFFER, storageBufferAlignment);
+	clusters.clustersBuffer = CreateRingBuffer(CLUSTER_COUNT * sizeof(glm::uvec2), GL_SHADER_STORAGE_BUFFER, storageBufferAlignment);
+	clusters.lightIndicesBuffer = CreateRingBuffer(MAX_CLUSTER_LIGHT_INDICES * sizeof(u32), GL_SHADER_STORAGE_BUFFER, storageBufferAlignment);
+
+	clusters.clusterCounts.resize(CLUSTER_COUNT);
+	clusters.clusters.resize(CLUSTER_COUNT);
+	clusters.lightIndices.resize(MAX_CLUSTER_LIGHT_INDICES);
+}
+
+static i32 DepthSlice(const LightClusters& clusters, f32 viewDepth)
+{
+	// same computation as the screen quad shader
+	i32 slice = (i32)floorf(logf(glm::max(viewDepth, 1e-6f)) * clusters.sliceScale - clusters.sliceBias);
+	return glm::clamp(slice, 0, CLUSTER_GRID_Z - 1);
+}
+
+static void PushLight(Buffer& buffer, const LightStore& lights, u32 index)
+{
+	const glm::mat4& lightMatrix = lights.transforms.worldMatrices[index];
+
+	AlignHead(buffer, sizeof(glm::vec4));
+	PushUInt(buffer, lights.types[index]);
+	PushFloat(buffer, lights.radii[index]);
+	PushVec3(buffer, lights.colors[index]);
+	PushVec3(buffer, glm::vec3(lightMatrix[2]));
+	PushVec3(buffer, lights.transforms.positions[index]);
+}
+
+void BuildLightClusters(LightClusters& clusters, const LightStore& lights, const glm::mat4& view, const glm::mat4& projection,
+	glm::ivec2 displaySize, f32 zNear, f32 zFar)
+{
+	clusters.tileSize = glm::vec2(ceilf((f32)displaySize.x / CLUSTER_GRID_X), ceilf((f32)displaySize.y / CLUSTER_GRID_Y));
+	clusters.tileSize = glm::max(clusters.tileSize, glm::vec2(1.0f));
+	clusters.sliceScale = CLUSTER_GRID_Z / logf(zFar / zNear);
+	clusters.sliceBias = CLUSTER_GRID_Z * logf(zNear) / logf(zFar / zNear);
+
+	clusters.lightCount = 0;
+	clusters.directionalLightCount = 0;
+	clusters.droppedLights = 0;
+	clusters.clusterBoxes.clear();
+
+	std::fill(clusters.clusterCounts.begin(), clusters.clusterCounts.end(), 0u);
+
+	BeginRingFrame(clusters.lightsBuffer);
+	BeginRingFrame(clusters.clustersBuffer);
+	BeginRingFrame(clusters.lightIndicesBuffer);
+
+	// directional lights reach every cluster, so the shader loops over them apart
+	const u32 lightCount = GetCount(lights.handles);
+
+	for (u32 i = 0; i < lightCount; ++i)
+	{
+		if (lights.types[i] != LightType_Directional) continue;
+		if (clusters.lightCount == MAX_CLUSTERED_LIGHTS) { clusters.droppedLights++; continue; }
+
+		PushLight(clusters.lightsBuffer, lights, i);
+		clusters.lightCount++;
+		clusters.directionalLightCount++;
+	}
+
+	// point lights: find the range of clusters overlapped by their sphere of influence
+	for (u32 i = 0; i < lightCount; ++i)
+	{
+		if (lights.types[i] != LightType_Point) continue;
+		if (clusters.lightCount == MAX_CLUSTERED_LIGHTS) { clusters.droppedLights++; continue; }
+
+		const glm::vec3 center = glm::vec3(view * glm::vec4(lights.transforms.positions[i], 1.0f));
+		const f32 radius = lights.radii[i];
+
+		// the view looks towards -z
+		const f32 depthMin = -center.z - radius;
+		const f32 depthMax = -center.z + radius;
+
+		const u32 lightIndex = clusters.lightCount;
+		PushLight(clusters.lightsBuffer, lights, i);
+		clusters.lightCount++;
+
+		if (depthMax < zNear || depthMin > zFar)
+			continue;
+
+		i32 x0 = 0, x1 = CLUSTER_GRID_X - 1;
+		i32 y0 = 0, y1 = CLUSTER_GRID_Y - 1;
+
+		// lights crossing the near plane can cover any tile, otherwise project the corners of their view space box
+		if (depthMin > zNear)
+		{
+			glm::vec2 ndcMin = glm::vec2(FLT_MAX);
+			glm::vec2 ndcMax = glm::vec2(-FLT_MAX);
+			for (u32 corner = 0; corner < 8; ++corner)
+			{
+				glm::vec4 point = glm::vec4(
+					center.x + ((corner & 1) ? radius : -radius),
+					center.y + ((corner & 2) ? radius : -radius),
+					center.z + ((corner & 4) ? radius : -radius),
+					1.0f);
+				glm::vec4 clip = projection * point;
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				ndcMin = glm::min(ndcMin, ndc);
+				ndcMax = glm::max(ndcMax, ndc);
+			}
+
+			if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+				continue;
+
+			glm::vec2 pixelMin = (glm::clamp(ndcMin, -1.0f, 1.0f) * 0.5f + 0.5f) * glm::vec2(displaySize);
+			glm::vec2 pixelMax = (glm::clamp(ndcMax, -1.0f, 1.0f) * 0.5f + 0.5f) * glm::vec2(displaySize);
+			x0 = glm::clamp((i32)(pixelMin.x / clusters.tileSize.x), 0, CLUSTER_GRID_X - 1);
+			x1 = glm::clamp((i32)(pixelMax.x / clusters.tileSize.x), 0, CLUSTER_GRID_X - 1);
+			y0 = glm::clamp((i32)(pixelMin.y / clusters.tileSize.y), 0, CLUSTER_GRID_Y - 1);
+			y1 = glm::clamp((i32)(pixelMax.y / clusters.tileSize.y), 0, CLUSTER_GRID_Y - 1);
+		}
+
+		const i32 z0 = DepthSlice(clusters, glm::max(depthMin, zNear));
+		const i32 z1 = DepthSlice(clusters, glm::min(depthMax, zFar));
+
+		u32 box[] = { lightIndex, (u32)x0, (u32)x1, (u32)y0, (u32)y1, (u32)z0, (u32)z1 };
+		clusters.clusterBoxes.insert(clusters.clusterBoxes.end(), box, box + ARRAY_COUNT(box));
+
+		for (i32 z = z0; z <= z1; ++z)
+			for (i32 y = y0; y <= y1; ++y)
+				for (i32 x = x0; x <= x1; ++x)
+					clusters.clusterCounts[(z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x]++;
+	}
+
+	// prefix sum of the counts gives the start of every cluster list
+	u32 offset = 0;
+	clusters.maxLightsPerCluster = 0;
+	clusters.droppedLightIndices = 0;
+	for (u32 i = 0; i < CLUSTER_COUNT; ++i)
+	{
+		u32 count = clusters.clusterCounts[i];
+		if (offset + count > MAX_CLUSTER_LIGHT_INDICES)
+		{
+			clusters.droppedLightIndices += offset + count - MAX_CLUSTER_LIGHT_INDICES;
+			count = MAX_CLUSTER_LIGHT_INDICES - offset;
+		}
+
+		clusters.clusters[i] = glm::uvec2(offset, 0);
+		clusters.clusterCounts[i] = count; // capacity left for the fill pass
+		clusters.maxLightsPerCluster = glm::max(clusters.maxLightsPerCluster, count);
+		offset += count;
+	}
+	clusters.lightIndexCount = offset;
+
+	for (u32 i = 0; i < clusters.clusterBoxes.size(); i += 7)
+	{
+		const u32* box = &clusters.clusterBoxes[i];
+		for (u32 z = box[5]; z <= box[6]; ++z)
+			for (u32 y = box[3]; y <= box[4]; ++y)
+				for (u32 x = box[1]; x <= box[2]; ++x)
+				{
+					const u32 clusterIndex = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+					glm::uvec2& cluster = clusters.clusters[clusterIndex];
+					if (cluster.y < clusters.clusterCounts[clusterIndex])
+					{
+						clusters.lightIndices[cluster.x + cluster.y] = box[0];
+						cluster.y++;
+					}
+				}
+	}
+
+	PushData(clusters.clustersBuffer, clusters.clusters.data(), CLUSTER_COUNT * sizeof(glm::uvec2));
+	PushData(clusters.lightIndicesBuffer, clusters.lightIndices.data(), clusters.lightIndexCount * sizeof(u32));
+
+	EndRingFrame(clusters.lightsBuffer);
+	EndRingFrame(clusters.clustersBuffer);
+	EndRingFrame(clusters.lightIndicesBuffer);
+}
+
+void BindLightClusters(const LightClusters& clusters)
+{
+	const Buffer* buffers[] = { &clusters.lightsBuffer, &clusters.clustersBuffer, &clusters.lightIndicesBuffer };
+	const u32 bindings[] = { LIGHTS_BINDING, CLUSTERS_BINDING, CLUSTER_LIGHT_INDICES_BINDING };
+
+	for (u32 i = 0; i < ARRAY_COUNT(buffers); ++i)
+		BindBufferRange(GL_SHADER_STORAGE_BUFFER, bindings[i], buffers[i]->handle, buffers[i]->regionBase, buffers[i]->regionSize);
+}
+
+void FenceLightClusters(LightClusters& clusters)
+{
+	FenceRingFrame(clusters.lightsBuffer);
+	FenceRingFrame(clusters.clustersBuffer);
+	FenceRingFrame(clusters.lightIndicesBuffer);
+}
@@ -0,0 +1,65 @@
+//
+// clustered_lighting.h: Assigns lights to a grid of view space clusters (froxels) so the
+// screen quad shader only evaluates the lights that can reach each pixel.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "buffer.h"
+#include "scene.h"
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+#define MAX_CLUSTERED_LIGHTS 16384
+#define MAX_CLUSTER_LIGHT_INDICES (CLUSTER_COUNT * 128)
+
+// Shader storage bindings used by the screen quad shader
+#define LIGHTS_BINDING                0
+#define CLUSTERS_BINDING              1
+#define CLUSTER_LIGHT_INDICES_BINDING 2
+
+struct LightClusters
+{
+	// Ring buffers bound as shader storage buffers
+	Buffer lightsBuffer;       // every light, directional lights first
+	Buffer clustersBuffer;     // (first index, light count) per cluster
+	Buffer lightIndicesBuffer; // light indices referenced by the clusters
+
+	// Parameters the shader needs to find the cluster of a pixel
+	glm::vec2 tileSize;   // in pixels
+	f32       sliceScale; // slice = log(viewDepth) * sliceScale - sliceBias
+	f32       sliceBias;
+
+	u32 lightCount;
+	u32 directionalLightCount;
+
+	// stats of the last build
+	u32 lightIndexCount;
+	u32 maxLightsPerCluster;
+	u32 droppedLights;
+	u32 droppedLightIndices;
+
+	// scratch memory reused every frame
+	std::vector<u32>        clusterCounts;
+	std::vector<glm::uvec2> clusters;
+	std::vector<u32>        lightIndices;
+	std::vector<u32>        clusterBoxes; // per point light: light index, x0, x1, y0, y1, z0, z1
+};
+
+void InitLightClusters(LightClusters& clusters, u32 storageBufferAlignment);
+
+/**
+ * Writes the lights and their cluster lists for this frame. Point lights are assigned to the
+ * clusters overlapped by the view space bounds of their influence sphere. The world matrices
+ * of the lights must be up to date.
+ */
+void BuildLightClusters(LightClusters& clusters, const LightStore& lights, const glm::mat4& view, const glm::mat4& projection,
+	glm::ivec2 displaySize, f32 zNear, f32 zFar);
+
+void BindLightClusters(const LightClusters& clusters);
+
+void FenceLightClusters(LightClusters& clusters);
@@ -0,0 +1,159 @@
+#include "culling.h"
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define CULLING_SSE 1
+#include <xmmintrin.h>
+#else
+#define CULLING_SSE 0
+#endif
+
+void ComputeSubmeshBounds(Submesh& submesh)
+{
+	const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+
+	u32 positionOffset = 0;
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+		if (attribute.location == 0) positionOffset = attribute.offset;
+
+	const u8* vertexData = (const u8*)submesh.vertices.data();
+	const u32 vertexCount = layout.stride > 0 ? (u32)(submesh.vertices.size() * sizeof(float) / layout.stride) : 0;
+
+	ComputeSubmeshBounds(submesh, vertexData + positionOffset, layout.stride, vertexCount);
+}
+
+void ComputeSubmeshBounds(Submesh& submesh, const u8* positions, u32 stride, u32 vertexCount)
+{
+	if (vertexCount == 0) {
+		submesh.aabbMin = submesh.aabbMax = submesh.boundingSphereCenter = vec3(0.0f);
+		submesh.boundingSphereRadius = 0.0f;
+		return;
+	}
+
+	vec3 aabbMin = vec3(FLT_MAX);
+	vec3 aabbMax = vec3(-FLT_MAX);
+	for (u32 i = 0; i < vertexCount; ++i) {
+		const vec3 position = *(const vec3*)(positions + i * stride);
+		aabbMin = glm::min(aabbMin, position);
+		aabbMax = glm::max(aabbMax, position);
+	}
+
+	// sphere centered in the box, with the radius of the farthest vertex (tighter than half the diagonal)
+	const vec3 center = (aabbMin + aabbMax) * 0.5f;
+	f32 radiusSquared = 0.0f;
+	for (u32 i = 0; i < vertexCount; ++i) {
+		const vec3 position = *(const vec3*)(positions + i * stride);
+		const vec3 toVertex = position - center;
+		radiusSquared = glm::max(radiusSquared, glm::dot(toVertex, toVertex));
+	}
+
+	submesh.aabbMin = aabbMin;
+	submesh.aabbMax = aabbMax;
+	submesh.boundingSphereCenter = center;
+	submesh.boundingSphereRadius = sqrtf(radiusSquared);
+}
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+	// Gribb & Hartmann: the planes are sums and differences of the rows of the matrix
+	const glm::mat4 m = glm::transpose(viewProjection);
+
+	Frustum frustum;
+	frustum.planes[0] = m[3] + m[0]; // left
+	frustum.planes[1] = m[3] - m[0]; // right
+	frustum.planes[2] = m[3] + m[1]; // bottom
+	frustum.planes[3] = m[3] - m[1]; // top
+	frustum.planes[4] = m[3] + m[2]; // near
+	frustum.planes[5] = m[3] - m[2]; // far
+
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+void ClearCullingBoxes(CullingBoxes& boxes)
+{
+	boxes.centerX.clear(); boxes.centerY.clear(); boxes.centerZ.clear();
+	boxes.extentX.clear(); boxes.extentY.clear(); boxes.extentZ.clear();
+	boxes.count = 0;
+}
+
+u32 AddCullingBox(CullingBoxes& boxes, const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& worldMatrix)
+{
+	// the world space extent of a transformed box is |M| * extent
+	const vec3 center = vec3(worldMatrix * vec4((aabbMin + aabbMax) * 0.5f, 1.0f));
+	const vec3 localExtent = (aabbMax - aabbMin) * 0.5f;
+	const glm::mat3 absolute = glm::mat3(glm::abs(vec3(worldMatrix[0])), glm::abs(vec3(worldMatrix[1])), glm::abs(vec3(worldMatrix[2])));
+	const vec3 extent = absolute * localExtent;
+
+	boxes.centerX.push_back(center.x); boxes.centerY.push_back(center.y); boxes.centerZ.push_back(center.z);
+	boxes.extentX.push_back(extent.x); boxes.extentY.push_back(extent.y); boxes.extentZ.push_back(extent.z);
+	return boxes.count++;
+}
+
+u32 CullBoxes(const Frustum& frustum, CullingBoxes& boxes, std::vector<u8>& visible)
+{
+	// pad to a multiple of 4 so the loop always loads full lanes
+	const u32 paddedCount = (boxes.count + 3) & ~3u;
+	boxes.centerX.resize(paddedCount, 0.0f); boxes.centerY.resize(paddedCount, 0.0f); boxes.centerZ.resize(paddedCount, 0.0f);
+	boxes.extentX.resize(paddedCount, 0.0f); boxes.extentY.resize(paddedCount, 0.0f); boxes.extentZ.resize(paddedCount, 0.0f);
+	visible.resize(paddedCount);
+
+	u32 visibleCount = 0;
+
+#if CULLING_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	__m128 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+	for (u32 p = 0; p < 6; ++p) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		absPlaneX[p] = _mm_set1_ps(fabsf(frustum.planes[p].x));
+		absPlaneY[p] = _mm_set1_ps(fabsf(frustum.planes[p].y));
+		absPlaneZ[p] = _mm_set1_ps(fabsf(frustum.planes[p].z));
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (u32 i = 0; i < paddedCount; i += 4)
+	{
+		const __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		// a box is outside if it is completely behind any plane: distance(center) + projected extent < 0
+		__m128 outside = _mm_setzero_ps();
+		for (u32 p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absPlaneX[p], ex), _mm_mul_ps(absPlaneY[p], ey)), _mm_mul_ps(absPlaneZ[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		const int outsideMask = _mm_movemask_ps(outside);
+		for (u32 lane = 0; lane < 4; ++lane)
+			visible[i + lane] = (outsideMask >> lane) & 1 ? 0 : 1;
+	}
+#else
+	for (u32 i = 0; i < paddedCount; ++i)
+	{
+		bool outside = false;
+		for (u32 p = 0; p < 6 && !outside; ++p) {
+			const glm::vec4& plane = frustum.planes[p];
+			f32 distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+			f32 radius = fabsf(plane.x) * boxes.extentX[i] + fabsf(plane.y) * boxes.extentY[i] + fabsf(plane.z) * boxes.extentZ[i];
+			outside = distance + radius < 0.0f;
+		}
+		visible[i] = outside ? 0 : 1;
+	}
+#endif
+
+	for (u32 i = 0; i < boxes.count; ++i)
+		visibleCount += visible[i];
+
+	return visibleCount;
+}
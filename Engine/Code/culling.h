@@ -0,0 +1,42 @@
+//
+// culling.h: Bounding volumes of the submeshes and view frustum culling of their world space
+// boxes, four boxes at a time.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+struct Frustum
+{
+	// normalized planes (xyz: normal pointing inside, w: distance), a point p is inside a plane when dot(xyz, p) + w >= 0
+	glm::vec4 planes[6];
+};
+
+// World space axis aligned boxes in SoA layout, so the frustum test loads four boxes per component
+struct CullingBoxes
+{
+	std::vector<f32> centerX, centerY, centerZ;
+	std::vector<f32> extentX, extentY, extentZ;
+	u32              count;
+};
+
+// Computes the model space AABB and bounding sphere of the submesh from its vertex positions (location 0)
+void ComputeSubmeshBounds(Submesh& submesh);
+
+// Same, from positions that are not in submesh.vertices (a mapped file), vertexCount vec3 stride bytes apart
+void ComputeSubmeshBounds(Submesh& submesh, const u8* positions, u32 stride, u32 vertexCount);
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+void ClearCullingBoxes(CullingBoxes& boxes);
+
+// Adds the world space box enclosing the model space box transformed by worldMatrix and returns its index
+u32 AddCullingBox(CullingBoxes& boxes, const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::mat4& worldMatrix);
+
+/**
+ * Tests every box against the frustum. visible[i] is set to 1 for the boxes inside or
+ * intersecting it, 0 for the ones completely outside. Returns the number of visible boxes.
+ */
+u32 CullBoxes(const Frustum& frustum, CullingBoxes& boxes, std::vector<u8>& visible);
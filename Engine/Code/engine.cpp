@@ -6,14 +6,25 @@
 //
 
 #include "engine.h"
-#include "assimpImport.h"
+#include "asset_loader.h"
+#include "gltf_loader.h"
+#include "geometry.h"
+#include "mesh_optimizer.h"
+#include "vertex_quantization.h"
 #include "buffer.h"
+#include "gl_state.h"
+#include "job_system.h"
 #include <imgui.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include <iostream>
+#include <algorithm>
+#include <float.h>
 
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+u32 GlobalTransformMatrixRecomputeCount = 0;
+
+// Compiles one stage of a program source, which picks its code with the shader name, variant and stage defines
+static GLuint CompileShader(GLenum type, const char* stageDefine, const char* stageName, String programSource, const char* shaderName, const char* variantName)
 {
 	GLchar  infoLogBuffer[1024] = {};
 	GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
@@ -23,57 +34,48 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 	char versionString[] = "#version 430\n";
 	char shaderNameDefine[128];
 	sprintf(shaderNameDefine, "#define %s\n", shaderName);
-	char vertexShaderDefine[] = "#define VERTEX\n";
-	char fragmentShaderDefine[] = "#define FRAGMENT\n";
+	char variantDefine[128] = {};
+	if (variantName) sprintf(variantDefine, "#define %s\n", variantName);
 
-	const GLchar* vertexShaderSource[] = {
-		versionString,
-		shaderNameDefine,
-		vertexShaderDefine,
-		programSource.str
-	};
-	const GLint vertexShaderLengths[] = {
-		(GLint) strlen(versionString),
-		(GLint) strlen(shaderNameDefine),
-		(GLint) strlen(vertexShaderDefine),
-		(GLint) programSource.len
-	};
-	const GLchar* fragmentShaderSource[] = {
+	const GLchar* shaderSource[] = {
 		versionString,
 		shaderNameDefine,
-		fragmentShaderDefine,
+		variantDefine,
+		stageDefine,
 		programSource.str
 	};
-	const GLint fragmentShaderLengths[] = {
+	const GLint shaderLengths[] = {
 		(GLint) strlen(versionString),
 		(GLint) strlen(shaderNameDefine),
-		(GLint) strlen(fragmentShaderDefine),
+		(GLint) strlen(variantDefine),
+		(GLint) strlen(stageDefine),
 		(GLint) programSource.len
 	};
 
-	GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
-	glCompileShader(vshader);
-	glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, ARRAY_COUNT(shaderSource), shaderSource, shaderLengths);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success)
 	{
-		glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-		ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+		glGetShaderInfoLog(shader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+		ELOG("glCompileShader() failed with %s shader %s\nReported message:\n%s\n", stageName, shaderName, infoLogBuffer);
 	}
 
-	GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fshader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
-	glCompileShader(fshader);
-	glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-		ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
-	}
+	return shader;
+}
+
+// Links the shaders into a program, then deletes them
+static GLuint LinkProgram(const GLuint* shaders, u32 shaderCount, const char* shaderName)
+{
+	GLchar  infoLogBuffer[1024] = {};
+	GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+	GLsizei infoLogSize;
+	GLint   success;
 
 	GLuint programHandle = glCreateProgram();
-	glAttachShader(programHandle, vshader);
-	glAttachShader(programHandle, fshader);
+	for (u32 i = 0; i < shaderCount; ++i)
+		glAttachShader(programHandle, shaders[i]);
 	glLinkProgram(programHandle);
 	glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
 	if (!success)
@@ -82,22 +84,59 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 		ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
 	}
 
-	glUseProgram(0);
+	for (u32 i = 0; i < shaderCount; ++i)
+	{
+		glDetachShader(programHandle, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+
+	return programHandle;
+}
+
+GLuint CreateProgramFromSource(String programSource, const char* shaderName, const char* variantName = NULL)
+{
+	const GLuint shaders[] = {
+		CompileShader(GL_VERTEX_SHADER, "#define VERTEX\n", "vertex", programSource, shaderName, variantName),
+		CompileShader(GL_FRAGMENT_SHADER, "#define FRAGMENT\n", "fragment", programSource, shaderName, variantName)
+	};
+	GLuint programHandle = LinkProgram(shaders, ARRAY_COUNT(shaders), shaderName);
 
-	glDetachShader(programHandle, vshader);
-	glDetachShader(programHandle, fshader);
-	glDeleteShader(vshader);
-	glDeleteShader(fshader);
+	UseProgram(0);
 
 	return programHandle;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+GLuint CreateComputeProgramFromSource(String programSource, const char* shaderName)
+{
+	const GLuint shader = CompileShader(GL_COMPUTE_SHADER, "#define COMPUTE\n", "compute", programSource, shaderName, NULL);
+	return LinkProgram(&shader, 1, shaderName);
+}
+
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName)
+{
+	String programSource = ReadTextFile(filepath);
+
+	Program program = {};
+	program.handle = CreateComputeProgramFromSource(programSource, programName);
+	program.quantizedVariantIdx = UINT32_MAX;
+	program.filepath = filepath;
+	program.programName = programName;
+	program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+	program.vertexInputLayout.stride = 0;
+	program.vertexInputMask = 0;
+
+	app->programs.push_back(program);
+
+	return app->programs.size() - 1;
+}
+
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* variantName = NULL)
 {
 	String programSource = ReadTextFile(filepath);
 
 	Program program = {};
-	program.handle = CreateProgramFromSource(programSource, programName);
+	program.handle = CreateProgramFromSource(programSource, programName, variantName);
+	program.quantizedVariantIdx = UINT32_MAX;
 	program.filepath = filepath;
 	program.programName = programName;
 	program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
@@ -123,6 +162,9 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
 		if (attributeType == GL_FLOAT_VEC3) {
 			attributeSize = 3;
 		}
+		if (attributeType == GL_FLOAT_VEC4) {
+			attributeSize = 4;
+		}
 
 		int attributeLocation = glGetAttribLocation(program.handle, attributeName);
 
@@ -132,15 +174,31 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
 	}
 	program.vertexInputLayout = vertexBufferLayout;
 
+	program.vertexInputMask = 0;
+	for (const VertexBufferAttribute& attribute : vertexBufferLayout.attributes)
+		program.vertexInputMask |= 1u << attribute.location;
+
 	app->programs.push_back(program);
 
 	return app->programs.size() - 1;
 }
 
+// Mesh programs are also compiled for the quantized vertex format, see vertex_quantization.h
+u32 LoadMeshProgram(App* app, const char* filepath, const char* programName)
+{
+	const u32 programIdx = LoadProgram(app, filepath, programName);
+	const u32 quantizedProgramIdx = LoadProgram(app, filepath, programName, "QUANTIZED_VERTICES");
+	app->programs[programIdx].quantizedVariantIdx = quantizedProgramIdx;
+	return programIdx;
+}
+
 Image LoadImage(const char* filename)
 {
+	if (IsGlbImagePath(filename))
+		return LoadGlbImage(filename);
+
 	Image img = {};
-	stbi_set_flip_vertically_on_load(true);
+	// images are flipped vertically on load, see InitAssetLoader()
 	img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
 	if (img.pixels)
 	{
@@ -173,7 +231,7 @@ GLuint CreateTexture2DFromImage(Image image)
 
 	GLuint texHandle;
 	glGenTextures(1, &texHandle);
-	glBindTexture(GL_TEXTURE_2D, texHandle);
+	BindTexture2D(0, texHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -181,7 +239,7 @@ GLuint CreateTexture2DFromImage(Image image)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTexture2D(0, 0);
 
 	return texHandle;
 }
@@ -216,47 +274,47 @@ void CreateScreenFramebuffers(App* app)
 {
 	// color
 	glGenTextures(1, &app->colorAttachmentHandle);
-	glBindTexture(GL_TEXTURE_2D, app->colorAttachmentHandle);
+	BindTexture2D(0, app->colorAttachmentHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTexture2D(0, 0);
 
 	// normal
 	glGenTextures(1, &app->normalAttachmentHandle);
-	glBindTexture(GL_TEXTURE_2D, app->normalAttachmentHandle);
+	BindTexture2D(0, app->normalAttachmentHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTexture2D(0, 0);
 
 	// position
 	glGenTextures(1, &app->positionAttachmentHandle);
-	glBindTexture(GL_TEXTURE_2D, app->positionAttachmentHandle);
+	BindTexture2D(0, app->positionAttachmentHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTexture2D(0, 0);
 
 	// depth
 	glGenTextures(1, &app->depthAttachmentHandle);
-	glBindTexture(GL_TEXTURE_2D, app->depthAttachmentHandle);
+	BindTexture2D(0, app->depthAttachmentHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTexture2D(0, 0);
 
 
 	// framebuffer object (FBO)
@@ -278,43 +336,70 @@ void CreateFramebuffers(App* app)
 {
 	CreateScreenFramebuffers(app);
 	app->bloom.Init(app->displaySize.x, app->displaySize.y);
+	ResizeHiZ(app->hiZ, app->displaySize);
 }
 
-GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program) {
+GLuint FindVAO(App* app, Mesh& mesh, u32 submeshIndex, const Program& program) {
 	Submesh& submesh = mesh.submeshes[submeshIndex];
 
-	// try finding a VAO for this submesh / program
-	for (u32 i = 0; i < (u32)submesh.vaos.size(); ++i) {
-		if (submesh.vaos[i].programHandle == program.handle) {
-			return submesh.vaos[i].handle;
-		}
+	if (submesh.vertexLayoutHash == 0)
+		submesh.vertexLayoutHash = HashVertexLayout(submesh.vertexBufferLayout);
+
+	GLuint vertexBufferHandle, indexBufferHandle;
+	GetSubmeshBuffers(app, mesh, submesh, vertexBufferHandle, indexBufferHandle);
+
+	// whole vertices of the offset are skipped with the base vertex of the draw, see GetBaseVertex().
+	// Pooled submeshes start at whole vertices, so all those of a format share the VAO.
+	VAOKey key = {};
+	key.vertexBufferHandle = vertexBufferHandle;
+	key.indexBufferHandle = indexBufferHandle;
+	key.vertexLayoutHash = submesh.vertexLayoutHash;
+	key.programInputMask = program.vertexInputMask;
+	key.vertexOffsetRemainder = submesh.vertexOffset % submesh.vertexBufferLayout.stride;
+
+	auto it = app->vaoCache.find(key);
+	if (it != app->vaoCache.end()) {
+		return it->second;
 	}
 
 	GLuint vaoHandle = 0;
 
-	// create a new VAO for this submesh / program
+	// create a new VAO for this layout / program inputs
 	{
 		glGenVertexArrays(1, &vaoHandle);
-		glBindVertexArray(vaoHandle);
+		BindVertexArray(vaoHandle);
 
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferHandle);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferHandle);
 
 		// link all vertex input attributes to attributes in the vertex buffer
 		for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i) 
 		{
 			bool attributeIsLinked = false;
 
+			if (program.vertexInputLayout.attributes[i].location == INSTANCE_INDEX_LOCATION)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, app->instanceIndexBuffer);
+				glVertexAttribIPointer(INSTANCE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(u32), (void*)0);
+				glVertexAttribDivisor(INSTANCE_INDEX_LOCATION, 1);
+				glEnableVertexAttribArray(INSTANCE_INDEX_LOCATION);
+				glBindBuffer(GL_ARRAY_BUFFER, vertexBufferHandle);
+				continue;
+			}
+
 			for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j) 
 			{
 				if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
 				{
 					const u32 index = submesh.vertexBufferLayout.attributes[j].location;
 					const u32 numComponents = submesh.vertexBufferLayout.attributes[j].componentCount;
-					const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset;
-					const u32 stride = submesh.vertexBufferLayout.stride;
+					const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + key.vertexOffsetRemainder;
+					const u32 stride = submesh.vertexBufferLayout.attributes[j].stride ? submesh.vertexBufferLayout.attributes[j].stride : submesh.vertexBufferLayout.stride;
 
-					glVertexAttribPointer(index, numComponents, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
+					const GLenum type = submesh.vertexBufferLayout.attributes[j].type;
+					const GLboolean normalized = submesh.vertexBufferLayout.attributes[j].normalized ? GL_TRUE : GL_FALSE;
+
+					glVertexAttribPointer(index, numComponents, type, normalized, stride, (void*)(u64)offset);
 					glEnableVertexAttribArray(index);
 
 					attributeIsLinked = true;
@@ -326,27 +411,75 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program) {
 			assert(attributeIsLinked);
 		}
 
-		glBindVertexArray(0);
+		BindVertexArray(0);
 	}
 
-	// store vao into the list of vaos for this submesh
-	VAO vao = { vaoHandle, program.handle };
-	submesh.vaos.push_back(vao);
+	app->vaoCache[key] = vaoHandle;
 
 	return vaoHandle;
 }
 
+i32 GetBaseVertex(const Submesh& submesh)
+{
+	return (i32)(submesh.vertexOffset / submesh.vertexBufferLayout.stride);
+}
+
+void GetModelBounds(App* app, u32 modelID, vec3& boundsMin, vec3& boundsMax)
+{
+	const Mesh& mesh = app->meshes[app->models[modelID].meshIdx];
+	boundsMin = vec3(FLT_MAX);
+	boundsMax = vec3(-FLT_MAX);
+	for (const Submesh& submesh : mesh.submeshes) {
+		boundsMin = glm::min(boundsMin, submesh.aabbMin);
+		boundsMax = glm::max(boundsMax, submesh.aabbMax);
+	}
+}
+
+Handle AddGameObject(App* app, const GameObject& gameObject)
+{
+	vec3 boundsMin, boundsMax;
+	GetModelBounds(app, gameObject.modelID, boundsMin, boundsMax);
+
+	return AddGameObject(app->scene.gameObjects, gameObject, boundsMin, boundsMax);
+}
+
+void AddStressTestLights(App* app, u32 count)
+{
+	const u32 columns = (u32)ceilf(sqrtf((f32)count));
+	for (u32 i = 0; i < count; ++i) {
+		Light light;
+		light.type = LightType_Point;
+		light.color = vec3(float(i % 4) / 3.0f, float(i % 8) / 7.0f, float(i % 16) / 15.0f);
+		light.radius = 2.0f;
+		light.transform.setPosition(vec3(float(i % columns) - columns * 0.5f, -3.0f, float(i / columns) - columns * 0.5f));
+		light.transform.setScale(vec3(0.05f, 0.05f, 0.05f));
+
+		AddLight(app->scene.lights, light);
+	}
+}
+
 void Init(App* app)
 {
+	InvalidateGLState();
+
+	InitAssetLoader(app);
+
 	app->framebufferToDisplay = FramebufferDisplayType::FINAL;
 	app->useBloom = true;
 	app->showGuizmos = true;
 	app->UIshowInfo = false;
 	app->UIsceneHierarchy = true;
-	app->gameObjectSelected = nullptr;
-	app->lightSelected = nullptr;
+	app->gameObjectSelected = NULL_HANDLE;
+	app->lightSelected = NULL_HANDLE;
 	app->UIgameObjectInspector = true;
 	app->UIlightInspector = true;
+	app->useInstancing = true;
+	app->useIndirectDraws = true;
+	app->sortRenderQueues = true;
+	app->useFrustumCulling = true;
+	app->useGpuCulling = false;
+	app->useOcclusionCulling = true;
+	app->useSoftwareOcclusion = false;
 
 	app->glVersion = glGetString(GL_VERSION);
 	app->glRenderer = glGetString(GL_RENDERER);
@@ -404,7 +537,7 @@ void Init(App* app)
 
 		// attributes
 		glGenVertexArrays(1, &app->quadVAO);
-		glBindVertexArray(app->quadVAO);
+		BindVertexArray(app->quadVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
 
 		for (int i = 0; i < vertexBufferLayout.attributes.size(); ++i) {
@@ -413,7 +546,7 @@ void Init(App* app)
 		}
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
-		glBindVertexArray(0);
+		BindVertexArray(0);
 
 		app->screenQuadProgramIdx = LoadProgram(app, "screen_quad.glsl", "SCREEN_QUAD");
 		Program& texturedGeometryProgram = app->programs[app->screenQuadProgramIdx];
@@ -426,7 +559,7 @@ void Init(App* app)
 
 	// load basic shapes
 	{
-		app->basicShapesProgramIdx = LoadProgram(app, "deferred_mesh.glsl", "BASIC_SHAPE");
+		app->basicShapesProgramIdx = LoadMeshProgram(app, "deferred_mesh.glsl", "BASIC_SHAPE");
 
 		// plane
 		{
@@ -474,47 +607,19 @@ void Init(App* app)
 				submesh.vertexBufferLayout = vertexBufferLayout;
 				submesh.vertices.swap(vertices);
 				submesh.indices.swap(indices);
+				submesh.vertexCount = (u32)(submesh.vertices.size() * sizeof(float) / vertexBufferLayout.stride);
+				submesh.indexCount = (u32)submesh.indices.size();
+				submesh.indexType = GL_UNSIGNED_INT;
+				ComputeSubmeshBounds(submesh);
 				mesh.submeshes.push_back(submesh);
 			}
 
-			u32 vertexBufferSize = 0;
-			u32 indexBufferSize = 0;
-
-			// change for specific mesh
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-				indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
-			}
-
-			glGenBuffers(1, &mesh.vertexBufferHandle);
-			glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-			glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
-
-			glGenBuffers(1, &mesh.indexBufferHandle);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
-
-			u32 indicesOffset = 0;
-			u32 verticesOffset = 0;
+			OptimizeMesh(mesh, "plane");
+			QuantizeMesh(mesh, "plane");
+			NarrowMeshIndices(mesh, "plane");
 
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				const void* verticesData = mesh.submeshes[i].vertices.data();
-				const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-				glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-				mesh.submeshes[i].vertexOffset = verticesOffset;
-				verticesOffset += verticesSize;
-
-				const void* indicesData = mesh.submeshes[i].indices.data();
-				const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-				mesh.submeshes[i].indexOffset = indicesOffset;
-				indicesOffset += indicesSize;
-			}
-
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			// the positions stay for the software occlusion culling
+			UploadMeshBuffers(app, mesh, GeometryRetention_KeepCompressed);
 
 			app->planeIdx = modelIdx;
 		}
@@ -580,47 +685,17 @@ void Init(App* app)
 				submesh.vertexBufferLayout = vertexBufferLayout;
 				submesh.vertices.swap(vertices);
 				submesh.indices.swap(indices);
+				submesh.vertexCount = (u32)(submesh.vertices.size() * sizeof(float) / vertexBufferLayout.stride);
+				submesh.indexCount = (u32)submesh.indices.size();
+				submesh.indexType = GL_UNSIGNED_INT;
+				ComputeSubmeshBounds(submesh);
 				mesh.submeshes.push_back(submesh);
 			}
 
-			u32 vertexBufferSize = 0;
-			u32 indexBufferSize = 0;
-
-			// change for specific mesh
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-				indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
-			}
-
-			glGenBuffers(1, &mesh.vertexBufferHandle);
-			glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-			glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
-
-			glGenBuffers(1, &mesh.indexBufferHandle);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
-
-			u32 indicesOffset = 0;
-			u32 verticesOffset = 0;
-
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				const void* verticesData = mesh.submeshes[i].vertices.data();
-				const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-				glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-				mesh.submeshes[i].vertexOffset = verticesOffset;
-				verticesOffset += verticesSize;
-
-				const void* indicesData = mesh.submeshes[i].indices.data();
-				const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-				mesh.submeshes[i].indexOffset = indicesOffset;
-				indicesOffset += indicesSize;
-			}
-
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			OptimizeMesh(mesh, "cube");
+			QuantizeMesh(mesh, "cube");
+			NarrowMeshIndices(mesh, "cube");
+			UploadMeshBuffers(app, mesh, GeometryRetention_KeepCompressed);
 
 			app->cubeIdx = modelIdx;
 		}
@@ -672,7 +747,7 @@ void Init(App* app)
 
 				// process indices (CHANGE MANUALLY)
 				for (int h = 0; h < H; ++h) {
-					for (int v = 0; v < V + 1; ++v) {
+					for (int v = 0; v < V; ++v) {
 						indices.push_back(	(h + 0)			* (V + 1)	+ v);
 						indices.push_back(	((h + 1) % H)	* (V + 1)	+ v);
 						indices.push_back(	((h + 1) % H)	* (V + 1)	+ v+1);
@@ -691,47 +766,17 @@ void Init(App* app)
 				submesh.vertexBufferLayout = vertexBufferLayout;
 				submesh.vertices.swap(vertices);
 				submesh.indices.swap(indices);
+				submesh.vertexCount = (u32)(submesh.vertices.size() * sizeof(float) / vertexBufferLayout.stride);
+				submesh.indexCount = (u32)submesh.indices.size();
+				submesh.indexType = GL_UNSIGNED_INT;
+				ComputeSubmeshBounds(submesh);
 				mesh.submeshes.push_back(submesh);
 			}
 
-			u32 vertexBufferSize = 0;
-			u32 indexBufferSize = 0;
-
-			// change for specific mesh
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-				indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
-			}
-
-			glGenBuffers(1, &mesh.vertexBufferHandle);
-			glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-			glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
-
-			glGenBuffers(1, &mesh.indexBufferHandle);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
-
-			u32 indicesOffset = 0;
-			u32 verticesOffset = 0;
-
-			for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-			{
-				const void* verticesData = mesh.submeshes[i].vertices.data();
-				const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-				glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-				mesh.submeshes[i].vertexOffset = verticesOffset;
-				verticesOffset += verticesSize;
-
-				const void* indicesData = mesh.submeshes[i].indices.data();
-				const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-				mesh.submeshes[i].indexOffset = indicesOffset;
-				indicesOffset += indicesSize;
-			}
-
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			OptimizeMesh(mesh, "sphere");
+			QuantizeMesh(mesh, "sphere");
+			NarrowMeshIndices(mesh, "sphere");
+			UploadMeshBuffers(app, mesh, GeometryRetention_Drop);
 
 			app->sphereIdx = modelIdx;
 		}
@@ -739,41 +784,45 @@ void Init(App* app)
 
 	// mesh
 	{
-		app->scene.gameObjects.push_back(GameObject());
-		GameObject& gameObject = app->scene.gameObjects.back();
+		GameObject gameObject;
 
 		// geometry
-		u32 modelID = LoadModel(app, "Patrick/patrick.obj");
+		u32 modelID = LoadModelAsync(app, "Patrick/patrick.obj", GeometryRetention_Drop);
 		gameObject.modelID = modelID;
 
 		// program
-		u32 programID = LoadProgram(app, "deferred_mesh.glsl", "TEXTURED_MESH");
+		u32 programID = LoadMeshProgram(app, "deferred_mesh.glsl", "TEXTURED_MESH");
 		gameObject.programID = programID;
 
-		app->scene.gameObjects.push_back(GameObject());
-		GameObject& gameObject2 = app->scene.gameObjects.back();
+		AddGameObject(app, gameObject);
+
+		GameObject gameObject2;
 
 		gameObject2.modelID = modelID;
 		gameObject2.programID = programID;
 
 		gameObject2.transform.setPosition(vec3(5.0f, 0.0f, 0.0f));
 
-		app->scene.gameObjects.push_back(GameObject());
-		GameObject& bakerHouse = app->scene.gameObjects.back();
+		AddGameObject(app, gameObject2);
+
+		GameObject bakerHouse;
 
 		// geometry
-		u32 bakerHouseModelID = LoadModel(app, "Baker House/BakerHouse.fbx");
+		// kept compressed, so its walls occlude with the software occlusion culling
+		u32 bakerHouseModelID = LoadModelAsync(app, "Baker House/BakerHouse.fbx", GeometryRetention_KeepCompressed);
 		bakerHouse.modelID = bakerHouseModelID;
 
 		bakerHouse.programID = programID;
 
 		bakerHouse.transform.setPosition(vec3(-5.0f, 0.0f, 0.0f));
 		bakerHouse.transform.setScale(vec3(0.01f, 0.01f, 0.01f));
+		bakerHouse.isOccluder = true;
+
+		AddGameObject(app, bakerHouse);
 	}
 
 
-	app->scene.gameObjects.push_back(GameObject());
-	GameObject& plane = app->scene.gameObjects.back();
+	GameObject plane;
 
 	plane.transform.setScale(vec3(10.0f, 10.0f, 10.0f));
 	plane.transform.setPosition(vec3(0, -3.5f, 0));
@@ -781,6 +830,9 @@ void Init(App* app)
 
 	plane.modelID = app->planeIdx;
 	plane.programID = app->basicShapesProgramIdx;
+	plane.isOccluder = true;
+
+	AddGameObject(app, plane);
 
 
 
@@ -796,76 +848,101 @@ void Init(App* app)
 		light1.color = vec3(1.0f, 1.0f, 0.0f);
 		light1.transform.setPosition(vec3(0.0f, 2.0f, -1.0f));
 		light1.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light1.radius = 10.0f;
 	
-		app->scene.lights.push_back(light1);
+		AddLight(app->scene.lights, light1);
 	
 		Light light2;
 		light2.type = LightType_Directional;
 		light2.color = vec3(1.0f, 1.0f, 1.0f);
 		light2.transform.setRotation(vec3(170, 0, 0));
 		light2.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light2.radius = 10.0f;
 	
-		app->scene.lights.push_back(light2);
+		AddLight(app->scene.lights, light2);
 
 		Light light3;
 		light3.type = LightType_Point;
 		light3.color = vec3(0.0f, 1.0f, 1.0f);
 		light3.transform.setPosition(vec3(-3.0f, -2.0f, -1.0f));
 		light3.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light3.radius = 10.0f;
 
-		app->scene.lights.push_back(light3);
+		AddLight(app->scene.lights, light3);
 
 		Light light4;
 		light4.type = LightType_Point;
 		light4.color = vec3(1.0f, 0.0f, 1.0f);
 		light4.transform.setPosition(vec3(3.0f, -2.0f, -2.0f));
 		light4.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light4.radius = 10.0f;
 
-		app->scene.lights.push_back(light4);
+		AddLight(app->scene.lights, light4);
 
 		Light light5;
 		light5.type = LightType_Point;
 		light5.color = vec3(1.0f, 0.0f, 0.0f);
 		light5.transform.setPosition(vec3(5.0f, 1.0f, -3.0f));
 		light5.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light5.radius = 10.0f;
 
-		app->scene.lights.push_back(light5);
+		AddLight(app->scene.lights, light5);
 
 		Light light6;
 		light6.type = LightType_Point;
 		light6.color = vec3(0.0f, 1.0f, 0.0f);
 		light6.transform.setPosition(vec3(0.0f, -2.0f, -3.0f));
 		light6.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light6.radius = 10.0f;
 
-		app->scene.lights.push_back(light6);
+		AddLight(app->scene.lights, light6);
 
 		Light light7;
 		light7.type = LightType_Point;
 		light7.color = vec3(0.0f, 0.0f, 1.0f);
 		light7.transform.setPosition(vec3(-5.0f, 2.0f, -2.0f));
 		light7.transform.setScale(vec3(0.2f, 0.2f, 0.2f));
+		light7.radius = 10.0f;
 
-		app->scene.lights.push_back(light7);
+		AddLight(app->scene.lights, light7);
 
 	}
 
-	// stress test lights
-	//{
-	//	// when trying to reach 256 the uniform buffer overflows
-	//	for (int i = 0; i < 128; ++i) {
-	//		Light light;
-	//		light.type = LightType_Point;
-	//		light.color = vec3(float(i % 4) / 3.0f, float(i % 8) / 7.0f, float(i % 16) / 15.0f);
-	//		light.transform.translate(vec3(i % 4, -0.5f, floorf(i / 4)), GLOBAL);
-	//		light.transform.scale(vec3(0.2f, 0.2f, 0.2f));
-	//
-	//		app->scene.lights.push_back(light);
-	//	}
-	//}
+	// stress test lights (also available from the Lights menu)
+	//AddStressTestLights(app, 1024);
 	
 	// for each buffer you need
 
-	app->uniformsBuffer = CreateBuffer(maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+	// the global block must fit in a single uniform block binding, instance blocks are chained in more pages
+	// instance data is also read from the arena as shader storage blocks
+	int storageBufferAlignment;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageBufferAlignment);
+	// indirect draws address the instance blocks in whole InstanceData from the start of their page
+	u32 arenaAlignment = glm::max(app->uniformBlockAlignment, storageBufferAlignment);
+	arenaAlignment = glm::max(arenaAlignment, (u32)sizeof(InstanceData));
+
+	app->uniforms = CreateUniformArena(glm::max(maxUniformBufferSize, UNIFORM_ARENA_PAGE_SIZE), arenaAlignment);
+
+	{
+		const u32 instanceIndexCount = Align(app->uniforms.pageSize, arenaAlignment) * BUFFER_RING_REGION_COUNT / sizeof(InstanceData);
+		std::vector<u32> instanceIndices(instanceIndexCount);
+		for (u32 i = 0; i < instanceIndexCount; ++i)
+			instanceIndices[i] = i;
+
+		glGenBuffers(1, &app->instanceIndexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, app->instanceIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, instanceIndexCount * sizeof(u32), instanceIndices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	InitLightClusters(app->lightClusters, storageBufferAlignment);
+
+	u32 cullingProgramIdx = LoadComputeProgram(app, "gpu_culling.glsl", "FRUSTUM_CULLING");
+	InitGpuCulling(app->gpuCulling, app->programs[cullingProgramIdx].handle);
+
+	u32 hiZCopyProgramIdx = LoadComputeProgram(app, "hi_z.glsl", "HIZ_COPY");
+	u32 hiZReduceProgramIdx = LoadComputeProgram(app, "hi_z.glsl", "HIZ_REDUCE");
+	InitHiZ(app->hiZ, app->programs[hiZCopyProgramIdx].handle, app->programs[hiZReduceProgramIdx].handle);
 
 	//glGenBuffers(1, &app->globalUniformBuffer.handle);
 	//glBindBuffer(GL_UNIFORM_BUFFER, app->globalUniformBuffer.handle);
@@ -888,6 +965,58 @@ void Gui(App* app)
 		ImGui::Begin("Info", &app->UIshowInfo);
 
 		ImGui::Text("FPS: %f", 1.0f / app->deltaTime);
+		ImGui::Text("Uniform pages: %u (%u used this frame)", (u32)app->uniforms.pages.size(), app->uniforms.usedPages);
+		ImGui::Text("Uniform bytes this frame: %u (high-water mark %u)", app->uniforms.frameBytes, app->uniforms.highWaterMark);
+		ImGui::Text("Uniform buffer stalls: %u", GetUniformArenaStallCount(app->uniforms));
+		ImGui::Text("Uniform buffer overflows: %u", GetUniformArenaOverflowCount(app->uniforms));
+		ImGui::Checkbox("Instancing", &app->useInstancing);
+		ImGui::Checkbox("Sort render queues", &app->sortRenderQueues);
+		ImGui::Checkbox("Indirect draws", &app->useIndirectDraws);
+		ImGui::Text("Transform matrices recomputed: %u", app->transformMatrixRecomputeCount);
+		ImGui::Text("Job workers: %u", GetJobWorkerCount());
+		ImGui::Text("Asset loads pending: %u", GetPendingAssetLoadCount());
+		const GeometryMemoryStats geometry = GetGeometryMemoryStats(app);
+		ImGui::Text("Geometry: CPU %.2f MB (%u meshes kept), compressed %.2f MB (%u meshes), GPU %.2f MB (%u meshes)",
+			geometry.cpuBytes / (f64)MB(1), geometry.keptMeshCount, geometry.cpuCompressedBytes / (f64)MB(1), geometry.compressedMeshCount,
+			geometry.gpuBytes / (f64)MB(1), geometry.meshCount);
+		ImGui::Text("Geometry pools: %u, %.2f MB used", geometry.poolCount, geometry.gpuPoolUsedBytes / (f64)MB(1));
+		ImGui::Checkbox("Frustum culling", &app->useFrustumCulling);
+		ImGui::Checkbox("GPU culling", &app->useGpuCulling);
+		ImGui::Checkbox("Occlusion culling", &app->useOcclusionCulling);
+		ImGui::Checkbox("Software occlusion", &app->useSoftwareOcclusion);
+		if (app->useGpuCulling) {
+			const GpuCullingStats& culling = app->gpuCulling.stats;
+			ImGui::Text("GPU culling: %u instances of %u draws tested in %u dispatches", culling.testedInstanceCount, culling.drawCount, culling.dispatchCount);
+			ImGui::Text("Culled instances: %u by frustum, %u by occlusion (%u frames ago)", culling.frustumCulledCount, culling.occlusionCulledCount,
+				GPU_CULLING_COUNTER_READBACK_COUNT);
+		}
+		else {
+			ImGui::Text("Culled objects: %u by frustum, %u by occlusion", app->frustumCulledObjectCount, app->occlusionCulledObjectCount);
+			if (app->useSoftwareOcclusion) {
+				const SoftwareOcclusionBuffer& occlusion = app->softwareOcclusion;
+				ImGui::Text("Software occlusion: %u culled, %u occluders, %u triangles (%u skipped), %ux%u", app->softwareOccludedObjectCount,
+					occlusion.occluderCount, occlusion.triangleCount, occlusion.skippedTriangleCount, occlusion.width, occlusion.height);
+				if (occlusion.occludersWithoutGeometryCount > 0)
+					ImGui::Text("  %u occluders skipped, their mesh keeps no CPU geometry", occlusion.occludersWithoutGeometryCount);
+			}
+		}
+		ImGui::Text("Visible: %u / %u objects, %u / %u submeshes tested", app->visibleObjectCount, GetCount(app->scene.gameObjects.handles),
+			app->visibleSubmeshCount, app->cullingBoxes.count);
+		ImGui::Text("VAOs: %u", (u32)app->vaoCache.size());
+		ImGui::Text("GL state calls: %u issued, %u skipped", GlobalGLState.lastFrame.issued, GlobalGLState.lastFrame.skipped);
+		for (const RenderQueue* queue : { &app->meshQueue, &app->gizmoQueue }) {
+			const RenderQueueStats& stats = queue->stats;
+			ImGui::Text("%s: %u draws (%u multi-draw calls), %u instances", queue == &app->meshQueue ? "Meshes" : "Gizmos",
+				stats.drawCount, stats.multiDrawCount, stats.instanceCount);
+			ImGui::Text("  state changes: %u programs, %u VAOs, %u textures, %u instance buffers",
+				stats.programChanges, stats.vaoChanges, stats.textureChanges, stats.instanceBufferChanges);
+		}
+		ImGui::Text("Mesh batches: %u, gizmo batches: %u", (u32)app->meshBatches.size(), (u32)app->gizmoBatches.size());
+		ImGui::Separator();
+		ImGui::Text("Lights: %u (%u directional)", app->lightClusters.lightCount, app->lightClusters.directionalLightCount);
+		ImGui::Text("Clustered light indices: %u (max %u per cluster)", app->lightClusters.lightIndexCount, app->lightClusters.maxLightsPerCluster);
+		ImGui::Text("Dropped lights: %u, dropped light indices: %u", app->lightClusters.droppedLights, app->lightClusters.droppedLightIndices);
+		ImGui::Separator();
 		ImGui::Text("OpenGL Version: %s", app->glVersion);
 		ImGui::Text("OpenGL Renderer: %s", app->glRenderer);
 		ImGui::Text("OpenGL Vendor: %s", app->glVendor);
@@ -902,18 +1031,20 @@ void Gui(App* app)
 		ImGui::Begin("Hierarchy", &app->UIsceneHierarchy);
 
 		if (ImGui::CollapsingHeader("Lights")) {
-			int i = 1;
-			for (Light& light : app->scene.lights) {
-				if (ImGui::Selectable(("Light " + std::to_string(i)).c_str(), app->lightSelected == &light)) { app->lightSelected = &light; }
-				i++;
+			const HandleTable& handles = app->scene.lights.handles;
+			for (u32 i = 0; i < GetCount(handles); ++i) {
+				Handle handle = GetHandle(handles, i);
+				bool isSelected = IsAlive(handles, app->lightSelected) && GetDenseIndex(handles, app->lightSelected) == i;
+				if (ImGui::Selectable(("Light " + std::to_string(i + 1)).c_str(), isSelected)) { app->lightSelected = handle; }
 			}
 		}
 
 		if (ImGui::CollapsingHeader("GameObjects")) {
-			int i = 1;
-			for (GameObject& GO : app->scene.gameObjects) {
-				if (ImGui::Selectable(("GameObject " + std::to_string(i)).c_str(), app->gameObjectSelected == &GO)) { app->gameObjectSelected = &GO; }
-				i++;
+			const HandleTable& handles = app->scene.gameObjects.handles;
+			for (u32 i = 0; i < GetCount(handles); ++i) {
+				Handle handle = GetHandle(handles, i);
+				bool isSelected = IsAlive(handles, app->gameObjectSelected) && GetDenseIndex(handles, app->gameObjectSelected) == i;
+				if (ImGui::Selectable(("GameObject " + std::to_string(i + 1)).c_str(), isSelected)) { app->gameObjectSelected = handle; }
 			}
 		}
 
@@ -922,33 +1053,41 @@ void Gui(App* app)
 
 	if (app->UIlightInspector) {
 		ImGui::Begin("Light Inspector", &app->UIlightInspector);
-		if (app->lightSelected == nullptr) { ImGui::Text("Light not selected"); }
+		LightStore& lights = app->scene.lights;
+		if (!IsAlive(lights.handles, app->lightSelected)) { ImGui::Text("Light not selected"); }
 		else {
-			glm::vec3 editPosition = app->lightSelected->transform.getPosition();
-			if (ImGui::DragFloat3("Position", &editPosition.x, 0.1f)) { app->lightSelected->transform.setPosition(editPosition); }
+			const u32 index = GetDenseIndex(lights.handles, app->lightSelected);
+
+			glm::vec3 editPosition = lights.transforms.positions[index];
+			if (ImGui::DragFloat3("Position", &editPosition.x, 0.1f)) { SetPosition(lights.transforms, index, editPosition); }
 
-			glm::vec3 editRotation = app->lightSelected->transform.getRotation();
-			if (ImGui::DragFloat3("Rotation", &editRotation.x, 0.1f)) { app->lightSelected->transform.setRotation(editRotation); }
+			glm::vec3 editRotation = lights.transforms.rotations[index];
+			if (ImGui::DragFloat3("Rotation", &editRotation.x, 0.1f)) { SetRotation(lights.transforms, index, editRotation); }
 
-			glm::vec3 editScale = app->lightSelected->transform.getScale();
-			if (ImGui::DragFloat3("Scale", &editScale.x, 0.1f)) { app->lightSelected->transform.setScale(editScale); }
+			glm::vec3 editScale = lights.transforms.scales[index];
+			if (ImGui::DragFloat3("Scale", &editScale.x, 0.1f)) { SetScale(lights.transforms, index, editScale); }
 
 			ImGui::Separator();
 
-			ImGui::ColorEdit3("Color", &app->lightSelected->color.r);
+			ImGui::ColorEdit3("Color", &lights.colors[index].r);
+			ImGui::DragFloat("Radius", &lights.radii[index], 0.1f, 0.01f, 1000.0f);
 
 			const char* lightTypes[] = { "Point Light", "Directional Light" };
 
-			if (ImGui::BeginCombo("Type", lightTypes[app->lightSelected->type])) {
+			if (ImGui::BeginCombo("Type", lightTypes[lights.types[index]])) {
 				for (int n = 0; n < IM_ARRAYSIZE(lightTypes); n++) {
-					if (ImGui::Selectable(lightTypes[n], app->lightSelected->type == n))
+					if (ImGui::Selectable(lightTypes[n], lights.types[index] == n))
 					{
-						app->lightSelected->type = (LightType)n;
+						lights.types[index] = (LightType)n;
 					}
 				}
 
 				ImGui::EndCombo();
 			}
+
+			ImGui::Separator();
+
+			if (ImGui::Button("Remove")) { RemoveLight(lights, app->lightSelected); }
 		}
 
 		ImGui::End();
@@ -957,17 +1096,40 @@ void Gui(App* app)
 
 	if (app->UIgameObjectInspector) {
 		ImGui::Begin("Game Object Inspector", &app->UIgameObjectInspector);
-		if (app->gameObjectSelected == nullptr) { ImGui::Text("GameObject not selected"); }
+		GameObjectStore& gameObjects = app->scene.gameObjects;
+		if (!IsAlive(gameObjects.handles, app->gameObjectSelected)) { ImGui::Text("GameObject not selected"); }
 		else {
-			glm::vec3 editPosition = app->gameObjectSelected->transform.getPosition();
-			if (ImGui::DragFloat3("Position", &editPosition.x, 0.1f)) { app->gameObjectSelected->transform.setPosition(editPosition); }
+			const u32 index = GetDenseIndex(gameObjects.handles, app->gameObjectSelected);
+
+			glm::vec3 editPosition = gameObjects.transforms.positions[index];
+			if (ImGui::DragFloat3("Position", &editPosition.x, 0.1f)) { SetPosition(gameObjects.transforms, index, editPosition); }
+
+			glm::vec3 editRotation = gameObjects.transforms.rotations[index];
+			if (ImGui::DragFloat3("Rotation", &editRotation.x, 0.1f)) { SetRotation(gameObjects.transforms, index, editRotation); }
 
-			glm::vec3 editRotation = app->gameObjectSelected->transform.getRotation();
-			if (ImGui::DragFloat3("Rotation", &editRotation.x, 0.1f)) { app->gameObjectSelected->transform.setRotation(editRotation); }
+			glm::vec3 editScale = gameObjects.transforms.scales[index];
+			if (ImGui::DragFloat3("Scale", &editScale.x, 0.1f)) { SetScale(gameObjects.transforms, index, editScale); }
 
-			glm::vec3 editScale = app->gameObjectSelected->transform.getScale();
-			if (ImGui::DragFloat3("Scale", &editScale.x, 0.1f)) { app->gameObjectSelected->transform.setScale(editScale); }
+			// the software occlusion rasterizes the geometry the mesh keeps on the CPU
+			const Mesh& mesh = app->meshes[app->models[gameObjects.modelIDs[index]].meshIdx];
+			if (HasOccluderGeometry(mesh)) {
+				bool isOccluder = gameObjects.occluders[index] != 0;
+				if (ImGui::Checkbox("Occluder", &isOccluder)) { gameObjects.occluders[index] = isOccluder ? 1 : 0; }
+			}
+			else if (!app->models[gameObjects.modelIDs[index]].filepath.empty()) {
+				// loaded again keeping the compressed geometry, warm from the model cache
+				if (ImGui::Button("Occluder: keep the CPU geometry")) {
+					ReloadModelAsync(app, gameObjects.modelIDs[index], GeometryRetention_KeepCompressed);
+					gameObjects.occluders[index] = 1;
+				}
+			}
+			else {
+				ImGui::TextDisabled("Occluder: the mesh keeps no CPU geometry (GeometryRetention)");
+			}
 
+			ImGui::Separator();
+
+			if (ImGui::Button("Remove")) { RemoveGameObject(gameObjects, app->gameObjectSelected); }
 		}
 
 		ImGui::End();
@@ -1011,32 +1173,40 @@ void Gui(App* app)
 
 			if (ImGui::MenuItem("Add Plane")) 
 			{
-				app->scene.gameObjects.push_back(GameObject());
-				GameObject& plane = app->scene.gameObjects.back();
-
+				GameObject plane;
 				plane.modelID = app->planeIdx;
 				plane.programID = app->basicShapesProgramIdx;
+
+				AddGameObject(app, plane);
 			}
 			if (ImGui::MenuItem("Add Cube")) 
 			{
-				app->scene.gameObjects.push_back(GameObject());
-				GameObject& cube = app->scene.gameObjects.back();
-
+				GameObject cube;
 				cube.modelID = app->cubeIdx;
 				cube.programID = app->basicShapesProgramIdx;
+
+				AddGameObject(app, cube);
 			}
 			if (ImGui::MenuItem("Add Sphere")) 
 			{ 
-				app->scene.gameObjects.push_back(GameObject());
-				GameObject& sphere = app->scene.gameObjects.back();
-
+				GameObject sphere;
 				sphere.modelID = app->sphereIdx;
 				sphere.programID = app->basicShapesProgramIdx;
+
+				AddGameObject(app, sphere);
 			}
 
 			ImGui::EndMenu();
 		}
 
+		if (ImGui::BeginMenu("Lights")) {
+
+			if (ImGui::MenuItem("Add Point Light")) { AddStressTestLights(app, 1); }
+			if (ImGui::MenuItem("Add 1024 Point Lights")) { AddStressTestLights(app, 1024); }
+
+			ImGui::EndMenu();
+		}
+
 		if (ImGui::BeginMenu("Postprocessing")) {
 			ImGui::Checkbox("Bloom", &app->useBloom);
 			if (ImGui::MenuItem("Bloom Settings")) { app->UIbloomSettings = true; }
@@ -1058,8 +1228,63 @@ void Gui(App* app)
 	ImGui::End();
 }
 
+f32 NormalizedViewDepth(App* app, vec3 worldPosition)
+{
+	const Camera& camera = app->scene.camera;
+	f32 viewDepth = -(app->view * vec4(worldPosition, 1.0f)).z;
+	return (viewDepth - camera.zNear) / (camera.zFar - camera.zNear);
+}
+
+void BuildRenderQueue(App* app, RenderQueue& queue, const std::vector<InstanceBatch>& batches)
+{
+	ClearRenderQueue(queue);
+
+	for (const InstanceBatch& batch : batches)
+	{
+		Model& model = app->models[batch.modelID];
+		Mesh& mesh = app->meshes[model.meshIdx];
+
+		// one draw item per submesh, for all the instances of the batch
+		for (u32 i = 0; i < mesh.submeshes.size(); ++i) {
+			if (!app->batchSubmeshVisibility[batch.firstSubmeshVisibility + i]) continue;
+
+			u32 submeshMaterialIdx = model.materialIdx[i];
+			Material& submeshMaterial = app->materials[submeshMaterialIdx];
+			Submesh& submesh = mesh.submeshes[i];
+
+			// quantized submeshes are drawn by the variant of the program reading their format
+			u32 programIdx = batch.programID;
+			if (app->programs[programIdx].quantizedVariantIdx != UINT32_MAX && IsQuantizedVertexLayout(submesh.vertexBufferLayout))
+				programIdx = app->programs[programIdx].quantizedVariantIdx;
+			const Program& program = app->programs[programIdx];
+
+			DrawItem item = {};
+			item.program = program.handle;
+			item.vao = FindVAO(app, mesh, i, program);
+			item.baseVertex = GetBaseVertex(submesh);
+			item.texture = app->textures[submeshMaterial.albedoTextureIdx].handle;
+			item.indexCount = submesh.indexCount;
+			item.indexType = submesh.indexType;
+			item.indexOffset = submesh.indexOffset;
+			item.instanceCount = batch.instanceCount;
+			item.instances = batch.instances;
+			item.boundingSphere = vec4(submesh.boundingSphereCenter, submesh.boundingSphereRadius);
+			item.key = MakeDrawKey(programIdx, item.vao, submeshMaterialIdx, batch.depth);
+
+			PushDrawItem(queue, item);
+		}
+	}
+
+	SortRenderQueue(queue, app->sortRenderQueues);
+}
+
 void Update(App* app)
 {
+	ProcessAssetUploads(app);
+
+	app->transformMatrixRecomputeCount = GlobalTransformMatrixRecomputeCount;
+	GlobalTransformMatrixRecomputeCount = 0;
+
 	// You can handle app->input keyboard/mouse here
 	float cameraSpeed = 0.1f;
 
@@ -1088,104 +1313,294 @@ void Update(App* app)
 		app->view = glm::lookAt(app->scene.camera.transform.getPosition(), app->scene.camera.transform.getPosition() + glm::vec3(cameraMatrix[2]), glm::vec3(cameraMatrix[1]));
 	}
 
-	// global uniforms
-	app->globalUniformHead = app->uniformsBuffer.head;
+	// world matrices of the objects and lights that changed
+	UpdateWorldMatrices(app->scene.gameObjects.transforms);
+	UpdateWorldMatrices(app->scene.lights.transforms);
 
-	MapBuffer(app->uniformsBuffer, GL_WRITE_ONLY);
+	// lights (assigned to the clusters of the view frustum)
+	LightClusters& clusters = app->lightClusters;
+	BuildLightClusters(clusters, app->scene.lights, app->view, app->projection, app->displaySize,
+		app->scene.camera.zNear, app->scene.camera.zFar);
 
-	PushVec3(app->uniformsBuffer, app->scene.camera.transform.getPosition());
-	PushUInt(app->uniformsBuffer, app->scene.lights.size());
+	// global uniforms
+	BeginUniformArenaFrame(app->uniforms);
 
-	for (Light& light : app->scene.lights) 
 	{
-		AlignHead(app->uniformsBuffer, sizeof(vec4));
+		Buffer& buffer = BeginUniformBlock(app->uniforms, app->globalUniforms, 7 * sizeof(vec4));
 
-		PushUInt(app->uniformsBuffer, light.type);
-		PushVec3(app->uniformsBuffer, light.color);
-		glm::mat4 lightMatrix = light.transform.getTransformationMatrix();
-		PushVec3(app->uniformsBuffer, glm::vec3(lightMatrix[2]));
-		PushVec3(app->uniformsBuffer, light.transform.getPosition());
-	}
+		glm::uvec4 clusterGrid = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, clusters.directionalLightCount);
+		glm::vec4 clusterParams = glm::vec4(clusters.tileSize, clusters.sliceScale, clusters.sliceBias);
 
-	app->globalUniformSize = app->uniformsBuffer.head - app->globalUniformHead;
+		PushVec3(buffer, app->scene.camera.transform.getPosition());
+		PushUInt(buffer, clusters.lightCount);
+		PushMat4(buffer, app->view);
+		PushVec4(buffer, clusterGrid);
+		PushVec4(buffer, clusterParams);
 
+		EndUniformBlock(app->uniforms, app->globalUniforms);
+	}
 
-	// prepare the local uniforms
-	for (GameObject& gameObject : app->scene.gameObjects) 
+	// prepare the instance data of the meshes
 	{
-		AlignHead(app->uniformsBuffer, app->uniformBlockAlignment);
+		const GameObjectStore& gameObjects = app->scene.gameObjects;
+		const u32 objectCount = GetCount(gameObjects.handles);
+		const std::vector<glm::mat4>& worldMatrices = gameObjects.transforms.worldMatrices;
 
-		glm::mat4 goMatrix = gameObject.transform.getTransformationMatrix();
+		// frustum culling: the bounds of the objects first, then the submeshes of the visible ones
+		CullingBoxes& boxes = app->cullingBoxes;
+		std::vector<u32>& firstBox = app->objectFirstCullingBox;
+		firstBox.resize(objectCount);
 
-		glm::mat4 worldViewProjectionMatrix = app->projection * app->view * goMatrix;
+		if (app->useFrustumCulling && !app->useGpuCulling)
+		{
+			Frustum frustum = ExtractFrustum(app->projection * app->view);
 
-		gameObject.localUniformBufferHead = app->uniformsBuffer.head;
-		PushMat4(app->uniformsBuffer, goMatrix);
-		PushMat4(app->uniformsBuffer, worldViewProjectionMatrix);
-		gameObject.localUniformBufferSize = app->uniformsBuffer.head - gameObject.localUniformBufferHead;
-	}
+			ClearCullingBoxes(boxes);
+			for (u32 i = 0; i < objectCount; ++i)
+				AddCullingBox(boxes, gameObjects.boundsMin[i], gameObjects.boundsMax[i], worldMatrices[i]);
+			app->frustumCulledObjectCount = objectCount - CullBoxes(frustum, boxes, app->objectVisibility);
 
-	// prepare uniforms for gizmos
-	for (Light& light : app->scene.lights) {
-		AlignHead(app->uniformsBuffer, app->uniformBlockAlignment);
+			// software occlusion: the occluders inside the frustum are rasterized, then every box inside it is tested
+			app->softwareOccludedObjectCount = 0;
+			if (app->useSoftwareOcclusion)
+			{
+				SoftwareOcclusionBuffer& occlusion = app->softwareOcclusion;
+				const u32 previousWithoutGeometryCount = occlusion.occludersWithoutGeometryCount;
+				BeginSoftwareOcclusion(occlusion, app->projection * app->view, (f32)app->displaySize.x / (f32)glm::max(app->displaySize.y, 1));
+				for (u32 i = 0; i < objectCount; ++i) {
+					if (!app->objectVisibility[i] || !gameObjects.occluders[i]) continue;
+
+					const Mesh& mesh = app->meshes[app->models[gameObjects.modelIDs[i]].meshIdx];
+					bool added = false;
+					for (const Submesh& submesh : mesh.submeshes)
+						added |= AddOccluderSubmesh(occlusion, worldMatrices[i], submesh);
+					if (!added) occlusion.occludersWithoutGeometryCount++;
+				}
+				RasterizeOccluders(occlusion);
 
-		glm::mat4 lightMatrix = light.transform.getTransformationMatrix();
+				if (occlusion.occludersWithoutGeometryCount > previousWithoutGeometryCount)
+					ELOG("%u occluders have no CPU geometry and hide nothing: still loading, or not loaded with GeometryRetention_KeepCompressed",
+						occlusion.occludersWithoutGeometryCount);
 
-		glm::mat4 worldViewProjectionMatrix = app->projection * app->view * lightMatrix;
+				for (u32 i = 0; i < objectCount; ++i) {
+					if (!app->objectVisibility[i]) continue;
 
-		light.localUniformBufferHead = app->uniformsBuffer.head;
-		PushMat4(app->uniformsBuffer, lightMatrix);
-		PushMat4(app->uniformsBuffer, worldViewProjectionMatrix);
-		light.localUniformBufferSize = app->uniformsBuffer.head - light.localUniformBufferHead;
-	}
+					const vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+					const vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+					if (IsOccludedBySoftware(occlusion, center - extent, center + extent)) {
+						app->objectVisibility[i] = 0;
+						app->softwareOccludedObjectCount++;
+					}
+				}
+			}
 
-	glUnmapBuffer(GL_UNIFORM_BUFFER);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-}
+			// occlusion: the boxes inside the frustum against the latest Hi-Z pyramid read back
+			app->occlusionCulledObjectCount = 0;
+			if (app->useOcclusionCulling)
+			{
+				UpdateHiZReadback(app->hiZ);
+				for (u32 i = 0; i < objectCount; ++i) {
+					if (!app->objectVisibility[i]) continue;
+
+					const vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+					const vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+					if (IsOccludedByHiZ(app->hiZ, center - extent, center + extent)) {
+						app->objectVisibility[i] = 0;
+						app->occlusionCulledObjectCount++;
+					}
+				}
+			}
 
-void RenderMeshes(App* app) 
-{
-	glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->uniformsBuffer.handle, app->globalUniformHead, app->globalUniformSize);
+			ClearCullingBoxes(boxes);
+			for (u32 i = 0; i < objectCount; ++i) {
+				firstBox[i] = UINT32_MAX;
+				if (!app->objectVisibility[i]) continue;
+
+				firstBox[i] = boxes.count;
+				Mesh& mesh = app->meshes[app->models[gameObjects.modelIDs[i]].meshIdx];
+				for (const Submesh& submesh : mesh.submeshes)
+					AddCullingBox(boxes, submesh.aabbMin, submesh.aabbMax, worldMatrices[i]);
+			}
+			app->visibleSubmeshCount = CullBoxes(frustum, boxes, app->cullingVisibility);
+		}
+		else
+		{
+			// every submesh is visible, only the box indices are needed
+			ClearCullingBoxes(boxes);
+			for (u32 i = 0; i < objectCount; ++i) {
+				firstBox[i] = boxes.count;
+				boxes.count += (u32)app->meshes[app->models[gameObjects.modelIDs[i]].meshIdx].submeshes.size();
+			}
+			app->cullingVisibility.assign(boxes.count, 1);
+			app->visibleSubmeshCount = boxes.count;
+			app->frustumCulledObjectCount = 0;
+			app->occlusionCulledObjectCount = 0;
+			app->softwareOccludedObjectCount = 0;
+		}
+
+		// group visible objects sharing model and program: sort by key (object index in the low bits keeps the scene order)
+		std::vector<u64>& keys = app->batchSortKeys;
+		keys.clear();
+		for (u32 i = 0; i < objectCount; ++i) {
+			if (firstBox[i] == UINT32_MAX) continue;
 
-	for (const GameObject& gameObject : app->scene.gameObjects)
+			const u32 submeshCount = (u32)app->meshes[app->models[gameObjects.modelIDs[i]].meshIdx].submeshes.size();
+			bool isVisible = false;
+			for (u32 box = firstBox[i]; box < firstBox[i] + submeshCount && !isVisible; ++box)
+				isVisible = app->cullingVisibility[box] != 0;
+			if (!isVisible) continue;
+
+			u64 groupKey = app->useInstancing ? ((u64)gameObjects.modelIDs[i] << 16 | gameObjects.programIDs[i]) : i;
+			keys.push_back(groupKey << 32 | i);
+		}
+		std::sort(keys.begin(), keys.end());
+
+		app->visibleObjectCount = (u32)keys.size();
+		app->meshBatches.clear();
+		app->batchSubmeshVisibility.clear();
+		app->instanceDestinations.resize(keys.size());
+		const u32 maxInstancesPerBatch = app->uniforms.pageSize / sizeof(InstanceData);
+
+		for (u32 first = 0; first < keys.size(); )
+		{
+			// objects [first, last) belong to the same group
+			u32 last = first + 1;
+			while (last < keys.size() && last - first < maxInstancesPerBatch && (keys[last] >> 32) == (keys[first] >> 32)) last++;
+
+			const u32 firstObject = (u32)keys[first];
+
+			InstanceBatch batch = {};
+			batch.modelID = gameObjects.modelIDs[firstObject];
+			batch.programID = gameObjects.programIDs[firstObject];
+			batch.instanceCount = last - first;
+			batch.depth = 1.0f;
+
+			// a submesh is drawn for the whole batch if it is visible for any of the instances
+			const u32 submeshCount = (u32)app->meshes[app->models[batch.modelID].meshIdx].submeshes.size();
+			batch.firstSubmeshVisibility = (u32)app->batchSubmeshVisibility.size();
+			app->batchSubmeshVisibility.resize(batch.firstSubmeshVisibility + submeshCount, 0);
+
+			// the instance data is written below, in parallel
+			InstanceData* instances = (InstanceData*)ReserveUniformBlock(app->uniforms, batch.instances, batch.instanceCount * sizeof(InstanceData));
+			for (u32 i = first; i < last; ++i)
+			{
+				const u32 objectIdx = (u32)keys[i];
+				app->instanceDestinations[i] = instances + (i - first);
+
+				batch.depth = glm::min(batch.depth, NormalizedViewDepth(app, vec3(worldMatrices[objectIdx][3])));
+
+				for (u32 j = 0; j < submeshCount; ++j)
+					app->batchSubmeshVisibility[batch.firstSubmeshVisibility + j] |= app->cullingVisibility[firstBox[objectIdx] + j];
+			}
+
+			app->meshBatches.push_back(batch);
+			first = last;
+		}
+
+		// every visible object writes its matrices to its own precomputed slot
+		const glm::mat4 viewProjection = app->projection * app->view;
+		InstanceData** destinations = app->instanceDestinations.data();
+		const u64* objectKeys = keys.data();
+		const glm::mat4* objectMatrices = worldMatrices.data();
+
+		ParallelFor((u32)keys.size(), INSTANCE_UPDATE_CHUNK_SIZE, [=](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				const glm::mat4& worldMatrix = objectMatrices[(u32)objectKeys[i]];
+				InstanceData* instance = destinations[i];
+				instance->worldMatrix = worldMatrix;
+				instance->worldViewProjectionMatrix = viewProjection * worldMatrix;
+			}
+		});
+	}
+
+	// prepare the instance data of the gizmos: one batch per light type
 	{
-		// set the block of the uniform
-		u32 blockOffset = gameObject.localUniformBufferHead;
-		u32 blockSize = gameObject.localUniformBufferSize;
-		glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->uniformsBuffer.handle, blockOffset, blockSize);
+		const LightStore& lights = app->scene.lights;
+		const u32 lightCount = GetCount(lights.handles);
 
-		// use the program
-		Program& texturedMeshProgram = app->programs[gameObject.programID];
-		glUseProgram(texturedMeshProgram.handle);
+		app->gizmoBatches.clear();
+		const LightType lightTypes[] = { LightType_Point, LightType_Directional };
+		const u32 gizmoModels[] = { app->sphereIdx, app->planeIdx };
+		const u32 maxInstancesPerBatch = app->uniforms.pageSize / sizeof(InstanceData);
 
-		// draw the mesh
-		Model& model = app->models[gameObject.modelID];
-		Mesh& mesh = app->meshes[model.meshIdx];
+		for (u32 t = 0; t < ARRAY_COUNT(lightTypes); ++t)
+		{
+			u32 lightIdx = 0;
+			while (true)
+			{
+				// lights of this type not written yet, up to the batch limit
+				u32 count = 0;
+				u32 end = lightIdx;
+				for (; end < lightCount && count < maxInstancesPerBatch; ++end)
+					if (lights.types[end] == lightTypes[t]) count++;
+				if (count == 0) break;
+
+				InstanceBatch batch = {};
+				batch.modelID = gizmoModels[t];
+				batch.programID = app->basicShapesProgramIdx;
+				batch.instanceCount = count;
+				batch.depth = 1.0f;
+
+				// gizmos are not culled
+				batch.firstSubmeshVisibility = (u32)app->batchSubmeshVisibility.size();
+				app->batchSubmeshVisibility.resize(batch.firstSubmeshVisibility + app->meshes[app->models[batch.modelID].meshIdx].submeshes.size(), 1);
+
+				Buffer& buffer = BeginUniformBlock(app->uniforms, batch.instances, count * sizeof(InstanceData));
+				for (; lightIdx < end; ++lightIdx)
+				{
+					if (lights.types[lightIdx] != lightTypes[t]) continue;
 
-		for (u32 i = 0; i < mesh.submeshes.size(); ++i) {
-			GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
-			glBindVertexArray(vao);
+					const glm::mat4& lightMatrix = lights.transforms.worldMatrices[lightIdx];
+					glm::mat4 worldViewProjectionMatrix = app->projection * app->view * lightMatrix;
 
-			u32 submeshMaterialIdx = model.materialIdx[i];
-			Material& submeshMaterial = app->materials[submeshMaterialIdx];
+					PushMat4(buffer, lightMatrix);
+					PushMat4(buffer, worldViewProjectionMatrix);
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
+					batch.depth = glm::min(batch.depth, NormalizedViewDepth(app, vec3(lightMatrix[3])));
+				}
+				EndUniformBlock(app->uniforms, batch.instances);
 
-			Submesh& submesh = mesh.submeshes[i];
-			glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+				app->gizmoBatches.push_back(batch);
+			}
 		}
 	}
+
+	EndUniformArenaFrame(app->uniforms);
+
+	// render queues
+	BuildRenderQueue(app, app->meshQueue, app->meshBatches);
+	BuildRenderQueue(app, app->gizmoQueue, app->gizmoBatches);
+}
+
+void SubmitMeshQueue(App* app, RenderQueue& queue)
+{
+	if (app->useIndirectDraws)
+		SubmitRenderQueueIndirect(queue, app->uniforms, INSTANCES_BINDING, sizeof(InstanceData));
+	else
+		SubmitRenderQueue(queue, app->uniforms, INSTANCES_BINDING);
+}
+
+void RenderMeshes(App* app) 
+{
+	BindUniformBlock(app->uniforms, app->globalUniforms, 0);
+
+	if (app->useGpuCulling)
+		SubmitRenderQueueGpuCulled(app->gpuCulling, app->meshQueue, app->uniforms, ExtractFrustum(app->projection * app->view),
+			app->useOcclusionCulling ? &app->hiZ : NULL, INSTANCES_BINDING, sizeof(InstanceData));
+	else
+		SubmitMeshQueue(app, app->meshQueue);
 }
 
 void RenderScreenQuad(App* app) 
 {
 	// render plane on the viewport to put the texture form the framebuffer
 	Program& programTexturedGeometry = app->programs[app->screenQuadProgramIdx];
-	glUseProgram(programTexturedGeometry.handle);
-	glBindVertexArray(app->quadVAO);
+	UseProgram(programTexturedGeometry.handle);
+	BindVertexArray(app->quadVAO);
 
-	glDisable(GL_DEPTH_TEST);
+	SetDepthTest(false);
 
 	// clear color and depth
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -1193,31 +1608,30 @@ void RenderScreenQuad(App* app)
 
 	glUniform1ui(app->programCurrentFramebufferLocation, app->framebufferToDisplay);
 
+	BindUniformBlock(app->uniforms, app->globalUniforms, 0);
+	BindLightClusters(app->lightClusters);
+
 	GLuint textureHandle;
 
 	// albedo
 	glUniform1i(app->programUniformTextureAlbedo, 0);
-	glActiveTexture(GL_TEXTURE0);
 	textureHandle = app->colorAttachmentHandle;
-	glBindTexture(GL_TEXTURE_2D, textureHandle);
+	BindTexture2D(0, textureHandle);
 
 	// normals
 	glUniform1i(app->programUniformTextureNormals, 1);
-	glActiveTexture(GL_TEXTURE1);
 	textureHandle = app->normalAttachmentHandle;
-	glBindTexture(GL_TEXTURE_2D, textureHandle);
+	BindTexture2D(1, textureHandle);
 
 	// position
 	glUniform1i(app->programUniformTexturePosition, 2);
-	glActiveTexture(GL_TEXTURE2);
 	textureHandle = app->positionAttachmentHandle;
-	glBindTexture(GL_TEXTURE_2D, textureHandle);
+	BindTexture2D(2, textureHandle);
 
 	// depth
 	glUniform1i(app->programUniformTextureDepth, 3);
-	glActiveTexture(GL_TEXTURE3);
 	textureHandle = app->depthAttachmentHandle;
-	glBindTexture(GL_TEXTURE_2D, textureHandle);
+	BindTexture2D(3, textureHandle);
 
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 }
@@ -1229,52 +1643,13 @@ void RenderPostprocessing(App* app)
 
 void RenderGuizmos(App* app)
 {
-	for (const Light& light : app->scene.lights)
-	{
-		// set the block of the uniform
-		u32 blockOffset = light.localUniformBufferHead;
-		u32 blockSize = light.localUniformBufferSize;
-		glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->uniformsBuffer.handle, blockOffset, blockSize);
-
-		// use the program
-		Program& meshProgram = app->programs[app->basicShapesProgramIdx];
-		glUseProgram(meshProgram.handle);
-
-		// draw the mesh
-		Model model;
-
-		switch (light.type)
-		{
-		case LightType_Directional:
-			model = app->models[app->planeIdx];
-			break;
-		case LightType_Point:
-			model = app->models[app->sphereIdx];
-			break;
-		default:
-			break;
-		}
-
-		Mesh& mesh = app->meshes[model.meshIdx];
-
-		for (u32 i = 0; i < mesh.submeshes.size(); ++i) {
-			GLuint vao = FindVAO(mesh, i, meshProgram);
-			glBindVertexArray(vao);
-
-			u32 submeshMaterialIdx = model.materialIdx[i];
-			Material& submeshMaterial = app->materials[submeshMaterialIdx];
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-
-			Submesh& submesh = mesh.submeshes[i];
-			glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-		}
-	}
+	SubmitMeshQueue(app, app->gizmoQueue);
 }
 
 void Render(App* app)
 {
+	BeginGLStateFrame();
+
 	// render on this framebuffer render targets
 	app->displayFramebuffer.bind();
 	
@@ -1284,22 +1659,32 @@ void Render(App* app)
 
 	glViewport(0, 0, app->displaySize.x, app->displaySize.y);
 
-	glEnable(GL_DEPTH_TEST);
+	SetDepthTest(true);
 	
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	SetBlend(true);
+	SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	RenderMeshes(app);
 	
 	app->displayFramebuffer.unbind();
 
+	// the depth of this frame culls the next one: sampled by the GPU culling pass, read back for the CPU path
+	if (app->useOcclusionCulling)
+		BuildHiZ(app->hiZ, app->depthAttachmentHandle, app->projection * app->view, !app->useGpuCulling);
+	else
+		InvalidateHiZ(app->hiZ);
+
 	RenderScreenQuad(app);
 
 	RenderPostprocessing(app);
 
 	if (app->showGuizmos) { RenderGuizmos(app); }
 
-	glBindVertexArray(0);
-	glUseProgram(0);
+	BindVertexArray(0);
+	UseProgram(0);
+
+	// the uniforms region of this frame can be reused once these draws are done
+	FenceUniformArenaFrame(app->uniforms);
+	FenceLightClusters(app->lightClusters);
 }
 
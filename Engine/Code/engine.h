@@ -10,7 +10,14 @@
 #include "framebuffer.h"
 #include "resources.h"
 #include "bloom.h"
+#include "clustered_lighting.h"
+#include "render_queue.h"
+#include "gpu_culling.h"
+#include "software_occlusion.h"
+#include "culling.h"
+#include "geometry.h"
 #include <glad/glad.h>
+#include <unordered_map>
 
 enum FramebufferDisplayType
 {
@@ -22,6 +29,37 @@ enum FramebufferDisplayType
 	DEPTH,
 };
 
+#define UNIFORM_ARENA_PAGE_SIZE MB(1)
+
+// Shader storage binding of the per-instance matrices read by the mesh shaders
+#define INSTANCES_BINDING 3
+
+// Vertex attribute of the mesh shaders holding the index of their instance in the Instances buffer.
+// It is fetched with divisor 1 from App::instanceIndexBuffer, which holds 0, 1, 2... so its value
+// is baseInstance + gl_InstanceID, and indirect draws select their instances with baseInstance.
+#define INSTANCE_INDEX_LOCATION 5
+
+// Per-instance data as laid out in the Instances buffer (std430)
+struct InstanceData
+{
+	glm::mat4 worldMatrix;
+	glm::mat4 worldViewProjectionMatrix;
+};
+
+// Visible objects whose instance data is written by each job of the parallel update
+#define INSTANCE_UPDATE_CHUNK_SIZE 256
+
+// Instances sharing a model and a program, drawn with one instanced draw per submesh
+struct InstanceBatch
+{
+	u32          modelID;
+	u32          programID;
+	u32          instanceCount;
+	f32          depth;     // normalized view depth of the closest instance
+	u32          firstSubmeshVisibility; // index of the flags of its submeshes in App::batchSubmeshVisibility
+	UniformBlock instances; // InstanceData array
+};
+
 struct App
 {
 	// Loop
@@ -70,9 +108,57 @@ struct App
 	glm::mat4 projection;
 	glm::mat4 view;
 
-	Buffer uniformsBuffer;
-	u32 globalUniformHead;
-	u32 globalUniformSize;
+	UniformArena uniforms;
+	UniformBlock globalUniforms;
+
+	// lights and their per cluster lists, read by the screen quad shader
+	LightClusters lightClusters;
+
+	// transform matrices rebuilt during the last frame
+	u32 transformMatrixRecomputeCount;
+
+	// frustum culling
+	bool                   useFrustumCulling;
+	CullingBoxes           cullingBoxes;          // world space box per submesh of the objects that passed their bounds test
+	std::vector<u32>       objectFirstCullingBox; // UINT32_MAX for the objects culled by their bounds
+	std::vector<u8>        objectVisibility;
+	std::vector<u8>        cullingVisibility;     // per culling box
+	u32                    visibleObjectCount;
+	u32                    visibleSubmeshCount;
+	bool                   useGpuCulling; // the instances of the mesh queue are culled by a compute pass instead
+	GpuCulling             gpuCulling;
+
+	// occlusion culling against the depth of the last frame
+	bool                   useOcclusionCulling;
+	HiZPyramid             hiZ;
+	u32                    frustumCulledObjectCount;   // by the CPU path, this frame
+	u32                    occlusionCulledObjectCount;
+
+	// occlusion culling against the occluders of this frame, rasterized on the CPU
+	bool                   useSoftwareOcclusion;
+	SoftwareOcclusionBuffer softwareOcclusion;
+	u32                    softwareOccludedObjectCount;
+
+	// instancing
+	bool useInstancing;
+	bool useIndirectDraws;
+	GLuint instanceIndexBuffer; // identity u32 array as long as an arena page holds instances
+	std::vector<InstanceBatch> meshBatches;
+	std::vector<InstanceBatch> gizmoBatches;
+	std::vector<u64>           batchSortKeys; // scratch: (model, program) key and object index
+	std::vector<u8>            batchSubmeshVisibility;
+	std::vector<InstanceData*> instanceDestinations;  // mapped slot of each sorted visible object
+
+	// VAOs shared by the submeshes with the same buffers, layout and program inputs
+	std::unordered_map<VAOKey, GLuint, VAOKeyHasher> vaoCache;
+
+	// vertex and index buffers shared by the submeshes of each vertex format
+	std::vector<GeometryPool> geometryPools;
+
+	// draw items of the batches, sorted by state before submission
+	bool        sortRenderQueues;
+	RenderQueue meshQueue;
+	RenderQueue gizmoQueue;
 
 	// framebuffer
 	FramebufferObject displayFramebuffer;
@@ -107,10 +193,12 @@ struct App
 	bool UIgameObjectInspector;
 	bool UIlightInspector;
 
-	GameObject* gameObjectSelected;
-	Light* lightSelected;
+	Handle gameObjectSelected;
+	Handle lightSelected;
 
 	// resources
+	u32                   placeholderTextureIdx; // white, shown until a texture finishes loading
+	u32                   placeholderModelIdx;   // cube, shown until a model finishes loading
 	std::vector<Texture>  textures;
 	std::vector<Material> materials;
 	std::vector<Mesh>     meshes;
@@ -126,6 +214,15 @@ void Update(App* app);
 
 void Render(App* app);
 
+Image LoadImage(const char* filename);
+
+void FreeImage(Image image);
+
+GLuint CreateTexture2DFromImage(Image image);
+
 u32 LoadTexture2D(App* app, const char* filepath);
 
+// Union of the bounds of the submeshes of the model, in model space
+void GetModelBounds(App* app, u32 modelID, vec3& boundsMin, vec3& boundsMax);
+
 void CreateFramebuffers(App* app);
\ No newline at end of file
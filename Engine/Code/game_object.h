@@ -3,6 +3,7 @@
 #include "platform.h"
 #include "transform.h"
 
+// Description of a game object, stored in the scene with AddGameObject()
 class GameObject
 {
 public:
@@ -16,9 +17,8 @@ public:
 	u32 modelID;
 	// shader
 	u32 programID;
+	// its triangles hide the objects behind it in the software occlusion culling
+	bool isOccluder = false;
 
 	Transform transform;
-
-	u32 localUniformBufferHead;
-	u32 localUniformBufferSize;
 };
@@ -0,0 +1,453 @@
+#include "geometry.h"
+#include "engine.h"
+#include "gl_state.h"
+#include "vertex_quantization.h"
+#include <algorithm>
+
+#define COMPRESSED_POSITION_MAX 65535.0f
+
+void InitFreeList(FreeListAllocator& allocator, u32 capacity)
+{
+	allocator.capacity = capacity;
+	allocator.freeBlocks.clear();
+	if (capacity > 0)
+		allocator.freeBlocks.push_back(FreeBlock{ 0, capacity });
+}
+
+bool AllocateFromFreeList(FreeListAllocator& allocator, u32 size, u32& offset)
+{
+	offset = 0;
+	if (size == 0)
+		return true;
+
+	for (u32 i = 0; i < allocator.freeBlocks.size(); ++i)
+	{
+		FreeBlock& block = allocator.freeBlocks[i];
+		if (block.size < size) continue;
+
+		offset = block.offset;
+		block.offset += size;
+		block.size -= size;
+		if (block.size == 0)
+			allocator.freeBlocks.erase(allocator.freeBlocks.begin() + i);
+		return true;
+	}
+
+	return false;
+}
+
+void FreeToFreeList(FreeListAllocator& allocator, u32 offset, u32 size)
+{
+	if (size == 0)
+		return;
+
+	std::vector<FreeBlock>& blocks = allocator.freeBlocks;
+	u32 i = (u32)(std::lower_bound(blocks.begin(), blocks.end(), offset, [](const FreeBlock& block, u32 o) { return block.offset < o; }) - blocks.begin());
+	blocks.insert(blocks.begin() + i, FreeBlock{ offset, size });
+
+	if (i + 1 < blocks.size() && blocks[i].offset + blocks[i].size == blocks[i + 1].offset) {
+		blocks[i].size += blocks[i + 1].size;
+		blocks.erase(blocks.begin() + i + 1);
+	}
+	if (i > 0 && blocks[i - 1].offset + blocks[i - 1].size == blocks[i].offset) {
+		blocks[i - 1].size += blocks[i].size;
+		blocks.erase(blocks.begin() + i);
+	}
+}
+
+void GrowFreeList(FreeListAllocator& allocator, u32 newCapacity)
+{
+	const u32 oldCapacity = allocator.capacity;
+	allocator.capacity = newCapacity;
+	FreeToFreeList(allocator, oldCapacity, newCapacity - oldCapacity);
+}
+
+u64 HashVertexLayout(const VertexBufferLayout& layout)
+{
+	// FNV-1a over the attributes and the stride
+	u64 hash = 14695981039346656037ull;
+	for (const VertexBufferAttribute& attribute : layout.attributes) {
+		const u8 bytes[] = {
+			attribute.location, attribute.componentCount, attribute.stride,
+			(u8)attribute.offset, (u8)(attribute.offset >> 8), (u8)(attribute.offset >> 16), (u8)(attribute.offset >> 24),
+			(u8)attribute.type, (u8)(attribute.type >> 8), (u8)attribute.normalized
+		};
+		for (u8 byte : bytes) hash = (hash ^ byte) * 1099511628211ull;
+	}
+	hash = (hash ^ layout.stride) * 1099511628211ull;
+	return hash;
+}
+
+u32 GetIndexTypeSize(GLenum indexType)
+{
+	switch (indexType)
+	{
+		case GL_UNSIGNED_BYTE:  return 1;
+		case GL_UNSIGNED_SHORT: return 2;
+		default:                return 4;
+	}
+}
+
+const void* GetSubmeshIndices(const Submesh& submesh)
+{
+	return submesh.indexType == GL_UNSIGNED_SHORT ? (const void*)submesh.indices16.data() : (const void*)submesh.indices.data();
+}
+
+void NarrowMeshIndices(Mesh& mesh, const char* name)
+{
+	u32 narrowedCount = 0;
+	u64 bytesBefore = 0, bytesAfter = 0;
+
+	for (Submesh& submesh : mesh.submeshes)
+	{
+		bytesBefore += submesh.indexCount * GetIndexTypeSize(submesh.indexType);
+
+		if (submesh.indexType == GL_UNSIGNED_INT && !submesh.indices.empty() && submesh.vertexCount <= 65536)
+		{
+			submesh.indices16.assign(submesh.indices.begin(), submesh.indices.end());
+			std::vector<u32>().swap(submesh.indices);
+			submesh.indexType = GL_UNSIGNED_SHORT;
+			narrowedCount++;
+		}
+
+		bytesAfter += submesh.indexCount * GetIndexTypeSize(submesh.indexType);
+	}
+
+	if (narrowedCount > 0)
+		ILOG("%s: indices narrowed to 16 bits in %u of %u submeshes, %.1f KB -> %.1f KB",
+			name, narrowedCount, (u32)mesh.submeshes.size(), bytesBefore / 1024.0, bytesAfter / 1024.0);
+}
+
+u32 GetVertexComponentSize(GLenum type)
+{
+	switch (type)
+	{
+		case GL_BYTE:  case GL_UNSIGNED_BYTE:  return 1;
+		case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+		default:                               return 4;
+	}
+}
+
+void CreateMeshBuffers(Mesh& mesh, u32 vertexBufferSize, const void* vertexData, u32 indexBufferSize, const void* indexData)
+{
+	glGenBuffers(1, &mesh.vertexBufferHandle);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+	glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, vertexData, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mesh.indexBufferHandle);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, indexData, GL_STATIC_DRAW);
+
+	mesh.vertexBufferSize = vertexBufferSize;
+	mesh.indexBufferSize = indexBufferSize;
+}
+
+// Pools only hold interleaved layouts: every attribute inside the vertex and advancing by the stride of the layout
+static bool IsPoolableLayout(const VertexBufferLayout& layout)
+{
+	if (layout.stride == 0)
+		return false;
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+		if ((attribute.stride != 0 && attribute.stride != layout.stride) || attribute.offset + attribute.componentCount * GetVertexComponentSize(attribute.type) > layout.stride)
+			return false;
+	return true;
+}
+
+// The VAOs of a buffer that is replaced would keep the deleted one
+static void ForgetBufferVAOs(App* app, GLuint buffer)
+{
+	BindVertexArray(0);
+
+	for (auto it = app->vaoCache.begin(); it != app->vaoCache.end(); )
+	{
+		if (it->first.vertexBufferHandle == buffer || it->first.indexBufferHandle == buffer) {
+			glDeleteVertexArrays(1, &it->second);
+			it = app->vaoCache.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+// Replaces the buffer with a bigger one keeping its contents. The copy targets leave the VAO and its element buffer alone.
+static void ResizePoolBuffer(App* app, GLuint& buffer, u32 oldSize, u32 newSize)
+{
+	GLuint newBuffer;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+
+	if (buffer) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		ForgetBufferVAOs(app, buffer);
+		glDeleteBuffers(1, &buffer);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	buffer = newBuffer;
+}
+
+static u32 FindGeometryPool(App* app, const VertexBufferLayout& layout)
+{
+	const u64 layoutHash = HashVertexLayout(layout);
+	for (u32 i = 0; i < app->geometryPools.size(); ++i)
+		if (app->geometryPools[i].layoutHash == layoutHash)
+			return i;
+
+	GeometryPool pool = {};
+	pool.layout = layout;
+	pool.layoutHash = layoutHash;
+	InitFreeList(pool.vertices, GEOMETRY_POOL_VERTEX_BYTES / layout.stride);
+	InitFreeList(pool.indices, GEOMETRY_POOL_INDEX_BYTES / 4);
+	ResizePoolBuffer(app, pool.vertexBufferHandle, 0, pool.vertices.capacity * layout.stride);
+	ResizePoolBuffer(app, pool.indexBufferHandle, 0, pool.indices.capacity * 4);
+
+	app->geometryPools.push_back(pool);
+	return (u32)app->geometryPools.size() - 1u;
+}
+
+// Allocates from the pool, doubling it (or more for a big request) until the allocation fits
+static u32 AllocateFromPool(App* app, GLuint& buffer, FreeListAllocator& allocator, u32 unitSize, u32 size)
+{
+	u32 offset;
+	while (!AllocateFromFreeList(allocator, size, offset))
+	{
+		const u32 oldCapacity = allocator.capacity;
+		const u32 newCapacity = glm::max(oldCapacity * 2, oldCapacity + size);
+		ResizePoolBuffer(app, buffer, oldCapacity * unitSize, newCapacity * unitSize);
+		GrowFreeList(allocator, newCapacity);
+	}
+	return offset;
+}
+
+// Copies the geometry of the submesh into the pool of its format and points the submesh at it
+static void UploadSubmeshToPool(App* app, Submesh& submesh, const void* vertices, const void* indices)
+{
+	const u32 poolIdx = FindGeometryPool(app, submesh.vertexBufferLayout);
+	GeometryPool& pool = app->geometryPools[poolIdx];
+
+	const u32 stride = pool.layout.stride;
+	const u32 indexBytes = submesh.indexCount * GetIndexTypeSize(submesh.indexType);
+
+	const u32 firstVertex = AllocateFromPool(app, pool.vertexBufferHandle, pool.vertices, stride, submesh.vertexCount);
+	const u32 firstIndexWord = AllocateFromPool(app, pool.indexBufferHandle, pool.indices, 4, (indexBytes + 3) / 4);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vertexBufferHandle);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * stride, submesh.vertexCount * stride, vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBufferHandle);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndexWord * 4, indexBytes, indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	submesh.geometryPoolIdx = poolIdx;
+	submesh.vertexOffset = firstVertex * stride;
+	submesh.indexOffset = firstIndexWord * 4;
+	pool.allocationCount++;
+}
+
+void UploadMeshBuffers(App* app, Mesh& mesh, GeometryRetention retention)
+{
+	for (Submesh& submesh : mesh.submeshes)
+	{
+		ASSERT(IsPoolableLayout(submesh.vertexBufferLayout), "CPU geometry is expected to be interleaved");
+		UploadSubmeshToPool(app, submesh, submesh.vertices.data(), GetSubmeshIndices(submesh));
+	}
+
+	ApplyGeometryRetention(mesh, retention);
+}
+
+void UploadMappedMeshBuffers(App* app, Mesh& mesh, const u8* vertexData, u32 vertexDataSize, const u8* indexData, u32 indexDataSize, GeometryRetention retention)
+{
+	if (retention != GeometryRetention_Drop) {
+		for (Submesh& submesh : mesh.submeshes)
+			CompressSubmeshGeometry(submesh, vertexData + submesh.vertexOffset, indexData + submesh.indexOffset);
+		retention = GeometryRetention_KeepCompressed;
+	}
+	mesh.retention = retention;
+
+	bool poolable = true;
+	for (const Submesh& submesh : mesh.submeshes)
+		poolable = poolable && IsPoolableLayout(submesh.vertexBufferLayout);
+
+	if (poolable) {
+		for (Submesh& submesh : mesh.submeshes)
+			UploadSubmeshToPool(app, submesh, vertexData + submesh.vertexOffset, indexData + submesh.indexOffset);
+		return;
+	}
+
+	// the offsets in the submeshes stay relative to the start of the data
+	CreateMeshBuffers(mesh, vertexDataSize, vertexData, indexDataSize, indexData);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (Submesh& submesh : mesh.submeshes)
+		submesh.geometryPoolIdx = GEOMETRY_POOL_NONE;
+}
+
+void FreeMeshGeometry(App* app, Mesh& mesh)
+{
+	if (!mesh.sharesGeometry)
+	{
+		for (Submesh& submesh : mesh.submeshes)
+		{
+			if (submesh.geometryPoolIdx == GEOMETRY_POOL_NONE) continue;
+
+			GeometryPool& pool = app->geometryPools[submesh.geometryPoolIdx];
+			const u32 indexBytes = submesh.indexCount * GetIndexTypeSize(submesh.indexType);
+			FreeToFreeList(pool.vertices, submesh.vertexOffset / pool.layout.stride, submesh.vertexCount);
+			FreeToFreeList(pool.indices, submesh.indexOffset / 4, (indexBytes + 3) / 4);
+			pool.allocationCount--;
+		}
+
+		if (mesh.vertexBufferHandle) {
+			ForgetBufferVAOs(app, mesh.vertexBufferHandle);
+			ForgetBufferVAOs(app, mesh.indexBufferHandle);
+			glDeleteBuffers(1, &mesh.vertexBufferHandle);
+			glDeleteBuffers(1, &mesh.indexBufferHandle);
+		}
+	}
+
+	mesh = Mesh{};
+}
+
+void GetSubmeshBuffers(App* app, const Mesh& mesh, const Submesh& submesh, GLuint& vertexBufferHandle, GLuint& indexBufferHandle)
+{
+	if (submesh.geometryPoolIdx != GEOMETRY_POOL_NONE) {
+		const GeometryPool& pool = app->geometryPools[submesh.geometryPoolIdx];
+		vertexBufferHandle = pool.vertexBufferHandle;
+		indexBufferHandle = pool.indexBufferHandle;
+	}
+	else {
+		vertexBufferHandle = mesh.vertexBufferHandle;
+		indexBufferHandle = mesh.indexBufferHandle;
+	}
+}
+
+void CompressSubmeshGeometry(Submesh& submesh, const u8* vertices, const u8* indices)
+{
+	CompressedGeometry& compressed = submesh.compressed;
+	compressed = CompressedGeometry{};
+
+	const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+	bool hasPositions = false;
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+		if (attribute.location == 0) hasPositions = true;
+
+	if (!hasPositions)
+		return;
+
+	// flat axes have no range to quantize, every vertex decodes to aabbMin there
+	const vec3 extent = submesh.aabbMax - submesh.aabbMin;
+	const vec3 scale = vec3(
+		extent.x > 0.0f ? COMPRESSED_POSITION_MAX / extent.x : 0.0f,
+		extent.y > 0.0f ? COMPRESSED_POSITION_MAX / extent.y : 0.0f,
+		extent.z > 0.0f ? COMPRESSED_POSITION_MAX / extent.z : 0.0f);
+
+	compressed.positions.resize(submesh.vertexCount * 3);
+	for (u32 i = 0; i < submesh.vertexCount; ++i)
+	{
+		const vec3 p = ReadVertexPosition(layout, vertices, i);
+		const vec3 q = glm::clamp((p - submesh.aabbMin) * scale + 0.5f, vec3(0.0f), vec3(COMPRESSED_POSITION_MAX));
+		compressed.positions[i * 3 + 0] = (u16)q.x;
+		compressed.positions[i * 3 + 1] = (u16)q.y;
+		compressed.positions[i * 3 + 2] = (u16)q.z;
+	}
+
+	const bool narrow = submesh.vertexCount <= 65536;
+	if (narrow) compressed.indices16.resize(submesh.indexCount);
+	else        compressed.indices32.resize(submesh.indexCount);
+
+	for (u32 i = 0; i < submesh.indexCount; ++i)
+	{
+		u32 index;
+		switch (submesh.indexType)
+		{
+			case GL_UNSIGNED_BYTE:  index = indices[i]; break;
+			case GL_UNSIGNED_SHORT: index = ((const u16*)indices)[i]; break;
+			default:                index = ((const u32*)indices)[i]; break;
+		}
+
+		if (narrow) compressed.indices16[i] = (u16)index;
+		else        compressed.indices32[i] = index;
+	}
+}
+
+void ApplyGeometryRetention(Mesh& mesh, GeometryRetention retention)
+{
+	mesh.retention = retention;
+
+	for (Submesh& submesh : mesh.submeshes)
+	{
+		if (retention == GeometryRetention_KeepCompressed && !submesh.vertices.empty())
+			CompressSubmeshGeometry(submesh, (const u8*)submesh.vertices.data(), (const u8*)GetSubmeshIndices(submesh));
+
+		// swapped rather than cleared, so the memory is actually released
+		if (retention != GeometryRetention_Keep) {
+			std::vector<float>().swap(submesh.vertices);
+			std::vector<u32>().swap(submesh.indices);
+			std::vector<u16>().swap(submesh.indices16);
+		}
+	}
+}
+
+vec3 GetCompressedPosition(const Submesh& submesh, u32 vertex)
+{
+	const u16* q = &submesh.compressed.positions[vertex * 3];
+	const vec3 extent = submesh.aabbMax - submesh.aabbMin;
+	return submesh.aabbMin + vec3(q[0], q[1], q[2]) * (extent / COMPRESSED_POSITION_MAX);
+}
+
+u32 GetCompressedIndex(const Submesh& submesh, u32 index)
+{
+	const CompressedGeometry& compressed = submesh.compressed;
+	return compressed.indices32.empty() ? compressed.indices16[index] : compressed.indices32[index];
+}
+
+GeometryMemoryStats GetGeometryMemoryStats(App* app)
+{
+	GeometryMemoryStats stats = {};
+
+	// meshes loading asynchronously share the buffers of the placeholder
+	std::vector<std::pair<GLuint, u32>> buffers;
+
+	for (const Mesh& mesh : app->meshes)
+	{
+		bool kept = false, compressed = false;
+		for (const Submesh& submesh : mesh.submeshes)
+		{
+			const CompressedGeometry& c = submesh.compressed;
+			stats.cpuBytes += submesh.vertices.capacity() * sizeof(float) + submesh.indices.capacity() * sizeof(u32) + submesh.indices16.capacity() * sizeof(u16);
+			stats.cpuCompressedBytes += c.positions.capacity() * sizeof(u16) + c.indices16.capacity() * sizeof(u16) + c.indices32.capacity() * sizeof(u32);
+			kept |= !submesh.vertices.empty();
+			compressed |= !c.positions.empty();
+		}
+
+		stats.meshCount++;
+		stats.keptMeshCount += kept ? 1 : 0;
+		stats.compressedMeshCount += compressed ? 1 : 0;
+
+		buffers.push_back(std::make_pair(mesh.vertexBufferHandle, mesh.vertexBufferSize));
+		buffers.push_back(std::make_pair(mesh.indexBufferHandle, mesh.indexBufferSize));
+	}
+
+	std::sort(buffers.begin(), buffers.end());
+	for (u32 i = 0; i < buffers.size(); ++i)
+		if (buffers[i].first != 0 && (i == 0 || buffers[i].first != buffers[i - 1].first))
+			stats.gpuBytes += buffers[i].second;
+
+	for (const GeometryPool& pool : app->geometryPools)
+	{
+		u64 freeVertices = 0, freeIndexWords = 0;
+		for (const FreeBlock& block : pool.vertices.freeBlocks) freeVertices += block.size;
+		for (const FreeBlock& block : pool.indices.freeBlocks) freeIndexWords += block.size;
+
+		stats.gpuBytes += (u64)pool.vertices.capacity * pool.layout.stride + (u64)pool.indices.capacity * 4;
+		stats.gpuPoolUsedBytes += (pool.vertices.capacity - freeVertices) * pool.layout.stride + (pool.indices.capacity - freeIndexWords) * 4;
+		stats.poolCount++;
+	}
+
+	return stats;
+}
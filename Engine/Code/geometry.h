@@ -0,0 +1,117 @@
+//
+// geometry.h: GL buffers of the meshes and the CPU copy of their geometry.
+//
+// Submeshes with an interleaved layout are suballocated from a GeometryPool shared by every
+// submesh of the same vertex format: one vertex buffer and one index buffer per format, so they
+// all share a VAO and are drawn with their base vertex. The vertex space of a pool is allocated
+// in whole vertices, which keeps every base vertex exact. Submeshes whose attributes each have
+// their own stride (GLB files) stay in buffers owned by their mesh. When a load replaces the
+// geometry of a mesh, the old blocks go back to the free lists of their pools.
+//
+// Once the vertices and indices are uploaded, the GeometryRetention of the mesh decides what
+// stays in CPU memory.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+struct App;
+
+// Initial size of the buffers of a pool, they double when full
+#define GEOMETRY_POOL_VERTEX_BYTES MB(8)
+#define GEOMETRY_POOL_INDEX_BYTES  MB(4)
+
+struct FreeBlock
+{
+	u32 offset;
+	u32 size;
+};
+
+// First fit allocator over a range of abstract units. Free blocks are sorted by offset and merged with their neighbours.
+struct FreeListAllocator
+{
+	u32                    capacity;
+	std::vector<FreeBlock> freeBlocks;
+};
+
+void InitFreeList(FreeListAllocator& allocator, u32 capacity);
+bool AllocateFromFreeList(FreeListAllocator& allocator, u32 size, u32& offset);
+void FreeToFreeList(FreeListAllocator& allocator, u32 offset, u32 size);
+void GrowFreeList(FreeListAllocator& allocator, u32 newCapacity);
+
+struct GeometryPool
+{
+	VertexBufferLayout layout;
+	u64                layoutHash;
+	GLuint             vertexBufferHandle;
+	GLuint             indexBufferHandle;
+	FreeListAllocator  vertices; // in vertices of the layout
+	FreeListAllocator  indices;  // in 4-byte words, so any index type stays aligned
+	u32                allocationCount;
+};
+
+struct GeometryMemoryStats
+{
+	u64 cpuBytes;           // vertices and indices kept as uploaded
+	u64 cpuCompressedBytes; // compressed copies
+	u64 gpuBytes;           // vertex and index buffers, counted once when meshes share them
+	u64 gpuPoolUsedBytes;   // allocated part of the pool buffers
+	u32 poolCount;
+	u32 meshCount;
+	u32 keptMeshCount;
+	u32 compressedMeshCount;
+};
+
+u64 HashVertexLayout(const VertexBufferLayout& layout);
+
+u32 GetIndexTypeSize(GLenum indexType);
+
+// CPU indices of the submesh in its indexType: indices, or indices16 once narrowed
+const void* GetSubmeshIndices(const Submesh& submesh);
+
+/**
+ * Moves the indices of the submeshes with at most 65536 vertices to indices16 and draws them as
+ * GL_UNSIGNED_SHORT, which halves their index memory and fetch. Run last when cooking a mesh, as
+ * the tools reordering the geometry work on the 32 bit indices.
+ */
+void NarrowMeshIndices(Mesh& mesh, const char* name);
+
+// Bytes per component of a vertex attribute of the type (VertexBufferAttribute::type)
+u32 GetVertexComponentSize(GLenum type);
+
+// Creates buffers owned by the mesh with the given contents (NULL to leave them undefined) and leaves both bound
+void CreateMeshBuffers(Mesh& mesh, u32 vertexBufferSize, const void* vertexData, u32 indexBufferSize, const void* indexData);
+
+// Uploads the CPU geometry of the submeshes to the pools of their formats and applies the retention
+void UploadMeshBuffers(App* app, Mesh& mesh, GeometryRetention retention);
+
+/**
+ * Uploads geometry mapped from a file, where the offsets of the submeshes point into vertexData and
+ * indexData. Interleaved submeshes go to the pools, the rest keep the ranges in buffers of the mesh.
+ * There are no CPU vectors to keep, so Keep falls back to KeepCompressed.
+ */
+void UploadMappedMeshBuffers(App* app, Mesh& mesh, const u8* vertexData, u32 vertexDataSize, const u8* indexData, u32 indexDataSize, GeometryRetention retention);
+
+// Returns the pool blocks of the mesh and deletes the buffers it owns (not those it shares, see
+// Mesh::sharesGeometry), then empties it
+void FreeMeshGeometry(App* app, Mesh& mesh);
+
+// Buffers holding the geometry of the submesh: those of its pool, or those of the mesh
+void GetSubmeshBuffers(App* app, const Mesh& mesh, const Submesh& submesh, GLuint& vertexBufferHandle, GLuint& indexBufferHandle);
+
+/**
+ * Builds the compressed copy of a submesh from its geometry wherever it is: the CPU vectors, or a
+ * mapped file for the meshes that never had them. vertices points at the first vertex of the
+ * submesh (where the attribute offsets start) and indices at its first index.
+ */
+void CompressSubmeshGeometry(Submesh& submesh, const u8* vertices, const u8* indices);
+
+// Frees the CPU geometry the retention does not keep, compressing it first for KeepCompressed
+void ApplyGeometryRetention(Mesh& mesh, GeometryRetention retention);
+
+vec3 GetCompressedPosition(const Submesh& submesh, u32 vertex);
+u32  GetCompressedIndex(const Submesh& submesh, u32 index);
+
+GeometryMemoryStats GetGeometryMemoryStats(App* app);
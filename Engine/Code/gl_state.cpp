@@ -0,0 +1,140 @@
+#include "gl_state.h"
+
+GLState GlobalGLState = {};
+
+void InvalidateGLState()
+{
+	GLState& state = GlobalGLState;
+
+	state.program = GL_STATE_UNKNOWN;
+	state.vertexArray = GL_STATE_UNKNOWN;
+	state.activeTextureUnit = GL_STATE_UNKNOWN;
+	for (u32 i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+		state.textures2D[i] = GL_STATE_UNKNOWN;
+
+	for (u32 i = 0; i < GL_STATE_BUFFER_BINDINGS; ++i) {
+		state.uniformBuffers[i].buffer = GL_STATE_UNKNOWN;
+		state.storageBuffers[i].buffer = GL_STATE_UNKNOWN;
+	}
+
+	state.depthTest = GL_STATE_UNKNOWN;
+	state.blend = GL_STATE_UNKNOWN;
+	state.cullFace = GL_STATE_UNKNOWN;
+
+	state.blendSrc = GL_STATE_UNKNOWN;
+	state.blendDst = GL_STATE_UNKNOWN;
+}
+
+void BeginGLStateFrame()
+{
+	GlobalGLState.lastFrame = GlobalGLState.frame;
+	GlobalGLState.frame = {};
+}
+
+// Returns true if the call has to be issued, and updates the cached value
+template <typename T>
+static bool ChangeState(T& cached, T value)
+{
+	if (cached == value) {
+		GlobalGLState.frame.skipped++;
+		return false;
+	}
+
+	cached = value;
+	GlobalGLState.frame.issued++;
+	return true;
+}
+
+void UseProgram(GLuint program)
+{
+	if (ChangeState(GlobalGLState.program, program))
+		glUseProgram(program);
+}
+
+void BindVertexArray(GLuint vertexArray)
+{
+	if (ChangeState(GlobalGLState.vertexArray, vertexArray))
+		glBindVertexArray(vertexArray);
+}
+
+void BindTexture2D(u32 unit, GLuint texture)
+{
+	ASSERT(unit < GL_STATE_TEXTURE_UNITS, "Texture unit out of the cached range");
+
+	if (GlobalGLState.textures2D[unit] == texture) {
+		GlobalGLState.frame.skipped++;
+		return;
+	}
+
+	if (ChangeState(GlobalGLState.activeTextureUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+
+	GlobalGLState.textures2D[unit] = texture;
+	GlobalGLState.frame.issued++;
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void BindBufferRange(GLenum target, u32 index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	ASSERT(index < GL_STATE_BUFFER_BINDINGS, "Buffer binding out of the cached range");
+	ASSERT(target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER, "Unsupported buffer target");
+
+	GLBufferRange& cached = target == GL_UNIFORM_BUFFER ? GlobalGLState.uniformBuffers[index] : GlobalGLState.storageBuffers[index];
+
+	if (cached.buffer == buffer && cached.offset == offset && cached.size == size) {
+		GlobalGLState.frame.skipped++;
+		return;
+	}
+
+	cached.buffer = buffer;
+	cached.offset = offset;
+	cached.size = size;
+	GlobalGLState.frame.issued++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+static void SetCapability(u32& cached, GLenum capability, bool enabled)
+{
+	if (ChangeState(cached, (u32)enabled)) {
+		if (enabled) glEnable(capability);
+		else         glDisable(capability);
+	}
+}
+
+void SetDepthTest(bool enabled)
+{
+	SetCapability(GlobalGLState.depthTest, GL_DEPTH_TEST, enabled);
+}
+
+void SetBlend(bool enabled)
+{
+	SetCapability(GlobalGLState.blend, GL_BLEND, enabled);
+}
+
+void SetCullFace(bool enabled)
+{
+	SetCapability(GlobalGLState.cullFace, GL_CULL_FACE, enabled);
+}
+
+void SetBlendFunc(GLenum src, GLenum dst)
+{
+	if (GlobalGLState.blendSrc == src && GlobalGLState.blendDst == dst) {
+		GlobalGLState.frame.skipped++;
+		return;
+	}
+
+	GlobalGLState.blendSrc = src;
+	GlobalGLState.blendDst = dst;
+	GlobalGLState.frame.issued++;
+	glBlendFunc(src, dst);
+}
+
+void DeleteTexture(GLuint& texture)
+{
+	for (u32 i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+		if (GlobalGLState.textures2D[i] == texture)
+			GlobalGLState.textures2D[i] = 0; // GL binds 0 where the texture was bound
+
+	glDeleteTextures(1, &texture);
+	texture = 0;
+}
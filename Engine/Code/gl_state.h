@@ -0,0 +1,73 @@
+//
+// gl_state.h: Shadow copy of the GL state the engine changes every frame. Binds that would not
+// change anything are skipped before reaching the driver.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define GL_STATE_TEXTURE_UNITS   16
+#define GL_STATE_BUFFER_BINDINGS 16
+
+// Value of the cached handles when the actual GL state is not known
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+struct GLBufferRange
+{
+	GLuint     buffer;
+	GLintptr   offset;
+	GLsizeiptr size;
+};
+
+struct GLStateCounters
+{
+	u32 issued;
+	u32 skipped;
+};
+
+struct GLState
+{
+	GLuint program;
+	GLuint vertexArray;
+	u32    activeTextureUnit;
+	GLuint textures2D[GL_STATE_TEXTURE_UNITS];
+
+	GLBufferRange uniformBuffers[GL_STATE_BUFFER_BINDINGS];
+	GLBufferRange storageBuffers[GL_STATE_BUFFER_BINDINGS];
+
+	// enables: 0 disabled, 1 enabled, GL_STATE_UNKNOWN
+	u32 depthTest;
+	u32 blend;
+	u32 cullFace;
+
+	GLenum blendSrc;
+	GLenum blendDst;
+
+	GLStateCounters frame;     // calls of the frame being rendered
+	GLStateCounters lastFrame;
+};
+
+extern GLState GlobalGLState;
+
+/**
+ * Forgets the cached state. Call it after code that changes GL state without going through
+ * these functions (ImGui rendering, for instance).
+ */
+void InvalidateGLState();
+
+// Moves the counters of the frame to lastFrame
+void BeginGLStateFrame();
+
+void UseProgram(GLuint program);
+void BindVertexArray(GLuint vertexArray);
+void BindTexture2D(u32 unit, GLuint texture);
+void BindBufferRange(GLenum target, u32 index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void SetDepthTest(bool enabled);
+void SetBlend(bool enabled);
+void SetCullFace(bool enabled);
+void SetBlendFunc(GLenum src, GLenum dst);
+
+// Deletes the texture and forgets it in the units it was bound to
+void DeleteTexture(GLuint& texture);
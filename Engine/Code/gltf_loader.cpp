@@ -0,0 +1,408 @@
+#include "gltf_loader.h"
+#include "json.h"
+#include "culling.h"
+#include <stb_image.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+// accessor.componentType, the same values as the GL enums
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+#define GLTF_MODE_TRIANGLES 4
+
+struct GlbFile
+{
+	MappedFile file;
+	JsonValue  json;
+	const u8*  bin;
+	u32        binSize;
+};
+
+struct GlbHeader
+{
+	u32 magic;
+	u32 version;
+	u32 length;
+};
+
+struct GlbChunkHeader
+{
+	u32 length;
+	u32 type;
+};
+
+// Byte range of the BIN chunk read by an accessor
+struct GlbAccessorRange
+{
+	u32 begin;  // first byte of the first element
+	u32 end;    // one past the last byte of the last element
+	u32 stride;
+	u32 componentType;
+	u32 componentCount;
+	u32 count;
+};
+
+static bool OpenGlb(const char* filename, GlbFile& glb)
+{
+	glb = GlbFile{};
+	if (!MapFile(filename, glb.file)) {
+		ELOG("Could not open the GLB file %s", filename);
+		return false;
+	}
+
+	GlbHeader header = {};
+	GlbChunkHeader jsonChunk = {};
+	if (glb.file.size >= sizeof(header) + sizeof(jsonChunk)) {
+		memcpy(&header, glb.file.data, sizeof(header));
+		memcpy(&jsonChunk, glb.file.data + sizeof(header), sizeof(jsonChunk));
+	}
+
+	const u64 jsonBegin = sizeof(header) + sizeof(jsonChunk);
+	const u64 jsonEnd = jsonBegin + jsonChunk.length;
+	if (header.magic != GLB_MAGIC || header.version != 2 || jsonChunk.type != GLB_CHUNK_JSON || jsonEnd > glb.file.size) {
+		ELOG("%s is not a glTF 2.0 binary file", filename);
+		UnmapFile(glb.file);
+		return false;
+	}
+
+	if (!ParseJson((const char*)glb.file.data + jsonBegin, jsonChunk.length, glb.json)) {
+		ELOG("%s has an invalid JSON chunk", filename);
+		UnmapFile(glb.file);
+		return false;
+	}
+
+	// the BIN chunk is optional and always the second one
+	GlbChunkHeader binChunk = {};
+	if (jsonEnd + sizeof(binChunk) <= glb.file.size)
+		memcpy(&binChunk, glb.file.data + jsonEnd, sizeof(binChunk));
+	if (binChunk.type == GLB_CHUNK_BIN && jsonEnd + sizeof(binChunk) + binChunk.length <= glb.file.size) {
+		glb.bin = glb.file.data + jsonEnd + sizeof(binChunk);
+		glb.binSize = binChunk.length;
+	}
+
+	return true;
+}
+
+static u32 GetJsonIndex(const JsonValue& object, const char* key)
+{
+	const f64 index = GetJsonNumber(object, key, -1.0);
+	return index >= 0.0 ? (u32)index : UINT32_MAX;
+}
+
+static u32 GetGltfComponentCount(const std::string& type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2")   return 2;
+	if (type == "VEC3")   return 3;
+	if (type == "VEC4")   return 4;
+	return 0;
+}
+
+static u32 GetGltfComponentSize(u32 componentType)
+{
+	switch (componentType)
+	{
+		case GLTF_UNSIGNED_BYTE:  return 1;
+		case GLTF_UNSIGNED_SHORT: return 2;
+		case GLTF_UNSIGNED_INT:   return 4;
+		case GLTF_FLOAT:          return 4;
+		default:                  return 0;
+	}
+}
+
+// Resolves the accessor down to the BIN chunk. Sparse accessors, accessors without a buffer view
+// and views of other buffers than the BIN chunk are not supported.
+static bool GetGlbAccessorRange(const GlbFile& glb, u32 accessorIdx, GlbAccessorRange& range)
+{
+	const JsonValue* accessor = GetJsonElement(FindJsonMember(glb.json, "accessors"), accessorIdx);
+	if (!accessor || FindJsonMember(*accessor, "sparse"))
+		return false;
+
+	const JsonValue* view = GetJsonElement(FindJsonMember(glb.json, "bufferViews"), GetJsonIndex(*accessor, "bufferView"));
+	if (!view || GetJsonIndex(*view, "buffer") != 0)
+		return false;
+
+	const JsonValue* buffer = GetJsonElement(FindJsonMember(glb.json, "buffers"), 0);
+	if (!buffer || FindJsonMember(*buffer, "uri") || !glb.bin)
+		return false;
+
+	range.componentType = GetJsonIndex(*accessor, "componentType");
+	range.componentCount = GetGltfComponentCount(GetJsonString(*accessor, "type", ""));
+	range.count = GetJsonIndex(*accessor, "count");
+
+	const u32 elementSize = GetGltfComponentSize(range.componentType) * range.componentCount;
+	const u64 viewOffset = (u64)GetJsonNumber(*view, "byteOffset", 0.0);
+	const u64 viewLength = (u64)GetJsonNumber(*view, "byteLength", 0.0);
+	const u64 accessorOffset = (u64)GetJsonNumber(*accessor, "byteOffset", 0.0);
+	range.stride = (u32)GetJsonNumber(*view, "byteStride", (f64)elementSize);
+
+	if (elementSize == 0 || range.count == 0 || range.count == UINT32_MAX || range.stride < elementSize)
+		return false;
+
+	const u64 begin = viewOffset + accessorOffset;
+	const u64 end = begin + (u64)(range.count - 1) * range.stride + elementSize;
+	if (end > viewOffset + viewLength || end > glb.binSize)
+		return false;
+
+	range.begin = (u32)begin;
+	range.end = (u32)end;
+	return true;
+}
+
+static std::string GetGlbTexturePath(const GlbFile& glb, const char* filename, const JsonValue* textureInfo)
+{
+	if (!textureInfo)
+		return std::string();
+
+	const JsonValue* texture = GetJsonElement(FindJsonMember(glb.json, "textures"), GetJsonIndex(*textureInfo, "index"));
+	const u32 imageIdx = texture ? GetJsonIndex(*texture, "source") : UINT32_MAX;
+	if (!GetJsonElement(FindJsonMember(glb.json, "images"), imageIdx))
+		return std::string();
+
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "#%u", imageIdx);
+	return std::string(filename) + suffix;
+}
+
+static void ProcessGlbMaterial(const GlbFile& glb, const char* filename, const JsonValue& gltfMaterial, ImportedMaterial& myMaterial)
+{
+	Material& material = myMaterial.material;
+	material.name = GetJsonString(gltfMaterial, "name", "GlbMaterial");
+	material.albedo = vec3(1.0f);
+	material.emissive = vec3(0.0f);
+	material.smoothness = 0.0f;
+
+	const JsonValue* pbr = FindJsonMember(gltfMaterial, "pbrMetallicRoughness");
+	if (pbr)
+	{
+		const JsonValue* baseColor = FindJsonMember(*pbr, "baseColorFactor");
+		for (u32 i = 0; i < 3; ++i)
+			if (const JsonValue* component = GetJsonElement(baseColor, i))
+				material.albedo[i] = (f32)component->number;
+
+		material.smoothness = 1.0f - (f32)GetJsonNumber(*pbr, "roughnessFactor", 1.0);
+		myMaterial.texturePaths[MaterialTexture_Albedo] = GetGlbTexturePath(glb, filename, FindJsonMember(*pbr, "baseColorTexture"));
+	}
+
+	const JsonValue* emissive = FindJsonMember(gltfMaterial, "emissiveFactor");
+	for (u32 i = 0; i < 3; ++i)
+		if (const JsonValue* component = GetJsonElement(emissive, i))
+			material.emissive[i] = (f32)component->number;
+
+	myMaterial.texturePaths[MaterialTexture_Emissive] = GetGlbTexturePath(glb, filename, FindJsonMember(gltfMaterial, "emissiveTexture"));
+	myMaterial.texturePaths[MaterialTexture_Normals] = GetGlbTexturePath(glb, filename, FindJsonMember(gltfMaterial, "normalTexture"));
+}
+
+struct GlbPrimitive
+{
+	GlbAccessorRange attributes[3]; // vertex attribute locations 0, 1 and 2
+	GlbAccessorRange indices;
+	u32              materialIdx;  // UINT32_MAX for the default material
+};
+
+static bool ReadGlbPrimitive(const GlbFile& glb, const JsonValue& gltfPrimitive, GlbPrimitive& primitive)
+{
+	if (GetJsonNumber(gltfPrimitive, "mode", GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES)
+		return false;
+
+	const JsonValue* attributes = FindJsonMember(gltfPrimitive, "attributes");
+	if (!attributes)
+		return false;
+
+	const char* attributeNames[] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+	const u32 componentCounts[] = { 3, 3, 2 };
+	for (u32 i = 0; i < ARRAY_COUNT(attributeNames); ++i)
+	{
+		GlbAccessorRange& range = primitive.attributes[i];
+		if (!GetGlbAccessorRange(glb, GetJsonIndex(*attributes, attributeNames[i]), range) ||
+			range.componentType != GLTF_FLOAT || range.componentCount != componentCounts[i])
+			return false;
+	}
+
+	// glTF requires it, and the draws index all the attributes the same
+	const u32 vertexCount = primitive.attributes[0].count;
+	if (primitive.attributes[1].count != vertexCount || primitive.attributes[2].count != vertexCount)
+		return false;
+
+	GlbAccessorRange& indices = primitive.indices;
+	if (!GetGlbAccessorRange(glb, GetJsonIndex(gltfPrimitive, "indices"), indices) ||
+		indices.componentCount != 1 || indices.componentType == GLTF_FLOAT || indices.stride != GetGltfComponentSize(indices.componentType))
+		return false;
+
+	primitive.materialIdx = GetJsonIndex(gltfPrimitive, "material");
+	return true;
+}
+
+bool ImportGlb(const char* filename, ImportedModel& model)
+{
+	GlbFile glb;
+	if (!OpenGlb(filename, glb))
+		return false;
+
+	const JsonValue* gltfMaterials = FindJsonMember(glb.json, "materials");
+	const u32 gltfMaterialCount = gltfMaterials && gltfMaterials->type == JsonType_Array ? (u32)gltfMaterials->elements.size() : 0;
+	model.materials.resize(gltfMaterialCount);
+	for (u32 i = 0; i < gltfMaterialCount; ++i)
+		ProcessGlbMaterial(glb, filename, gltfMaterials->elements[i], model.materials[i]);
+
+	std::vector<GlbPrimitive> primitives;
+	u32 skippedPrimitives = 0;
+
+	const JsonValue* meshes = FindJsonMember(glb.json, "meshes");
+	for (u32 meshIdx = 0; GetJsonElement(meshes, meshIdx); ++meshIdx)
+	{
+		const JsonValue* gltfPrimitives = FindJsonMember(meshes->elements[meshIdx], "primitives");
+		for (u32 primitiveIdx = 0; GetJsonElement(gltfPrimitives, primitiveIdx); ++primitiveIdx)
+		{
+			GlbPrimitive primitive = {};
+			if (ReadGlbPrimitive(glb, gltfPrimitives->elements[primitiveIdx], primitive))
+				primitives.push_back(primitive);
+			else
+				skippedPrimitives++;
+		}
+	}
+
+	if (skippedPrimitives > 0)
+		ELOG("%s: %u primitives skipped (only indexed triangles with float positions, normals and texture coordinates are loaded)", filename, skippedPrimitives);
+
+	if (primitives.empty()) {
+		ELOG("%s has no mesh that can be loaded", filename);
+		UnmapFile(glb.file);
+		return false;
+	}
+
+	// the smallest ranges of the BIN chunk holding all the vertices and all the indices
+	u32 vertexBegin = UINT32_MAX, vertexEnd = 0;
+	u32 indexBegin = UINT32_MAX, indexEnd = 0;
+	for (const GlbPrimitive& primitive : primitives)
+	{
+		for (const GlbAccessorRange& attribute : primitive.attributes) {
+			vertexBegin = glm::min(vertexBegin, attribute.begin);
+			vertexEnd = glm::max(vertexEnd, attribute.end);
+		}
+		indexBegin = glm::min(indexBegin, primitive.indices.begin);
+		indexEnd = glm::max(indexEnd, primitive.indices.end);
+	}
+
+	// keeps the offsets aligned to the components as they are in the file
+	vertexBegin &= ~3u;
+	indexBegin &= ~3u;
+
+	u32 defaultMaterialIdx = UINT32_MAX;
+
+	for (const GlbPrimitive& primitive : primitives)
+	{
+		// the positions set the stride of the layout, which only the base vertex uses, and that is 0
+		Submesh submesh = {};
+		VertexBufferLayout& layout = submesh.vertexBufferLayout;
+		for (u32 location = 0; location < ARRAY_COUNT(primitive.attributes); ++location) {
+			const GlbAccessorRange& attribute = primitive.attributes[location];
+			layout.attributes.push_back(VertexBufferAttribute{ (u8)location, (u8)attribute.componentCount, attribute.begin - vertexBegin, (u8)attribute.stride });
+		}
+		layout.stride = (u8)primitive.attributes[0].stride;
+
+		submesh.vertexCount = primitive.attributes[0].count;
+		submesh.vertexOffset = 0;
+		submesh.indexOffset = primitive.indices.begin - indexBegin;
+		submesh.indexCount = primitive.indices.count;
+		submesh.indexType = (GLenum)primitive.indices.componentType;
+
+		const GlbAccessorRange& positions = primitive.attributes[0];
+		ComputeSubmeshBounds(submesh, glb.bin + positions.begin, positions.stride, positions.count);
+
+		u32 materialIdx = primitive.materialIdx;
+		if (materialIdx >= gltfMaterialCount)
+		{
+			if (defaultMaterialIdx == UINT32_MAX) {
+				defaultMaterialIdx = (u32)model.materials.size();
+				model.materials.push_back(ImportedMaterial{});
+				model.materials.back().material.name = "DefaultMaterial";
+				model.materials.back().material.albedo = vec3(1.0f);
+			}
+			materialIdx = defaultMaterialIdx;
+		}
+
+		model.mesh.submeshes.push_back(submesh);
+		model.submeshMaterialIndices.push_back(materialIdx);
+	}
+
+	// the buffers are filled from the mapped file, like from the model cache
+	model.mappedFile = glb.file;
+	model.vertexData = glb.bin + vertexBegin;
+	model.vertexDataSize = vertexEnd - vertexBegin;
+	model.indexData = glb.bin + indexBegin;
+	model.indexDataSize = indexEnd - indexBegin;
+	return true;
+}
+
+bool IsGlbImagePath(const char* filepath)
+{
+	const char* separator = strrchr(filepath, '#');
+	return separator && separator - filepath >= 4 && (strncmp(separator - 4, ".glb", 4) == 0 || strncmp(separator - 4, ".GLB", 4) == 0);
+}
+
+static Image DecodeGlbImage(const stbi_uc* data, u32 size, const std::string& filepath)
+{
+	Image image = {};
+
+	// per thread, on top of the global flip set by InitAssetLoader()
+	stbi_set_flip_vertically_on_load_thread(false);
+	if (data)
+		image.pixels = stbi_load_from_memory(data, (int)size, &image.size.x, &image.size.y, &image.nchannels, 0);
+	else
+		image.pixels = stbi_load(filepath.c_str(), &image.size.x, &image.size.y, &image.nchannels, 0);
+	stbi_set_flip_vertically_on_load_thread(true);
+
+	if (image.pixels)
+		image.stride = image.size.x * image.nchannels;
+	return image;
+}
+
+Image LoadGlbImage(const char* filepath)
+{
+	Image image = {};
+
+	const char* separator = strrchr(filepath, '#');
+	const std::string filename(filepath, separator);
+	const u32 imageIdx = (u32)strtoul(separator + 1, NULL, 10);
+
+	GlbFile glb;
+	if (!OpenGlb(filename.c_str(), glb))
+		return image;
+
+	const JsonValue* gltfImage = GetJsonElement(FindJsonMember(glb.json, "images"), imageIdx);
+	if (gltfImage)
+	{
+		const std::string uri = GetJsonString(*gltfImage, "uri", "");
+		const JsonValue* view = GetJsonElement(FindJsonMember(glb.json, "bufferViews"), GetJsonIndex(*gltfImage, "bufferView"));
+
+		if (view && GetJsonIndex(*view, "buffer") == 0)
+		{
+			const u64 offset = (u64)GetJsonNumber(*view, "byteOffset", 0.0);
+			const u64 length = (u64)GetJsonNumber(*view, "byteLength", 0.0);
+			if (glb.bin && offset + length <= glb.binSize)
+				image = DecodeGlbImage(glb.bin + offset, (u32)length, filepath);
+		}
+		else if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+		{
+			std::string directory = filename;
+			const size_t directorySeparator = directory.find_last_of("/\\");
+			directory = directorySeparator != std::string::npos ? directory.substr(0, directorySeparator) : std::string(".");
+			image = DecodeGlbImage(NULL, 0, directory + "/" + uri);
+		}
+	}
+
+	if (!image.pixels)
+		ELOG("Could not load the image %s", filepath);
+
+	UnmapFile(glb.file);
+	return image;
+}
@@ -0,0 +1,24 @@
+//
+// gltf_loader.h: Native glTF 2.0 binary (.glb) importer. The file is memory mapped and its BIN
+// chunk is uploaded as is: the vertex buffer gets the byte range covering every vertex attribute
+// and the index buffer the range covering every index accessor, and the accessor offsets and
+// strides become the VertexBufferLayout of each primitive. Nothing is re-interleaved or copied
+// on the CPU.
+//
+// Every triangle primitive of every mesh becomes a submesh, in mesh space (the node hierarchy
+// and its transforms are not read). Primitives need float POSITION, NORMAL and TEXCOORD_0
+// accessors, the inputs of the mesh programs, and indices; the other ones are skipped.
+//
+
+#pragma once
+
+#include "asset_loader.h"
+
+bool ImportGlb(const char* filename, ImportedModel& model);
+
+// Texture paths of GLB materials are "<file.glb>#<image index>"
+bool IsGlbImagePath(const char* filepath);
+
+// Decodes an image of a GLB file, embedded in the BIN chunk or in a file next to it. glTF texture
+// coordinates start at the top left, so unlike the rest of the images these are not flipped.
+Image LoadGlbImage(const char* filepath);
@@ -0,0 +1,236 @@
+#include "gpu_culling.h"
+#include "gl_state.h"
+
+void InitGpuCulling(GpuCulling& culling, GLuint program)
+{
+	culling.program = program;
+	culling.frustumPlanesLocation = glGetUniformLocation(program, "uFrustumPlanes");
+	culling.firstJobLocation = glGetUniformLocation(program, "uFirstJob");
+	culling.occlusionCullingLocation = glGetUniformLocation(program, "uOcclusionCulling");
+	culling.hiZViewProjectionLocation = glGetUniformLocation(program, "uHiZViewProjection");
+	culling.hiZSizeLocation = glGetUniformLocation(program, "uHiZSize");
+	culling.hiZLevelCountLocation = glGetUniformLocation(program, "uHiZLevelCount");
+
+	glGenBuffers(GPU_CULLING_COUNTER_READBACK_COUNT, culling.countersBuffers);
+	for (GLuint buffer : culling.countersBuffers)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(u32), NULL, GL_DYNAMIC_READ);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Grows the buffer to hold at least size bytes, its previous contents are discarded
+static void ReserveStorageBuffer(GLuint& handle, u32& capacity, u32 size, GLenum usage)
+{
+	if (handle && size <= capacity)
+		return;
+
+	capacity = glm::max(capacity, KB(4u));
+	while (capacity < size)
+		capacity *= 2;
+
+	if (!handle)
+		glGenBuffers(1, &handle);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, usage);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void UploadStorageBuffer(GLuint& handle, u32& capacity, const void* data, u32 size, GLenum usage)
+{
+	ReserveStorageBuffer(handle, capacity, size, usage);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Reads the counts the pass wrote into the next counters buffer some frames ago, and clears it for this frame
+static GLuint CycleCountersBuffer(GpuCulling& culling)
+{
+	const u32 index = culling.countersIndex;
+	culling.countersIndex = (index + 1) % GPU_CULLING_COUNTER_READBACK_COUNT;
+
+	GLuint buffer = culling.countersBuffers[index];
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+	GLsync& fence = culling.countersFences[index];
+	if (fence)
+	{
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {} // 1 ms
+		glDeleteSync(fence);
+		fence = 0;
+
+		u32 counts[2];
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+		culling.stats.frustumCulledCount = counts[0];
+		culling.stats.occlusionCulledCount = counts[1];
+	}
+
+	const u32 zeros[2] = {};
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	return buffer;
+}
+
+// Unlike SubmitRenderQueueIndirect(), the instances of every run are in the same buffer
+static bool SharesCulledRun(const DrawItem& a, const DrawItem& b)
+{
+	return a.program == b.program && a.vao == b.vao && a.texture == b.texture && a.indexType == b.indexType;
+}
+
+void SubmitRenderQueueGpuCulled(GpuCulling& culling, RenderQueue& queue, const UniformArena& arena, const Frustum& frustum,
+	const HiZPyramid* hiZ, u32 instancesBinding, u32 instanceSize)
+{
+	RenderQueueStats& stats = queue.stats;
+	stats = {};
+	culling.stats.drawCount = 0;
+	culling.stats.testedInstanceCount = 0;
+	culling.stats.dispatchCount = 0;
+
+	const u32 count = (u32)queue.order.size();
+	if (count == 0)
+		return;
+
+	const u32 pageCount = (u32)arena.pages.size();
+	culling.commands.resize(count);
+	culling.draws.resize(count);
+	culling.pageFirstJob.assign(pageCount + 1, 0);
+	queue.indirectRuns.clear();
+
+	// commands with no instances yet (the pass counts them), and the runs sharing their state
+	u32 visibleInstanceCount = 0;
+	for (u32 i = 0; i < count; ++i)
+	{
+		const DrawItem& item = queue.items[queue.order[i]];
+
+		if (queue.indirectRuns.empty() || !SharesCulledRun(queue.items[queue.order[queue.indirectRuns.back().firstItem]], item))
+			queue.indirectRuns.push_back(IndirectDrawRun{ i, i, 0 });
+		queue.indirectRuns.back().commandCount++;
+
+		const u32 indexSize = item.indexType == GL_UNSIGNED_INT ? 4 : item.indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+		ASSERT(item.indexOffset % indexSize == 0 && item.instances.offset % instanceSize == 0, "Indirect draws need whole index and instance offsets");
+
+		DrawElementsIndirectCommand& command = culling.commands[i];
+		command.count = item.indexCount;
+		command.instanceCount = 0;
+		command.firstIndex = item.indexOffset / indexSize;
+		command.baseVertex = item.baseVertex;
+		command.baseInstance = visibleInstanceCount;
+
+		GpuCullingDraw& draw = culling.draws[i];
+		draw.boundingSphere = item.boundingSphere;
+		draw.firstInstance = item.instances.offset / instanceSize;
+		draw.firstVisibleInstance = visibleInstanceCount;
+
+		visibleInstanceCount += item.instanceCount;
+		culling.pageFirstJob[item.instances.page + 1] += (item.instanceCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE;
+
+		stats.drawCount++;
+		stats.instanceCount += item.instanceCount;
+	}
+
+	// jobs grouped by the page of their instances, which is bound to the pass as a whole
+	for (u32 page = 0; page < pageCount; ++page)
+		culling.pageFirstJob[page + 1] += culling.pageFirstJob[page];
+
+	culling.jobs.resize(culling.pageFirstJob[pageCount]);
+	{
+		std::vector<u32>& cursor = culling.pageFirstJob;
+		for (u32 i = 0; i < count; ++i)
+		{
+			const DrawItem& item = queue.items[queue.order[i]];
+			for (u32 first = 0; first < item.instanceCount; first += GPU_CULLING_GROUP_SIZE)
+				culling.jobs[cursor[item.instances.page]++] = GpuCullingJob{ i, first, glm::min(item.instanceCount - first, (u32)GPU_CULLING_GROUP_SIZE), 0 };
+		}
+
+		// the cursors ended at the start of the next page
+		for (u32 page = pageCount; page > 0; --page)
+			cursor[page] = cursor[page - 1];
+		cursor[0] = 0;
+	}
+
+	// upload the inputs, the commands go with their instance counts cleared
+	UploadStorageBuffer(culling.drawsBuffer, culling.drawsBufferSize, culling.draws.data(), count * sizeof(GpuCullingDraw), GL_STREAM_DRAW);
+	UploadStorageBuffer(culling.jobsBuffer, culling.jobsBufferSize, culling.jobs.data(), (u32)culling.jobs.size() * sizeof(GpuCullingJob), GL_STREAM_DRAW);
+	UploadStorageBuffer(culling.commandsBuffer, culling.commandsBufferSize, culling.commands.data(), count * sizeof(DrawElementsIndirectCommand), GL_DYNAMIC_COPY);
+	ReserveStorageBuffer(culling.visibleInstancesBuffer, culling.visibleInstancesBufferSize, visibleInstanceCount * instanceSize, GL_DYNAMIC_COPY);
+
+	const GLuint countersBuffer = CycleCountersBuffer(culling);
+
+	// cull
+	UseProgram(culling.program);
+	glUniform4fv(culling.frustumPlanesLocation, 6, glm::value_ptr(frustum.planes[0]));
+
+	const bool occlusionCulling = hiZ && hiZ->built;
+	glUniform1ui(culling.occlusionCullingLocation, occlusionCulling ? 1 : 0);
+	if (occlusionCulling)
+	{
+		glUniformMatrix4fv(culling.hiZViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(hiZ->viewProjection));
+		glUniform2i(culling.hiZSizeLocation, hiZ->size.x, hiZ->size.y);
+		glUniform1ui(culling.hiZLevelCountLocation, hiZ->levelCount);
+		BindTexture2D(0, hiZ->texture);
+	}
+
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_CULLING_DRAWS_BINDING, culling.drawsBuffer, 0, culling.drawsBufferSize);
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_CULLING_JOBS_BINDING, culling.jobsBuffer, 0, culling.jobsBufferSize);
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_CULLING_COMMANDS_BINDING, culling.commandsBuffer, 0, culling.commandsBufferSize);
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_CULLING_VISIBLE_INSTANCES_BINDING, culling.visibleInstancesBuffer, 0, culling.visibleInstancesBufferSize);
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_CULLING_COUNTERS_BINDING, countersBuffer, 0, 2 * sizeof(u32));
+
+	for (u32 page = 0; page < pageCount; ++page)
+	{
+		const u32 jobCount = culling.pageFirstJob[page + 1] - culling.pageFirstJob[page];
+		if (jobCount == 0) continue;
+
+		BindStoragePage(arena, page, GPU_CULLING_INSTANCES_BINDING);
+		glUniform1ui(culling.firstJobLocation, culling.pageFirstJob[page]);
+		glDispatchCompute(jobCount, 1, 1);
+
+		culling.stats.dispatchCount++;
+	}
+
+	culling.countersFences[(culling.countersIndex + GPU_CULLING_COUNTER_READBACK_COUNT - 1) % GPU_CULLING_COUNTER_READBACK_COUNT] =
+		glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	culling.stats.drawCount = count;
+	culling.stats.testedInstanceCount = visibleInstanceCount;
+
+	// the draws read the counts as commands and the instances as shader storage
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// draw
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandsBuffer);
+	BindBufferRange(GL_SHADER_STORAGE_BUFFER, instancesBinding, culling.visibleInstancesBuffer, 0, culling.visibleInstancesBufferSize);
+	stats.instanceBufferChanges++;
+
+	const DrawItem* previous = NULL;
+	for (const IndirectDrawRun& run : queue.indirectRuns)
+	{
+		const DrawItem& item = queue.items[queue.order[run.firstItem]];
+
+		if (!previous || item.program != previous->program) {
+			UseProgram(item.program);
+			stats.programChanges++;
+		}
+
+		if (!previous || item.vao != previous->vao) {
+			BindVertexArray(item.vao);
+			stats.vaoChanges++;
+		}
+
+		if (!previous || item.texture != previous->texture) {
+			BindTexture2D(0, item.texture);
+			stats.textureChanges++;
+		}
+
+		const u32 offset = run.firstCommand * sizeof(DrawElementsIndirectCommand);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, item.indexType, (void*)(u64)offset, run.commandCount, 0);
+
+		stats.multiDrawCount++;
+		previous = &item;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,102 @@
+//
+// gpu_culling.h: Frustum culling of the instances on the GPU. A compute pass tests the bounding
+// sphere of every instance of every draw of a render queue, appends the visible ones to the
+// instances of their draw with an atomic counter and writes that count into the indirect command
+// of the draw, which glMultiDrawElementsIndirect() then reads. The CPU writes one command per
+// draw, whatever the number of instances.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "render_queue.h"
+#include "culling.h"
+#include "hi_z.h"
+
+// Instances tested by each workgroup, local_size_x of the shader
+#define GPU_CULLING_GROUP_SIZE 64
+
+// Shader storage bindings of the culling pass
+#define GPU_CULLING_INSTANCES_BINDING         0
+#define GPU_CULLING_DRAWS_BINDING             1
+#define GPU_CULLING_JOBS_BINDING              2
+#define GPU_CULLING_COMMANDS_BINDING          3
+#define GPU_CULLING_VISIBLE_INSTANCES_BINDING 4
+#define GPU_CULLING_COUNTERS_BINDING          5
+
+// Frames the culled counts of the pass take to be read back
+#define GPU_CULLING_COUNTER_READBACK_COUNT 3
+
+// Per draw input of the pass (std430)
+struct GpuCullingDraw
+{
+	glm::vec4 boundingSphere;       // model space center and radius of the submesh
+	u32       firstInstance;        // of the draw in the arena page
+	u32       firstVisibleInstance; // where its visible instances go, its baseInstance
+	u32       padding[2];
+};
+
+// Up to GPU_CULLING_GROUP_SIZE instances of a draw, tested by one workgroup (std430)
+struct GpuCullingJob
+{
+	u32 draw;
+	u32 firstInstance; // relative to the first instance of the draw
+	u32 instanceCount;
+	u32 padding;
+};
+
+struct GpuCullingStats
+{
+	u32 drawCount;
+	u32 testedInstanceCount;
+	u32 dispatchCount;
+
+	// counted by the pass, GPU_CULLING_COUNTER_READBACK_COUNT frames late
+	u32 frustumCulledCount;
+	u32 occlusionCulledCount;
+};
+
+struct GpuCulling
+{
+	GLuint program;
+	GLint  frustumPlanesLocation;
+	GLint  firstJobLocation;
+	GLint  occlusionCullingLocation;
+	GLint  hiZViewProjectionLocation;
+	GLint  hiZSizeLocation;
+	GLint  hiZLevelCountLocation;
+
+	// GPU buffers, grown when a frame needs more
+	GLuint drawsBuffer;
+	GLuint jobsBuffer;
+	GLuint commandsBuffer;         // indirect commands, instance counts written by the pass
+	GLuint visibleInstancesBuffer; // compacted instance data, read by the mesh shaders
+	u32    drawsBufferSize;
+	u32    jobsBufferSize;
+	u32    commandsBufferSize;
+	u32    visibleInstancesBufferSize;
+
+	// culled counts (frustum, occlusion) of the last frames
+	GLuint countersBuffers[GPU_CULLING_COUNTER_READBACK_COUNT];
+	GLsync countersFences[GPU_CULLING_COUNTER_READBACK_COUNT];
+	u32    countersIndex;
+
+	// CPU side of the inputs, rebuilt each frame
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<GpuCullingDraw>              draws;
+	std::vector<GpuCullingJob>               jobs;        // grouped by arena page
+	std::vector<u32>                         pageFirstJob; // per page, plus the end
+
+	GpuCullingStats stats; // of the last submission
+};
+
+void InitGpuCulling(GpuCulling& culling, GLuint program);
+
+/**
+ * Culls the instances of the queue against the frustum, and against the Hi-Z pyramid of the last
+ * frame when there is one, and submits it like SubmitRenderQueueIndirect(), with the compacted
+ * instances bound to instancesBinding. instanceSize is the size of the instance data, which must
+ * start with the world matrix.
+ */
+void SubmitRenderQueueGpuCulled(GpuCulling& culling, RenderQueue& queue, const UniformArena& arena, const Frustum& frustum,
+	const HiZPyramid* hiZ, u32 instancesBinding, u32 instanceSize);
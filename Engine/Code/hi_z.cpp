@@ -0,0 +1,230 @@
+#include "hi_z.h"
+#include "gl_state.h"
+#include <float.h>
+#include <string.h>
+
+static glm::ivec2 GetLevelSize(const HiZPyramid& hiZ, u32 level)
+{
+	return glm::max(glm::ivec2(hiZ.size.x >> level, hiZ.size.y >> level), glm::ivec2(1));
+}
+
+static u32 GetGroupCount(i32 texels)
+{
+	return (u32)(texels + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE;
+}
+
+static void DropReadbacks(HiZPyramid& hiZ)
+{
+	for (u32 i = 0; i < HIZ_READBACK_COUNT; ++i)
+	{
+		if (hiZ.readbackFences[i]) glDeleteSync(hiZ.readbackFences[i]);
+		hiZ.readbackFences[i] = 0;
+	}
+	hiZ.cpuValid = false;
+}
+
+void InitHiZ(HiZPyramid& hiZ, GLuint copyProgram, GLuint reduceProgram)
+{
+	hiZ.copyProgram = copyProgram;
+	hiZ.reduceProgram = reduceProgram;
+}
+
+void ResizeHiZ(HiZPyramid& hiZ, glm::ivec2 size)
+{
+	DropReadbacks(hiZ);
+
+	if (hiZ.texture)
+		DeleteTexture(hiZ.texture);
+
+	hiZ.size = size;
+	hiZ.built = false;
+	if (size.x <= 0 || size.y <= 0)
+		return; // minimized
+
+	hiZ.levelCount = 1;
+	while ((glm::max(size.x, size.y) >> hiZ.levelCount) > 0)
+		hiZ.levelCount++;
+
+	glGenTextures(1, &hiZ.texture);
+	BindTexture2D(0, hiZ.texture);
+	glTexStorage2D(GL_TEXTURE_2D, hiZ.levelCount, GL_RG32F, size.x, size.y);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	BindTexture2D(0, 0);
+
+	// the coarse levels read back for the CPU
+	hiZ.readbackFirstLevel = 0;
+	while (hiZ.readbackFirstLevel + 1 < hiZ.levelCount)
+	{
+		const glm::ivec2 levelSize = GetLevelSize(hiZ, hiZ.readbackFirstLevel);
+		if (glm::max(levelSize.x, levelSize.y) <= HIZ_READBACK_MAX_SIZE) break;
+		hiZ.readbackFirstLevel++;
+	}
+
+	u32 texelCount = 0;
+	hiZ.cpuLevelOffsets.clear();
+	for (u32 level = hiZ.readbackFirstLevel; level < hiZ.levelCount; ++level)
+	{
+		const glm::ivec2 levelSize = GetLevelSize(hiZ, level);
+		hiZ.cpuLevelOffsets.push_back(texelCount);
+		texelCount += levelSize.x * levelSize.y;
+	}
+	hiZ.readbackSize = texelCount * sizeof(glm::vec2);
+	hiZ.cpuTexels.resize(texelCount);
+
+	if (!hiZ.readbackBuffers[0])
+		glGenBuffers(HIZ_READBACK_COUNT, hiZ.readbackBuffers);
+	for (u32 i = 0; i < HIZ_READBACK_COUNT; ++i)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZ.readbackBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, hiZ.readbackSize, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void InvalidateHiZ(HiZPyramid& hiZ)
+{
+	DropReadbacks(hiZ);
+	hiZ.built = false;
+}
+
+void BuildHiZ(HiZPyramid& hiZ, GLuint depthTexture, const glm::mat4& viewProjection, bool readback)
+{
+	if (!hiZ.texture)
+		return;
+
+	// level 0: min and max are the depth itself
+	UseProgram(hiZ.copyProgram);
+	BindTexture2D(0, depthTexture);
+	glBindImageTexture(0, hiZ.texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+	glDispatchCompute(GetGroupCount(hiZ.size.x), GetGroupCount(hiZ.size.y), 1);
+
+	UseProgram(hiZ.reduceProgram);
+	for (u32 level = 1; level < hiZ.levelCount; ++level)
+	{
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		const glm::ivec2 levelSize = GetLevelSize(hiZ, level);
+		glBindImageTexture(0, hiZ.texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+		glBindImageTexture(1, hiZ.texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+		glDispatchCompute(GetGroupCount(levelSize.x), GetGroupCount(levelSize.y), 1);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	hiZ.viewProjection = viewProjection;
+	hiZ.built = true;
+
+	// the CPU path stops here, an older readback would keep culling with a stale pyramid
+	if (!readback) {
+		DropReadbacks(hiZ);
+		return;
+	}
+
+	// a readback still pending here is three frames old, the newer ones will replace it
+	const u32 index = hiZ.readbackIndex;
+	if (hiZ.readbackFences[index])
+		glDeleteSync(hiZ.readbackFences[index]);
+
+	// glGetTexImage() reads the active unit: the first bind leaves unit 0 active whether or not it is skipped
+	BindTexture2D(0, 0);
+	BindTexture2D(0, hiZ.texture);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZ.readbackBuffers[index]);
+	for (u32 level = hiZ.readbackFirstLevel; level < hiZ.levelCount; ++level)
+	{
+		const u32 offset = hiZ.cpuLevelOffsets[level - hiZ.readbackFirstLevel] * sizeof(glm::vec2);
+		glGetTexImage(GL_TEXTURE_2D, level, GL_RG, GL_FLOAT, (void*)(u64)offset);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	hiZ.readbackFences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	hiZ.readbackViewProjections[index] = viewProjection;
+	hiZ.readbackIndex = (index + 1) % HIZ_READBACK_COUNT;
+}
+
+void UpdateHiZReadback(HiZPyramid& hiZ)
+{
+	// from the newest readback to the oldest, the ones older than a finished one are not needed anymore
+	bool found = false;
+	for (u32 age = 1; age <= HIZ_READBACK_COUNT; ++age)
+	{
+		const u32 index = (hiZ.readbackIndex + HIZ_READBACK_COUNT - age) % HIZ_READBACK_COUNT;
+		GLsync& fence = hiZ.readbackFences[index];
+		if (!fence) continue;
+
+		if (!found)
+		{
+			const GLenum result = glClientWaitSync(fence, 0, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) continue;
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZ.readbackBuffers[index]);
+			const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, hiZ.readbackSize, GL_MAP_READ_BIT);
+			if (data)
+			{
+				memcpy(hiZ.cpuTexels.data(), data, hiZ.readbackSize);
+				hiZ.cpuViewProjection = hiZ.readbackViewProjections[index];
+				hiZ.cpuValid = true;
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			found = true;
+		}
+
+		glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+bool IsOccludedByHiZ(const HiZPyramid& hiZ, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (!hiZ.cpuValid)
+		return false;
+
+	// screen rectangle and nearest depth of the box, as seen when the depth was rendered
+	glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+	f32 nearestDepth = 1.0f;
+	for (u32 corner = 0; corner < 8; ++corner)
+	{
+		const glm::vec3 position(corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z);
+		const glm::vec4 clip = hiZ.cpuViewProjection * glm::vec4(position, 1.0f);
+
+		// crossing the near plane: it covers the camera
+		if (clip.w <= 0.0f)
+			return false;
+
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		uvMin = glm::min(uvMin, glm::vec2(ndc) * 0.5f + 0.5f);
+		uvMax = glm::max(uvMax, glm::vec2(ndc) * 0.5f + 0.5f);
+		nearestDepth = glm::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	// outside the depth that was rendered, nothing is known about it
+	if (uvMax.x < 0.0f || uvMax.y < 0.0f || uvMin.x > 1.0f || uvMin.y > 1.0f)
+		return false;
+
+	uvMin = glm::clamp(uvMin, 0.0f, 1.0f);
+	uvMax = glm::clamp(uvMax, 0.0f, 1.0f);
+
+	// the level where the rectangle is at most a texel wide, so it touches at most 2x2 of them
+	const glm::vec2 extent = (uvMax - uvMin) * glm::vec2(hiZ.size);
+	u32 level = (u32)ceilf(log2f(glm::max(glm::max(extent.x, extent.y), 1.0f)));
+	level = glm::clamp(level, hiZ.readbackFirstLevel, hiZ.levelCount - 1);
+
+	const glm::ivec2 levelSize = GetLevelSize(hiZ, level);
+	// through level 0 texels, as the last texel of an odd sized level also covers the remainder
+	const glm::ivec2 pixelMin = glm::min(glm::ivec2(uvMin * glm::vec2(hiZ.size)), hiZ.size - 1);
+	const glm::ivec2 pixelMax = glm::min(glm::ivec2(uvMax * glm::vec2(hiZ.size)), hiZ.size - 1);
+	const glm::ivec2 texelMin = glm::min(glm::ivec2(pixelMin.x >> level, pixelMin.y >> level), levelSize - 1);
+	const glm::ivec2 texelMax = glm::min(glm::ivec2(pixelMax.x >> level, pixelMax.y >> level), levelSize - 1);
+	const glm::vec2* texels = hiZ.cpuTexels.data() + hiZ.cpuLevelOffsets[level - hiZ.readbackFirstLevel];
+
+	f32 farthestDepth = 0.0f;
+	for (i32 y = texelMin.y; y <= texelMax.y; ++y)
+		for (i32 x = texelMin.x; x <= texelMax.x; ++x)
+			farthestDepth = glm::max(farthestDepth, texels[y * levelSize.x + x].y);
+
+	return nearestDepth > farthestDepth;
+}
@@ -0,0 +1,70 @@
+//
+// hi_z.h: Hierarchical Z pyramid of the depth buffer, for occlusion culling. Every level holds the
+// min and max depth of the texels of the level below it, so bounds projected on the screen are
+// hidden when their nearest depth is behind the max depth of the texels they cover, read at the
+// level where they cover at most 2x2 texels.
+//
+// The pyramid is built after the G-buffer pass and culls the next frame, projecting the bounds
+// with the view projection the depth was rendered with. The GPU culling pass samples it directly,
+// the CPU path reads its coarse levels back asynchronously and uses the latest one that arrived.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+// The CPU reads back the levels whose larger side is at most this many texels
+#define HIZ_READBACK_MAX_SIZE 128
+
+#define HIZ_READBACK_COUNT 3
+
+// Local size of the pyramid shaders in each axis
+#define HIZ_GROUP_SIZE 8
+
+struct HiZPyramid
+{
+	GLuint copyProgram;   // level 0 from the depth buffer
+	GLuint reduceProgram; // each level from the previous one
+
+	GLuint     texture;    // RG32F: min, max depth
+	glm::ivec2 size;       // of level 0, the size of the depth buffer
+	u32        levelCount;
+	glm::mat4  viewProjection; // the depth was rendered with
+	bool       built;
+
+	// levels readbackFirstLevel and up, copied to a ring of pixel pack buffers fenced until the GPU wrote them
+	u32       readbackFirstLevel;
+	u32       readbackSize; // bytes of all the levels read back
+	GLuint    readbackBuffers[HIZ_READBACK_COUNT];
+	GLsync    readbackFences[HIZ_READBACK_COUNT];
+	glm::mat4 readbackViewProjections[HIZ_READBACK_COUNT];
+	u32       readbackIndex;
+
+	// latest pyramid read back, for the CPU tests
+	std::vector<glm::vec2> cpuTexels;       // levels readbackFirstLevel and up, one after the other
+	std::vector<u32>       cpuLevelOffsets; // in texels, per level read back
+	glm::mat4              cpuViewProjection;
+	bool                   cpuValid;
+};
+
+void InitHiZ(HiZPyramid& hiZ, GLuint copyProgram, GLuint reduceProgram);
+
+// (Re)creates the pyramid for a depth buffer of this size, dropping the pyramids being read back
+void ResizeHiZ(HiZPyramid& hiZ, glm::ivec2 size);
+
+// Forgets the pyramid and the readbacks, for the frames it is not built. Nothing is occluded until the next build.
+void InvalidateHiZ(HiZPyramid& hiZ);
+
+/**
+ * Builds the pyramid from the depth texture, rendered with viewProjection. With readback, its
+ * coarse levels are also copied for the CPU, they reach IsOccludedByHiZ() a few frames later.
+ * Without, the readbacks still pending or taken are dropped.
+ */
+void BuildHiZ(HiZPyramid& hiZ, GLuint depthTexture, const glm::mat4& viewProjection, bool readback);
+
+// Takes the newest readback the GPU has finished, if any. Call before the CPU tests of a frame.
+void UpdateHiZReadback(HiZPyramid& hiZ);
+
+// Tests a world space box against the pyramid read back. Without one, nothing is occluded.
+bool IsOccludedByHiZ(const HiZPyramid& hiZ, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
@@ -0,0 +1,208 @@
+#include "job_system.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+struct JobQueue
+{
+	std::mutex      mutex;
+	std::deque<Job> jobs;
+};
+
+// queue 0 belongs to the main thread, queue i + 1 to the worker i
+static std::vector<std::thread> Workers;
+static JobQueue*                Queues = NULL;
+static u32                      QueueCount = 0;
+static JobQueue                 BackgroundQueue;
+
+static std::atomic<bool>       Running(false);
+static std::atomic<u32>        QueuedJobs(0);
+static std::mutex              SleepMutex;
+static std::condition_variable WakeUp;
+
+static thread_local u32  ThreadQueueIndex = 0;
+static thread_local bool ThreadInBackgroundJob = false;
+
+static bool PopJob(u32 queueIndex, Job& job)
+{
+	JobQueue& queue = Queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty()) return false;
+
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	return true;
+}
+
+static bool StealJob(u32 thiefIndex, Job& job)
+{
+	for (u32 i = 1; i < QueueCount; ++i)
+	{
+		JobQueue& queue = Queues[(thiefIndex + i) % QueueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) continue;
+
+		// the oldest job, which is the one the owner would run last
+		job = queue.jobs.front();
+		queue.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+static bool PopBackgroundJob(u32 queueIndex, Job& job)
+{
+	if (queueIndex == 0) return false; // the main thread never blocks on a background job
+
+	std::lock_guard<std::mutex> lock(BackgroundQueue.mutex);
+	if (BackgroundQueue.jobs.empty()) return false;
+
+	job = BackgroundQueue.jobs.front();
+	BackgroundQueue.jobs.pop_front();
+	return true;
+}
+
+static bool TryRunJob(u32 queueIndex)
+{
+	Job job;
+	bool background = false;
+	if (!PopJob(queueIndex, job) && !StealJob(queueIndex, job)) {
+		if (!PopBackgroundJob(queueIndex, job))
+			return false;
+		background = true;
+	}
+
+	if (job.dependency && job.dependency->pending.load() != 0)
+	{
+		// not ready: leave it where it will be picked last
+		JobQueue& queue = Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_front(job);
+		return false;
+	}
+
+	QueuedJobs--;
+
+	const bool wasInBackgroundJob = ThreadInBackgroundJob;
+	ThreadInBackgroundJob = wasInBackgroundJob || background;
+	job.function(job.data, job.begin, job.end);
+	ThreadInBackgroundJob = wasInBackgroundJob;
+
+	job.counter->pending--;
+	return true;
+}
+
+static void WorkerLoop(u32 queueIndex)
+{
+	ThreadQueueIndex = queueIndex;
+
+	while (Running)
+	{
+		if (TryRunJob(queueIndex))
+			continue;
+
+		std::unique_lock<std::mutex> lock(SleepMutex);
+		if (QueuedJobs == 0 && Running)
+			WakeUp.wait(lock, [] { return QueuedJobs > 0 || !Running; });
+		else
+			std::this_thread::yield(); // only jobs waiting on a dependency are left
+	}
+}
+
+void InitJobSystem(u32 workerCount)
+{
+	if (workerCount == 0) {
+		u32 hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	QueueCount = workerCount + 1;
+	Queues = new JobQueue[QueueCount];
+	Running = true;
+
+	for (u32 i = 0; i < workerCount; ++i)
+		Workers.push_back(std::thread(WorkerLoop, i + 1));
+
+	ILOG("Job system: %u worker threads", workerCount);
+}
+
+void ShutdownJobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(SleepMutex);
+		Running = false;
+	}
+	WakeUp.notify_all();
+
+	for (std::thread& worker : Workers)
+		worker.join();
+	Workers.clear();
+
+	delete[] Queues;
+	Queues = NULL;
+	QueueCount = 0;
+}
+
+u32 GetJobWorkerCount()
+{
+	return (u32)Workers.size();
+}
+
+void RunJob(const Job& job)
+{
+	ASSERT(Queues != NULL, "The job system is not initialized");
+
+	job.counter->pending++;
+
+	if (ThreadInBackgroundJob) {
+		// parts of a background job stay out of reach of the main thread, ahead of the other background jobs
+		std::lock_guard<std::mutex> lock(BackgroundQueue.mutex);
+		BackgroundQueue.jobs.push_front(job);
+	}
+	else {
+		JobQueue& queue = Queues[ThreadQueueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(SleepMutex);
+		QueuedJobs++;
+	}
+	WakeUp.notify_one();
+}
+
+void RunBackgroundJob(const Job& job)
+{
+	ASSERT(Queues != NULL, "The job system is not initialized");
+	ASSERT(job.dependency == NULL, "Background jobs can not have dependencies");
+
+	job.counter->pending++;
+
+	if (Workers.empty()) {
+		job.function(job.data, job.begin, job.end);
+		job.counter->pending--;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(BackgroundQueue.mutex);
+		BackgroundQueue.jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(SleepMutex);
+		QueuedJobs++;
+	}
+	WakeUp.notify_one();
+}
+
+void WaitForCounter(JobCounter& counter)
+{
+	while (counter.pending.load() != 0)
+	{
+		if (!TryRunJob(ThreadQueueIndex))
+			std::this_thread::yield();
+	}
+}
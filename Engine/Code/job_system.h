@@ -0,0 +1,71 @@
+//
+// job_system.h: Worker threads running small jobs. Every thread owns a deque of jobs: it pushes
+// and pops its own jobs at the back and steals from the front of the others when it runs out.
+// Jobs must not use the frame arena (PushSize/MakeString), it is not thread safe.
+// Long jobs (asset loading) go to a background queue that only the workers serve, so waiting
+// for per-frame work on the main thread never picks one of them up.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+
+typedef void (*JobFunction)(void* data, u32 begin, u32 end);
+
+// Unfinished jobs of a group. RunJob() increments it and it is decremented when each job finishes.
+struct JobCounter
+{
+	JobCounter() : pending(0) {}
+
+	std::atomic<u32> pending;
+};
+
+struct Job
+{
+	JobFunction function;
+	void*       data;
+	u32         begin;
+	u32         end;
+	JobCounter* counter;
+	JobCounter* dependency; // the job does not start until this counter reaches 0 (can be NULL).
+	                        // Run the jobs of the dependency first, an empty counter does not hold anything back.
+};
+
+// workerCount 0 starts one worker per hardware thread besides the main one
+void InitJobSystem(u32 workerCount);
+void ShutdownJobSystem();
+
+u32 GetJobWorkerCount();
+
+void RunJob(const Job& job);
+
+// Queues a job that may take many frames. Without worker threads it runs immediately.
+void RunBackgroundJob(const Job& job);
+
+// Runs queued jobs on the calling thread until every job of the counter has finished
+void WaitForCounter(JobCounter& counter);
+
+/**
+ * Calls function(begin, end) for consecutive ranges of at most chunkSize elements of [0, count)
+ * on the workers and the calling thread, and returns when all of them are done.
+ */
+template <typename Function>
+void ParallelFor(u32 count, u32 chunkSize, const Function& function)
+{
+	if (chunkSize == 0) chunkSize = 1;
+
+	JobCounter counter;
+	for (u32 begin = 0; begin < count; begin += chunkSize)
+	{
+		Job job = {};
+		job.function = [](void* data, u32 begin, u32 end) { (*(const Function*)data)(begin, end); };
+		job.data = (void*)&function;
+		job.begin = begin;
+		job.end = begin + chunkSize < count ? begin + chunkSize : count;
+		job.counter = &counter;
+		RunJob(job);
+	}
+
+	WaitForCounter(counter);
+}
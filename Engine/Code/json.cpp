@@ -0,0 +1,231 @@
+#include "json.h"
+#include <string.h>
+
+#define JSON_MAX_DEPTH 64
+
+struct JsonParser
+{
+	const char* begin;
+	const char* cursor;
+	const char* end;
+	bool        failed;
+};
+
+static void JsonError(JsonParser& parser, const char* message)
+{
+	if (!parser.failed)
+		ELOG("JSON error at offset %u: %s", (u32)(parser.cursor - parser.begin), message);
+	parser.failed = true;
+}
+
+static void SkipJsonWhitespace(JsonParser& parser)
+{
+	while (parser.cursor < parser.end && (*parser.cursor == ' ' || *parser.cursor == '\t' || *parser.cursor == '\n' || *parser.cursor == '\r'))
+		++parser.cursor;
+}
+
+static bool ConsumeJson(JsonParser& parser, const char* literal)
+{
+	const size_t length = strlen(literal);
+	if ((size_t)(parser.end - parser.cursor) < length || memcmp(parser.cursor, literal, length) != 0)
+		return false;
+	parser.cursor += length;
+	return true;
+}
+
+static void AppendUtf8(std::string& string, u32 codepoint)
+{
+	if (codepoint < 0x80) {
+		string += (char)codepoint;
+	}
+	else if (codepoint < 0x800) {
+		string += (char)(0xC0 | (codepoint >> 6));
+		string += (char)(0x80 | (codepoint & 0x3F));
+	}
+	else if (codepoint < 0x10000) {
+		string += (char)(0xE0 | (codepoint >> 12));
+		string += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		string += (char)(0x80 | (codepoint & 0x3F));
+	}
+	else {
+		string += (char)(0xF0 | (codepoint >> 18));
+		string += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+		string += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		string += (char)(0x80 | (codepoint & 0x3F));
+	}
+}
+
+static u32 ParseJsonHex4(JsonParser& parser)
+{
+	u32 value = 0;
+	for (u32 i = 0; i < 4; ++i, ++parser.cursor)
+	{
+		if (parser.cursor >= parser.end) { JsonError(parser, "truncated \\u escape"); return 0; }
+		const char c = *parser.cursor;
+		value <<= 4;
+		if      (c >= '0' && c <= '9') value |= (u32)(c - '0');
+		else if (c >= 'a' && c <= 'f') value |= (u32)(c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F') value |= (u32)(c - 'A' + 10);
+		else { JsonError(parser, "invalid \\u escape"); return 0; }
+	}
+	return value;
+}
+
+// The cursor is on the opening quote
+static void ParseJsonString(JsonParser& parser, std::string& string)
+{
+	++parser.cursor;
+	while (parser.cursor < parser.end && !parser.failed)
+	{
+		const char c = *parser.cursor++;
+		if (c == '"')
+			return;
+
+		if (c != '\\') {
+			string += c;
+			continue;
+		}
+
+		if (parser.cursor >= parser.end)
+			break;
+
+		const char escaped = *parser.cursor++;
+		switch (escaped)
+		{
+			case '"':  string += '"';  break;
+			case '\\': string += '\\'; break;
+			case '/':  string += '/';  break;
+			case 'b':  string += '\b'; break;
+			case 'f':  string += '\f'; break;
+			case 'n':  string += '\n'; break;
+			case 'r':  string += '\r'; break;
+			case 't':  string += '\t'; break;
+			case 'u': {
+				u32 codepoint = ParseJsonHex4(parser);
+				// surrogate pair
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && ConsumeJson(parser, "\\u")) {
+					const u32 low = ParseJsonHex4(parser);
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(string, codepoint);
+				break;
+			}
+			default: JsonError(parser, "invalid escape sequence"); return;
+		}
+	}
+
+	JsonError(parser, "unterminated string");
+}
+
+static void ParseJsonValue(JsonParser& parser, JsonValue& value, u32 depth)
+{
+	SkipJsonWhitespace(parser);
+	value = JsonValue{};
+
+	if (depth > JSON_MAX_DEPTH) { JsonError(parser, "too deeply nested"); return; }
+	if (parser.cursor >= parser.end) { JsonError(parser, "unexpected end of the document"); return; }
+
+	const char c = *parser.cursor;
+
+	if (c == '{')
+	{
+		value.type = JsonType_Object;
+		++parser.cursor;
+		SkipJsonWhitespace(parser);
+		if (ConsumeJson(parser, "}")) return;
+
+		while (!parser.failed)
+		{
+			SkipJsonWhitespace(parser);
+			if (parser.cursor >= parser.end || *parser.cursor != '"') { JsonError(parser, "expected a member name"); return; }
+
+			value.keys.push_back(std::string());
+			ParseJsonString(parser, value.keys.back());
+
+			SkipJsonWhitespace(parser);
+			if (!ConsumeJson(parser, ":")) { JsonError(parser, "expected ':'"); return; }
+
+			value.elements.push_back(JsonValue{});
+			ParseJsonValue(parser, value.elements.back(), depth + 1);
+
+			SkipJsonWhitespace(parser);
+			if (ConsumeJson(parser, "}")) return;
+			if (!ConsumeJson(parser, ",")) { JsonError(parser, "expected ',' or '}'"); return; }
+		}
+	}
+	else if (c == '[')
+	{
+		value.type = JsonType_Array;
+		++parser.cursor;
+		SkipJsonWhitespace(parser);
+		if (ConsumeJson(parser, "]")) return;
+
+		while (!parser.failed)
+		{
+			value.elements.push_back(JsonValue{});
+			ParseJsonValue(parser, value.elements.back(), depth + 1);
+
+			SkipJsonWhitespace(parser);
+			if (ConsumeJson(parser, "]")) return;
+			if (!ConsumeJson(parser, ",")) { JsonError(parser, "expected ',' or ']'"); return; }
+		}
+	}
+	else if (c == '"')
+	{
+		value.type = JsonType_String;
+		ParseJsonString(parser, value.string);
+	}
+	else if (c == '-' || (c >= '0' && c <= '9'))
+	{
+		value.type = JsonType_Number;
+		const char* numberEnd = ParseDecimal(parser.cursor, parser.end, value.number);
+		if (numberEnd == parser.cursor) { JsonError(parser, "invalid number"); return; }
+		parser.cursor = numberEnd;
+	}
+	else if (ConsumeJson(parser, "true"))  { value.type = JsonType_Bool; value.boolean = true; }
+	else if (ConsumeJson(parser, "false")) { value.type = JsonType_Bool; value.boolean = false; }
+	else if (ConsumeJson(parser, "null"))  { value.type = JsonType_Null; }
+	else JsonError(parser, "unexpected character");
+}
+
+bool ParseJson(const char* text, u32 length, JsonValue& root)
+{
+	JsonParser parser = { text, text, text + length, false };
+	ParseJsonValue(parser, root, 0);
+
+	SkipJsonWhitespace(parser);
+	if (!parser.failed && parser.cursor != parser.end)
+		JsonError(parser, "unexpected data after the document");
+
+	return !parser.failed;
+}
+
+const JsonValue* FindJsonMember(const JsonValue& object, const char* key)
+{
+	if (object.type != JsonType_Object)
+		return NULL;
+
+	for (u32 i = 0; i < object.keys.size(); ++i)
+		if (object.keys[i] == key)
+			return &object.elements[i];
+	return NULL;
+}
+
+const JsonValue* GetJsonElement(const JsonValue* array, u32 index)
+{
+	if (!array || array->type != JsonType_Array || index >= array->elements.size())
+		return NULL;
+	return &array->elements[index];
+}
+
+f64 GetJsonNumber(const JsonValue& object, const char* key, f64 defaultValue)
+{
+	const JsonValue* member = FindJsonMember(object, key);
+	return member && member->type == JsonType_Number ? member->number : defaultValue;
+}
+
+std::string GetJsonString(const JsonValue& object, const char* key, const char* defaultValue)
+{
+	const JsonValue* member = FindJsonMember(object, key);
+	return member && member->type == JsonType_String ? member->string : std::string(defaultValue);
+}
@@ -0,0 +1,41 @@
+//
+// json.h: Small JSON reader for asset metadata (the JSON chunk of glTF files). It builds the
+// whole document as a tree of values; it is meant for documents of a few kilobytes, not for data.
+//
+
+#pragma once
+
+#include "platform.h"
+
+enum JsonType
+{
+	JsonType_Null,
+	JsonType_Bool,
+	JsonType_Number,
+	JsonType_String,
+	JsonType_Array,
+	JsonType_Object,
+};
+
+struct JsonValue
+{
+	JsonType                 type;
+	bool                     boolean;
+	f64                      number;
+	std::string              string;
+	std::vector<JsonValue>   elements; // array elements, or object members
+	std::vector<std::string> keys;     // object member names, parallel to elements
+};
+
+// Returns false and logs the offset of the error on malformed input
+bool ParseJson(const char* text, u32 length, JsonValue& root);
+
+// NULL if the value is not an object or has no such member
+const JsonValue* FindJsonMember(const JsonValue& object, const char* key);
+
+// The element, or NULL when the value is not an array or the index is out of range
+const JsonValue* GetJsonElement(const JsonValue* array, u32 index);
+
+// Members with a default for when they are missing or of another type
+f64         GetJsonNumber(const JsonValue& object, const char* key, f64 defaultValue);
+std::string GetJsonString(const JsonValue& object, const char* key, const char* defaultValue);
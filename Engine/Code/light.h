@@ -9,13 +9,12 @@ enum LightType
 	LightType_Directional
 };
 
+// Description of a light, stored in the scene with AddLight()
 struct Light
 {
 	LightType type;
 	glm::vec3 color;
+	f32 radius; // distance at which a point light stops contributing
 
 	Transform transform;
-
-	u32 localUniformBufferHead;
-	u32 localUniformBufferSize;
 };
@@ -0,0 +1,327 @@
+#include "mesh_optimizer.h"
+#include "culling.h"
+#include <algorithm>
+#include <string.h>
+
+u32 CountCacheMisses(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize)
+{
+	// a vertex is in the cache while fewer than cacheSize misses happened since its own
+	std::vector<u32> missTime(vertexCount, 0);
+	u32 misses = 0;
+	for (u32 i = 0; i < indexCount; ++i)
+	{
+		const u32 vertex = indices[i];
+		if (missTime[vertex] == 0 || misses + 1 - missTime[vertex] > cacheSize)
+			missTime[vertex] = ++misses;
+	}
+	return misses;
+}
+
+// Vertex -> triangles adjacency, as offsets into one array
+struct TriangleAdjacency
+{
+	std::vector<u32> offsets; // vertexCount + 1
+	std::vector<u32> triangles;
+};
+
+static void BuildAdjacency(TriangleAdjacency& adjacency, const u32* indices, u32 indexCount, u32 vertexCount)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (u32 i = 0; i < indexCount; ++i)
+		adjacency.offsets[indices[i] + 1]++;
+	for (u32 v = 0; v < vertexCount; ++v)
+		adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+	std::vector<u32> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.triangles.resize(indexCount);
+	for (u32 i = 0; i < indexCount; ++i)
+		adjacency.triangles[cursor[indices[i]]++] = i / 3;
+}
+
+void OptimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount, std::vector<u32>* clusterStarts)
+{
+	const u32 triangleCount = indexCount / 3;
+	const i32 cacheSize = MESH_OPTIMIZER_CACHE_SIZE;
+	if (clusterStarts) clusterStarts->clear();
+	if (triangleCount == 0)
+		return;
+
+	TriangleAdjacency adjacency;
+	BuildAdjacency(adjacency, indices, indexCount, vertexCount);
+
+	// live: triangles of the vertex not emitted yet, cacheTime: timestamp of its last miss
+	std::vector<i32> live(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+		live[v] = (i32)(adjacency.offsets[v + 1] - adjacency.offsets[v]);
+	std::vector<i32> cacheTime(vertexCount, 0);
+	std::vector<u8>  emitted(triangleCount, 0);
+	std::vector<u32> deadEnd;    // stack of the vertices emitted most recently
+	std::vector<u32> candidates; // vertices of the triangles of the last fan
+	std::vector<u32> output;
+	output.reserve(indexCount);
+
+	i32 time = cacheSize + 1;
+	u32 cursor = 0; // next vertex in input order, when the dead ends are exhausted too
+	i64 fanning = indices[0];
+
+	if (clusterStarts) clusterStarts->push_back(0);
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+
+		const u32 fan = (u32)fanning;
+		for (u32 k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; ++k)
+		{
+			const u32 triangle = adjacency.triangles[k];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = 1;
+
+			for (u32 corner = 0; corner < 3; ++corner)
+			{
+				const u32 vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+
+				if (time - cacheTime[vertex] > cacheSize)
+					cacheTime[vertex] = time++;
+			}
+		}
+
+		// the candidate that stays in the cache for its remaining triangles, the oldest one first
+		fanning = -1;
+		i32 best = -1;
+		for (u32 vertex : candidates)
+		{
+			if (live[vertex] <= 0) continue;
+
+			i32 priority = 0;
+			if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize)
+				priority = time - cacheTime[vertex];
+			if (priority > best) {
+				best = priority;
+				fanning = vertex;
+			}
+		}
+
+		if (fanning >= 0)
+			continue;
+
+		// dead end: a recent vertex with triangles left, otherwise the next one in input order
+		while (!deadEnd.empty() && fanning < 0) {
+			const u32 vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[vertex] > 0) fanning = vertex;
+		}
+		while (cursor < vertexCount && fanning < 0) {
+			if (live[cursor] > 0) fanning = cursor;
+			cursor++;
+		}
+
+		if (fanning >= 0 && clusterStarts)
+			clusterStarts->push_back((u32)output.size() / 3);
+	}
+
+	ASSERT(output.size() == indexCount, "Every triangle is emitted once");
+	memcpy(indices, output.data(), indexCount * sizeof(u32));
+}
+
+void SplitClusters(const u32* indices, u32 indexCount, u32 vertexCount, f32 threshold, std::vector<u32>& clusterStarts)
+{
+	const u32 triangleCount = indexCount / 3;
+	if (triangleCount == 0 || clusterStarts.empty())
+		return;
+
+	const f32 maxMissesPerTriangle = threshold * CountCacheMisses(indices, indexCount, vertexCount, MESH_OPTIMIZER_CACHE_SIZE) / triangleCount;
+
+	// same FIFO as CountCacheMisses(), where the misses before the cluster do not count as cached
+	std::vector<u32> missTime(vertexCount, 0);
+	std::vector<u32> split;
+	u32 misses = 0;
+
+	for (u32 i = 0; i < clusterStarts.size(); ++i)
+	{
+		const u32 end = i + 1 < clusterStarts.size() ? clusterStarts[i + 1] : triangleCount;
+		u32 clusterStart = clusterStarts[i];
+		u32 clusterMissStart = misses;
+		split.push_back(clusterStart);
+
+		for (u32 t = clusterStart; t < end; ++t)
+		{
+			for (u32 corner = 0; corner < 3; ++corner)
+			{
+				const u32 vertex = indices[t * 3 + corner];
+				if (missTime[vertex] <= clusterMissStart || misses + 1 - missTime[vertex] > MESH_OPTIMIZER_CACHE_SIZE)
+					missTime[vertex] = ++misses;
+			}
+
+			if (t + 1 < end && misses - clusterMissStart <= maxMissesPerTriangle * (t + 1 - clusterStart))
+			{
+				clusterStart = t + 1;
+				clusterMissStart = misses;
+				split.push_back(clusterStart);
+			}
+		}
+	}
+
+	clusterStarts.swap(split);
+}
+
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 stride, const std::vector<u32>& clusterStarts)
+{
+	const u32 triangleCount = indexCount / 3;
+	const u32 clusterCount = (u32)clusterStarts.size();
+	if (clusterCount < 2)
+		return;
+
+	struct Cluster
+	{
+		u32 firstTriangle;
+		u32 triangleCount;
+		vec3 centroid;
+		vec3 normal;
+		f32 sortKey;
+	};
+	std::vector<Cluster> clusters(clusterCount);
+
+	// area weighted centroid and normal of each cluster, and of the whole mesh
+	vec3 meshCentroid(0.0f);
+	f32 meshArea = 0.0f;
+	for (u32 i = 0; i < clusterCount; ++i)
+	{
+		Cluster& cluster = clusters[i];
+		cluster.firstTriangle = clusterStarts[i];
+		cluster.triangleCount = (i + 1 < clusterCount ? clusterStarts[i + 1] : triangleCount) - cluster.firstTriangle;
+		cluster.centroid = vec3(0.0f);
+		cluster.normal = vec3(0.0f);
+
+		f32 clusterArea = 0.0f;
+		for (u32 t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+		{
+			const vec3& a = *(const vec3*)(positions + indices[t * 3 + 0] * stride);
+			const vec3& b = *(const vec3*)(positions + indices[t * 3 + 1] * stride);
+			const vec3& c = *(const vec3*)(positions + indices[t * 3 + 2] * stride);
+			const vec3 normal = glm::cross(b - a, c - a);
+			const f32 area = glm::length(normal);
+
+			cluster.centroid += (a + b + c) * (area / 3.0f);
+			cluster.normal += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += cluster.centroid;
+		meshArea += clusterArea;
+		cluster.centroid = clusterArea > 0.0f ? cluster.centroid / clusterArea : vec3(0.0f);
+		const f32 normalLength = glm::length(cluster.normal);
+		cluster.normal = normalLength > 0.0f ? cluster.normal / normalLength : vec3(0.0f);
+	}
+	meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : vec3(0.0f);
+
+	// the clusters facing away from the center occlude the others from most points of view
+	for (Cluster& cluster : clusters)
+		cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal);
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<u32> sorted;
+	sorted.reserve(indexCount);
+	for (const Cluster& cluster : clusters)
+		sorted.insert(sorted.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	memcpy(indices, sorted.data(), indexCount * sizeof(u32));
+}
+
+u32 OptimizeVertexFetch(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount)
+{
+	std::vector<u32> remap(vertexCount, UINT32_MAX);
+	std::vector<u8> reordered((size_t)vertexCount * stride);
+
+	u32 newVertexCount = 0;
+	for (u32 i = 0; i < indexCount; ++i)
+	{
+		u32& newVertex = remap[indices[i]];
+		if (newVertex == UINT32_MAX) {
+			newVertex = newVertexCount++;
+			memcpy(&reordered[(size_t)newVertex * stride], vertices + (size_t)indices[i] * stride, stride);
+		}
+		indices[i] = newVertex;
+	}
+
+	memcpy(vertices, reordered.data(), (size_t)newVertexCount * stride);
+	return newVertexCount;
+}
+
+bool OptimizeSubmesh(Submesh& submesh, MeshOptimizerStats* stats)
+{
+	if (submesh.vertices.empty() || submesh.indices.empty())
+		return false;
+
+	const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+	u32* indices = submesh.indices.data();
+	const u32 indexCount = (u32)submesh.indices.size();
+	const u32 triangleCount = indexCount / 3;
+
+	// every pass indexes per vertex arrays with the indices
+	for (u32 i = 0; i < indexCount; ++i) {
+		if (indices[i] >= submesh.vertexCount) {
+			ELOG("Index %u of a submesh is %u, past its %u vertices: the submesh is not optimized", i, indices[i], submesh.vertexCount);
+			return false;
+		}
+	}
+
+	u32 positionOffset = 0;
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+		if (attribute.location == 0) positionOffset = attribute.offset;
+
+	const u32 missesBefore = CountCacheMisses(indices, indexCount, submesh.vertexCount, MESH_OPTIMIZER_CACHE_SIZE);
+
+	std::vector<u32> clusterStarts;
+	OptimizeVertexCache(indices, indexCount, submesh.vertexCount, &clusterStarts);
+	SplitClusters(indices, indexCount, submesh.vertexCount, MESH_OPTIMIZER_OVERDRAW_THRESHOLD, clusterStarts);
+	OptimizeOverdraw(indices, indexCount, (const u8*)submesh.vertices.data() + positionOffset, layout.stride, clusterStarts);
+
+	// the vertices no triangle uses are dropped, the bounds may shrink
+	const u32 vertexCountBefore = submesh.vertexCount;
+	submesh.vertexCount = OptimizeVertexFetch((u8*)submesh.vertices.data(), layout.stride, submesh.vertexCount, indices, indexCount);
+	submesh.vertices.resize(submesh.vertexCount * layout.stride / sizeof(float));
+	if (submesh.vertexCount != vertexCountBefore)
+		ComputeSubmeshBounds(submesh);
+
+	if (stats)
+	{
+		const u32 missesAfter = CountCacheMisses(indices, indexCount, submesh.vertexCount, MESH_OPTIMIZER_CACHE_SIZE);
+		stats->triangleCount = triangleCount;
+		stats->vertexCountBefore = vertexCountBefore;
+		stats->vertexCount = submesh.vertexCount;
+		stats->acmrBefore = triangleCount ? (f32)missesBefore / triangleCount : 0.0f;
+		stats->acmrAfter = triangleCount ? (f32)missesAfter / triangleCount : 0.0f;
+		stats->atvrBefore = vertexCountBefore ? (f32)missesBefore / vertexCountBefore : 0.0f;
+		stats->atvrAfter = submesh.vertexCount ? (f32)missesAfter / submesh.vertexCount : 0.0f;
+	}
+
+	return true;
+}
+
+void OptimizeMesh(Mesh& mesh, const char* name)
+{
+	u32 triangleCount = 0, vertexCountBefore = 0, vertexCount = 0;
+	f32 missesBefore = 0.0f, missesAfter = 0.0f;
+
+	for (Submesh& submesh : mesh.submeshes)
+	{
+		MeshOptimizerStats stats;
+		if (!OptimizeSubmesh(submesh, &stats)) continue;
+
+		triangleCount += stats.triangleCount;
+		vertexCountBefore += stats.vertexCountBefore;
+		vertexCount += stats.vertexCount;
+		missesBefore += stats.acmrBefore * stats.triangleCount;
+		missesAfter += stats.acmrAfter * stats.triangleCount;
+	}
+
+	if (triangleCount == 0)
+		return;
+
+	ILOG("%s: mesh optimized, %u triangles, %u vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", name, triangleCount, vertexCount,
+		missesBefore / triangleCount, missesAfter / triangleCount, missesBefore / vertexCountBefore, missesAfter / vertexCount);
+}
@@ -0,0 +1,62 @@
+//
+// mesh_optimizer.h: Reordering of the triangles and vertices of the submeshes at import time, for
+// every source of geometry (Assimp, the OBJ parser and the procedural shapes). Three passes, in
+// this order:
+//  - vertex cache: Tipsify (Sander et al. 2007) fans around the vertices still in a simulated cache
+//  - overdraw: the clusters Tipsify ends with a dead end, split again where their ACMR with a cold
+//    cache is low enough (Sander et al.), are sorted to draw the outward facing ones first
+//  - vertex fetch: the vertices are renumbered in the order the indices first use them, so the
+//    fetches walk the vertex buffer forward, and the ones no triangle uses are dropped
+// The optimized geometry is what the model cache stores, so warm loads skip all of it.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+// Post-transform cache entries Tipsify targets and ACMR/ATVR are measured with (FIFO)
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+// ACMR the overdraw pass may cost, relative to the Tipsify order: the clusters are split as long
+// as drawing each one from a cold cache stays under it
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+struct MeshOptimizerStats
+{
+	u32 triangleCount;
+	u32 vertexCountBefore; // the unused vertices are dropped
+	u32 vertexCount;
+
+	// average cache misses per triangle (0.5 at best for a regular grid, 3 for no reuse)
+	// and per vertex (1 at best), before and after
+	f32 acmrBefore, acmrAfter;
+	f32 atvrBefore, atvrAfter;
+};
+
+// Simulates the FIFO post-transform cache over the triangles, returns the misses
+u32 CountCacheMisses(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize);
+
+void OptimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount, std::vector<u32>* clusterStarts = NULL);
+
+/**
+ * Splits the clusters (first triangle of each, ascending) after every triangle where the misses of
+ * the cluster so far, simulated from a cold cache, fall under threshold times the ACMR of the
+ * whole order. A connected mesh has few Tipsify dead ends, so this is where most clusters come from.
+ */
+void SplitClusters(const u32* indices, u32 indexCount, u32 vertexCount, f32 threshold, std::vector<u32>& clusterStarts);
+
+// Sorts the clusters (first triangle of each, ascending) by how much they face out of the mesh
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 stride, const std::vector<u32>& clusterStarts);
+
+// Renumbers the vertices in first use order, returns the vertex count left
+u32 OptimizeVertexFetch(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount);
+
+/**
+ * Runs the three passes on the CPU geometry of the submesh (vertices and indices, so before the
+ * upload), and updates its vertex count and bounds. Returns false when it has none.
+ */
+bool OptimizeSubmesh(Submesh& submesh, MeshOptimizerStats* stats = NULL);
+
+// Optimizes every submesh and logs the ACMR/ATVR of the whole mesh before and after
+void OptimizeMesh(Mesh& mesh, const char* name);
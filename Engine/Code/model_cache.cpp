@@ -0,0 +1,290 @@
+#include "model_cache.h"
+#include "geometry.h"
+#include <string.h>
+#include <stdio.h>
+
+#define MODEL_CACHE_MAGIC 0x4853454D // "MESH"
+
+#define MODEL_CACHE_DATA_ALIGNMENT 16
+
+struct ModelCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u64 sourceTimestamp;
+	u32 materialCount;
+	u32 submeshCount;
+	u32 vertexDataSize;
+	u32 indexDataSize;
+	u64 vertexDataOffset; // from the start of the file
+	u64 indexDataOffset;
+};
+
+static std::string GetModelCachePath(const char* sourcePath)
+{
+	return std::string(sourcePath) + ".meshcache";
+}
+
+static u64 AlignCacheOffset(u64 offset)
+{
+	return (offset + MODEL_CACHE_DATA_ALIGNMENT - 1) & ~(u64)(MODEL_CACHE_DATA_ALIGNMENT - 1);
+}
+
+static void WriteBytes(std::vector<u8>& out, const void* data, size_t size)
+{
+	out.insert(out.end(), (const u8*)data, (const u8*)data + size);
+}
+
+template <typename T>
+static void WriteValue(std::vector<u8>& out, const T& value)
+{
+	WriteBytes(out, &value, sizeof(T));
+}
+
+static void WriteString(std::vector<u8>& out, const std::string& string)
+{
+	WriteValue(out, (u32)string.size());
+	WriteBytes(out, string.data(), string.size());
+}
+
+// Reads the table part of the file. Any read past the end marks the whole cache as invalid.
+struct CacheReader
+{
+	const u8* cursor;
+	const u8* end;
+	bool      failed;
+};
+
+static void ReadBytes(CacheReader& reader, void* data, size_t size)
+{
+	if (reader.failed || (size_t)(reader.end - reader.cursor) < size) {
+		reader.failed = true;
+		memset(data, 0, size);
+		return;
+	}
+	memcpy(data, reader.cursor, size);
+	reader.cursor += size;
+}
+
+template <typename T>
+static T ReadValue(CacheReader& reader)
+{
+	T value;
+	ReadBytes(reader, &value, sizeof(T));
+	return value;
+}
+
+static std::string ReadString(CacheReader& reader)
+{
+	const u32 length = ReadValue<u32>(reader);
+	if (reader.failed || (size_t)(reader.end - reader.cursor) < length) {
+		reader.failed = true;
+		return std::string();
+	}
+	std::string string((const char*)reader.cursor, length);
+	reader.cursor += length;
+	return string;
+}
+
+bool WriteModelCache(const char* sourcePath, const ImportedModel& model)
+{
+	const u64 sourceTimestamp = GetFileLastWriteTimestamp(sourcePath);
+	if (sourceTimestamp == 0)
+		return false;
+
+	std::vector<u8> table;
+
+	for (const ImportedMaterial& importedMaterial : model.materials)
+	{
+		const Material& material = importedMaterial.material;
+		WriteString(table, material.name);
+		WriteValue(table, material.albedo);
+		WriteValue(table, material.emissive);
+		WriteValue(table, material.smoothness);
+		for (u32 i = 0; i < MaterialTexture_Count; ++i)
+			WriteString(table, importedMaterial.texturePaths[i]);
+	}
+
+	// the data of the submeshes one after the other, each copied to its pool on load
+	u32 vertexDataSize = 0;
+	u32 indexDataSize = 0;
+
+	for (u32 i = 0; i < model.mesh.submeshes.size(); ++i)
+	{
+		const Submesh& submesh = model.mesh.submeshes[i];
+		const u32 submeshVertexSize = (u32)(submesh.vertices.size() * sizeof(float));
+
+		WriteValue(table, model.submeshMaterialIndices[i]);
+		WriteValue(table, (u32)submesh.vertexBufferLayout.stride);
+		WriteValue(table, (u32)submesh.vertexBufferLayout.attributes.size());
+		// field by field, the struct has padding and a GLenum of no fixed size
+		for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+		{
+			WriteValue(table, attribute.location);
+			WriteValue(table, attribute.componentCount);
+			WriteValue(table, attribute.offset);
+			WriteValue(table, attribute.stride);
+			WriteValue(table, (u32)attribute.type);
+			WriteValue(table, (u8)attribute.normalized);
+		}
+		WriteValue(table, vertexDataSize);
+		WriteValue(table, submeshVertexSize);
+		WriteValue(table, indexDataSize);
+		WriteValue(table, submesh.indexCount);
+		WriteValue(table, (u32)submesh.indexType);
+		WriteValue(table, submesh.aabbMin);
+		WriteValue(table, submesh.aabbMax);
+		WriteValue(table, submesh.boundingSphereCenter);
+		WriteValue(table, submesh.boundingSphereRadius);
+
+		vertexDataSize += submeshVertexSize;
+		// padded to 4 bytes, so the offsets of the 32 bit indices after 16 bit ones stay whole indices
+		indexDataSize += (submesh.indexCount * GetIndexTypeSize(submesh.indexType) + 3) & ~3u;
+	}
+
+	ModelCacheHeader header = {};
+	header.magic = MODEL_CACHE_MAGIC;
+	header.version = MODEL_CACHE_VERSION;
+	header.sourceTimestamp = sourceTimestamp;
+	header.materialCount = (u32)model.materials.size();
+	header.submeshCount = (u32)model.mesh.submeshes.size();
+	header.vertexDataSize = vertexDataSize;
+	header.indexDataSize = indexDataSize;
+	header.vertexDataOffset = AlignCacheOffset(sizeof(header) + table.size());
+	header.indexDataOffset = AlignCacheOffset(header.vertexDataOffset + vertexDataSize);
+
+	// written aside and renamed at the end, so a crash never leaves a truncated cache behind
+	const std::string cachePath = GetModelCachePath(sourcePath);
+	const std::string temporaryPath = cachePath + ".tmp";
+
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const u8 padding[MODEL_CACHE_DATA_ALIGNMENT] = {};
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(table.data(), 1, table.size(), file);
+	fwrite(padding, 1, (size_t)(header.vertexDataOffset - sizeof(header) - table.size()), file);
+	for (const Submesh& submesh : model.mesh.submeshes)
+		fwrite(submesh.vertices.data(), sizeof(float), submesh.vertices.size(), file);
+	fwrite(padding, 1, (size_t)(header.indexDataOffset - header.vertexDataOffset - vertexDataSize), file);
+	for (const Submesh& submesh : model.mesh.submeshes)
+	{
+		const u32 indexBytes = submesh.indexCount * GetIndexTypeSize(submesh.indexType);
+		fwrite(GetSubmeshIndices(submesh), 1, indexBytes, file);
+		fwrite(padding, 1, ((indexBytes + 3) & ~3u) - indexBytes, file);
+	}
+
+	const bool written = ferror(file) == 0;
+	fclose(file);
+
+	if (!written) {
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	remove(cachePath.c_str());
+	return rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+}
+
+bool ReadModelCache(const char* sourcePath, ImportedModel& model)
+{
+	const u64 sourceTimestamp = GetFileLastWriteTimestamp(sourcePath);
+	const std::string cachePath = GetModelCachePath(sourcePath);
+
+	MappedFile file;
+	if (!MapFile(cachePath.c_str(), file))
+		return false;
+
+	ModelCacheHeader header = {};
+	if (file.size >= sizeof(header))
+		memcpy(&header, file.data, sizeof(header));
+
+	const bool valid =
+		file.size >= sizeof(header) &&
+		header.magic == MODEL_CACHE_MAGIC &&
+		header.version == MODEL_CACHE_VERSION &&
+		header.sourceTimestamp == sourceTimestamp &&
+		header.vertexDataOffset >= sizeof(header) &&
+		header.indexDataOffset >= header.vertexDataOffset + header.vertexDataSize &&
+		header.indexDataOffset + header.indexDataSize <= file.size;
+
+	if (!valid) {
+		UnmapFile(file);
+		return false;
+	}
+
+	CacheReader reader = { file.data + sizeof(header), file.data + header.vertexDataOffset, false };
+
+	model.materials.resize(header.materialCount);
+	for (ImportedMaterial& importedMaterial : model.materials)
+	{
+		Material& material = importedMaterial.material;
+		material.name = ReadString(reader);
+		material.albedo = ReadValue<vec3>(reader);
+		material.emissive = ReadValue<vec3>(reader);
+		material.smoothness = ReadValue<f32>(reader);
+		for (u32 i = 0; i < MaterialTexture_Count; ++i)
+			importedMaterial.texturePaths[i] = ReadString(reader);
+	}
+
+	model.mesh.submeshes.resize(header.submeshCount);
+	model.submeshMaterialIndices.resize(header.submeshCount);
+	for (u32 i = 0; i < header.submeshCount && !reader.failed; ++i)
+	{
+		Submesh& submesh = model.mesh.submeshes[i];
+		model.submeshMaterialIndices[i] = ReadValue<u32>(reader);
+
+		submesh.vertexBufferLayout.stride = (u8)ReadValue<u32>(reader);
+		const u32 attributeCount = ReadValue<u32>(reader);
+		for (u32 j = 0; j < attributeCount && !reader.failed; ++j)
+		{
+			VertexBufferAttribute attribute;
+			attribute.location = ReadValue<u8>(reader);
+			attribute.componentCount = ReadValue<u8>(reader);
+			attribute.offset = ReadValue<u32>(reader);
+			attribute.stride = ReadValue<u8>(reader);
+			attribute.type = (GLenum)ReadValue<u32>(reader);
+			attribute.normalized = ReadValue<u8>(reader) != 0;
+
+			const bool knownType = attribute.type == GL_FLOAT || attribute.type == GL_HALF_FLOAT || attribute.type == GL_SHORT;
+			if (!knownType || attribute.componentCount == 0 || attribute.componentCount > 4)
+				reader.failed = true;
+			submesh.vertexBufferLayout.attributes.push_back(attribute);
+		}
+
+		submesh.vertexOffset = ReadValue<u32>(reader);
+		const u32 submeshVertexSize = ReadValue<u32>(reader);
+		submesh.vertexCount = submesh.vertexBufferLayout.stride ? submeshVertexSize / submesh.vertexBufferLayout.stride : 0;
+		submesh.indexOffset = ReadValue<u32>(reader);
+		submesh.indexCount = ReadValue<u32>(reader);
+		submesh.indexType = (GLenum)ReadValue<u32>(reader);
+		submesh.aabbMin = ReadValue<vec3>(reader);
+		submesh.aabbMax = ReadValue<vec3>(reader);
+		submesh.boundingSphereCenter = ReadValue<vec3>(reader);
+		submesh.boundingSphereRadius = ReadValue<f32>(reader);
+
+		const bool inside =
+			submesh.vertexOffset + (u64)submeshVertexSize <= header.vertexDataSize &&
+			(submesh.indexType == GL_UNSIGNED_INT || submesh.indexType == GL_UNSIGNED_SHORT) &&
+			submesh.indexOffset + (u64)submesh.indexCount * GetIndexTypeSize(submesh.indexType) <= header.indexDataSize &&
+			model.submeshMaterialIndices[i] < header.materialCount;
+		if (!inside) reader.failed = true;
+	}
+
+	if (reader.failed) {
+		ELOG("The model cache %s is corrupt, the model is imported again", cachePath.c_str());
+		model.materials.clear();
+		model.mesh.submeshes.clear();
+		model.submeshMaterialIndices.clear();
+		UnmapFile(file);
+		return false;
+	}
+
+	model.mappedFile = file;
+	model.vertexData = file.data + header.vertexDataOffset;
+	model.vertexDataSize = header.vertexDataSize;
+	model.indexData = file.data + header.indexDataOffset;
+	model.indexDataSize = header.indexDataSize;
+	return true;
+}
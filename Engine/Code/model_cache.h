@@ -0,0 +1,20 @@
+//
+// model_cache.h: Binary cache of imported models. A ".meshcache" file next to each source keeps
+// the materials, the submesh table (layout, offsets, bounds) and the vertex and index data laid
+// out exactly as in the GL buffers, so a warm load maps the file and copies each submesh to its
+// geometry pool without parsing.
+// The cache is valid while its version and the last write time of the source match.
+//
+
+#pragma once
+
+#include "asset_loader.h"
+
+// Bump whenever the file layout or the imported data changes, older caches are then rebuilt
+#define MODEL_CACHE_VERSION 7
+
+// Returns false if there is no valid cache. On success the model keeps the file mapped (ImportedModel::mappedFile).
+bool ReadModelCache(const char* sourcePath, ImportedModel& model);
+
+// Expects the CPU geometry of a model just imported from the source
+bool WriteModelCache(const char* sourcePath, const ImportedModel& model);
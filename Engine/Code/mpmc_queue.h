@@ -0,0 +1,87 @@
+//
+// mpmc_queue.h: Bounded lock-free queue for several producers and consumers (D. Vyukov's design).
+// Each cell carries a sequence number that tells producers and consumers whether it is their turn,
+// so pushing and popping only contend on one atomic increment each.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+
+template <typename T, u32 Capacity>
+class MPMCQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+
+public:
+	MPMCQueue() : enqueuePosition(0), dequeuePosition(0)
+	{
+		for (u32 i = 0; i < Capacity; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Returns false if the queue is full
+	bool Push(const T& value)
+	{
+		u32 position = enqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & (Capacity - 1)];
+			const u32 sequence = cell.sequence.load(std::memory_order_acquire);
+			const i32 difference = (i32)(sequence - position);
+
+			if (difference == 0) {
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					cell.value = value;
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) {
+				return false;
+			}
+			else {
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns false if the queue is empty
+	bool Pop(T& value)
+	{
+		u32 position = dequeuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & (Capacity - 1)];
+			const u32 sequence = cell.sequence.load(std::memory_order_acquire);
+			const i32 difference = (i32)(sequence - (position + 1));
+
+			if (difference == 0) {
+				if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					value = cell.value;
+					cell.sequence.store(position + Capacity, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) {
+				return false;
+			}
+			else {
+				position = dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<u32> sequence;
+		T                value;
+	};
+
+	// the positions live in their own cache lines so producers and consumers do not share them
+	alignas(64) Cell             cells[Capacity];
+	alignas(64) std::atomic<u32> enqueuePosition;
+	alignas(64) std::atomic<u32> dequeuePosition;
+};
@@ -0,0 +1,629 @@
+#include "obj_loader.h"
+#include "job_system.h"
+#include "culling.h"
+#include <string.h>
+#include <unordered_map>
+
+enum ObjCornerFlags
+{
+	ObjCorner_HasTexCoord      = 1 << 0,
+	ObjCorner_HasNormal        = 1 << 1,
+	ObjCorner_RelativePosition = 1 << 2, // negative indices count back from the chunk, see ResolveCorners()
+	ObjCorner_RelativeTexCoord = 1 << 3,
+	ObjCorner_RelativeNormal   = 1 << 4,
+};
+
+// Zero-based attribute indices of a triangle corner
+struct ObjCorner
+{
+	i32 position;
+	i32 texCoord;
+	i32 normal;
+	u32 flags;
+};
+
+// Faces from firstCorner on use the material
+struct ObjMaterialRun
+{
+	u32         firstCorner;
+	std::string material;
+};
+
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+
+	std::vector<vec3>           positions;
+	std::vector<vec2>           texCoords;
+	std::vector<vec3>           normals;
+	std::vector<ObjCorner>      corners; // three per triangle, polygons are triangulated as fans
+	std::vector<ObjMaterialRun> materialRuns;
+	std::vector<std::string>    materialLibraries;
+
+	// attributes of the chunks before this one
+	u32 positionBase;
+	u32 texCoordBase;
+	u32 normalBase;
+
+	bool invalidIndices;
+};
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool IsLineEnd(char c)
+{
+	return c == '\n' || c == '\r';
+}
+
+static inline const char* SkipSpaces(const char* c, const char* end)
+{
+	while (c < end && (*c == ' ' || *c == '\t')) ++c;
+	return c;
+}
+
+static inline const char* SkipLine(const char* c, const char* end)
+{
+	while (c < end && *c != '\n') ++c;
+	return c < end ? c + 1 : end;
+}
+
+static inline bool StartsWithKeyword(const char* c, const char* end, const char* keyword, u32 length)
+{
+	return (u32)(end - c) > length && memcmp(c, keyword, length) == 0 && (c[length] == ' ' || c[length] == '\t');
+}
+
+// Floats after the spaces that separate them, 0 if there is none
+static const char* ParseFloat(const char* c, const char* end, f32& value)
+{
+	f64 result;
+	c = ParseDecimal(SkipSpaces(c, end), end, result);
+	value = (f32)result;
+	return c;
+}
+
+static const char* ParseInt(const char* c, const char* end, i32& value)
+{
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		++c;
+	}
+
+	i32 result = 0;
+	for (; c < end && IsDigit(*c); ++c)
+		result = result * 10 + (*c - '0');
+
+	value = negative ? -result : result;
+	return c;
+}
+
+// OBJ indices are one-based, or negative to count back from the last attribute read so far
+static inline void StoreIndex(i32 fileIndex, u32 countSoFar, u32 relativeFlag, i32& index, u32& flags, bool& invalid)
+{
+	if (fileIndex > 0) {
+		index = fileIndex - 1;
+	}
+	else if (fileIndex < 0) {
+		index = (i32)countSoFar + fileIndex; // chunk local, it can be negative until the chunk bases are added
+		flags |= relativeFlag;
+	}
+	else {
+		invalid = true;
+	}
+}
+
+// Parses "v", "v/vt", "v//vn" or "v/vt/vn". Returns NULL at the end of the face.
+static const char* ParseCorner(const char* c, const char* end, ObjChunk& chunk, ObjCorner& corner)
+{
+	c = SkipSpaces(c, end);
+	if (c >= end || IsLineEnd(*c) || *c == '#')
+		return NULL;
+
+	corner = {};
+	i32 fileIndex;
+
+	const char* start = c;
+	c = ParseInt(c, end, fileIndex);
+	if (c == start) {
+		chunk.invalidIndices = true;
+		return NULL;
+	}
+	StoreIndex(fileIndex, (u32)chunk.positions.size(), ObjCorner_RelativePosition, corner.position, corner.flags, chunk.invalidIndices);
+
+	if (c < end && *c == '/') {
+		++c;
+		if (c < end && *c != '/') {
+			c = ParseInt(c, end, fileIndex);
+			StoreIndex(fileIndex, (u32)chunk.texCoords.size(), ObjCorner_RelativeTexCoord, corner.texCoord, corner.flags, chunk.invalidIndices);
+			corner.flags |= ObjCorner_HasTexCoord;
+		}
+		if (c < end && *c == '/') {
+			++c;
+			c = ParseInt(c, end, fileIndex);
+			StoreIndex(fileIndex, (u32)chunk.normals.size(), ObjCorner_RelativeNormal, corner.normal, corner.flags, chunk.invalidIndices);
+			corner.flags |= ObjCorner_HasNormal;
+		}
+	}
+
+	// anything else glued to the corner is not understood
+	if (c < end && !IsLineEnd(*c) && *c != ' ' && *c != '\t')
+		chunk.invalidIndices = true;
+
+	return c;
+}
+
+// The rest of the line without the trailing spaces
+static std::string ParseName(const char* c, const char* end)
+{
+	c = SkipSpaces(c, end);
+	const char* nameEnd = c;
+	while (nameEnd < end && !IsLineEnd(*nameEnd)) ++nameEnd;
+	while (nameEnd > c && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')) --nameEnd;
+	return std::string(c, nameEnd);
+}
+
+static void ParseChunk(ObjChunk& chunk)
+{
+	const char* c = chunk.begin;
+	const char* end = chunk.end;
+
+	ObjCorner polygon[3];
+
+	while (c < end)
+	{
+		c = SkipSpaces(c, end);
+
+		if (StartsWithKeyword(c, end, "v", 1)) {
+			vec3 position;
+			c = ParseFloat(c + 1, end, position.x);
+			c = ParseFloat(c, end, position.y);
+			c = ParseFloat(c, end, position.z);
+			chunk.positions.push_back(position);
+		}
+		else if (StartsWithKeyword(c, end, "vt", 2)) {
+			vec2 texCoord;
+			c = ParseFloat(c + 2, end, texCoord.x);
+			c = ParseFloat(c, end, texCoord.y);
+			chunk.texCoords.push_back(texCoord);
+		}
+		else if (StartsWithKeyword(c, end, "vn", 2)) {
+			vec3 normal;
+			c = ParseFloat(c + 2, end, normal.x);
+			c = ParseFloat(c, end, normal.y);
+			c = ParseFloat(c, end, normal.z);
+			chunk.normals.push_back(normal);
+		}
+		else if (StartsWithKeyword(c, end, "f", 1)) {
+			// fan: (first, previous, current) for every corner after the second one
+			u32 cornerCount = 0;
+			ObjCorner corner;
+			const char* next = c + 1;
+			while ((next = ParseCorner(next, end, chunk, corner)) != NULL)
+			{
+				if (cornerCount < 2) {
+					polygon[cornerCount] = corner;
+				}
+				else {
+					polygon[2] = corner;
+					chunk.corners.insert(chunk.corners.end(), polygon, polygon + 3);
+					polygon[1] = corner;
+				}
+				cornerCount++;
+			}
+		}
+		else if (StartsWithKeyword(c, end, "usemtl", 6)) {
+			chunk.materialRuns.push_back(ObjMaterialRun{ (u32)chunk.corners.size(), ParseName(c + 6, end) });
+		}
+		else if (StartsWithKeyword(c, end, "mtllib", 6)) {
+			chunk.materialLibraries.push_back(ParseName(c + 6, end));
+		}
+
+		// comments, groups, objects, smoothing groups, lines and points are skipped
+		c = SkipLine(c, end);
+	}
+}
+
+static void ResolveCorners(ObjChunk& chunk, u32 positionCount, u32 texCoordCount, u32 normalCount)
+{
+	for (ObjCorner& corner : chunk.corners)
+	{
+		if (corner.flags & ObjCorner_RelativePosition) corner.position += (i32)chunk.positionBase;
+		if (corner.flags & ObjCorner_RelativeTexCoord) corner.texCoord += (i32)chunk.texCoordBase;
+		if (corner.flags & ObjCorner_RelativeNormal)   corner.normal += (i32)chunk.normalBase;
+
+		const bool valid =
+			corner.position >= 0 && (u32)corner.position < positionCount &&
+			(!(corner.flags & ObjCorner_HasTexCoord) || (corner.texCoord >= 0 && (u32)corner.texCoord < texCoordCount)) &&
+			(!(corner.flags & ObjCorner_HasNormal) || (corner.normal >= 0 && (u32)corner.normal < normalCount));
+		if (!valid) chunk.invalidIndices = true;
+	}
+}
+
+static u32 FindOrAddMaterial(std::vector<ImportedMaterial>& materials, std::unordered_map<std::string, u32>& materialIndices, const std::string& name)
+{
+	auto it = materialIndices.find(name);
+	if (it != materialIndices.end())
+		return it->second;
+
+	ImportedMaterial material = {};
+	material.material.name = name;
+	material.material.albedo = vec3(0.6f);
+	materials.push_back(material);
+
+	const u32 index = (u32)materials.size() - 1u;
+	materialIndices[name] = index;
+	return index;
+}
+
+static void ParseMtl(const std::string& filepath, const std::string& directory, std::vector<ImportedMaterial>& materials, std::unordered_map<std::string, u32>& materialIndices)
+{
+	MappedFile file;
+	if (!MapFile(filepath.c_str(), file)) {
+		ELOG("Could not open the material library %s", filepath.c_str());
+		return;
+	}
+
+	struct TextureKeyword { const char* keyword; u32 length; MaterialTexture texture; };
+	static const TextureKeyword textureKeywords[] = {
+		{ "map_Kd", 6, MaterialTexture_Albedo },
+		{ "map_Ke", 6, MaterialTexture_Emissive },
+		{ "map_Ks", 6, MaterialTexture_Specular },
+		{ "norm", 4, MaterialTexture_Normals },
+		{ "map_Kn", 6, MaterialTexture_Normals },
+		{ "map_Bump", 8, MaterialTexture_Bump },
+		{ "map_bump", 8, MaterialTexture_Bump },
+		{ "bump", 4, MaterialTexture_Bump },
+	};
+
+	const char* c = (const char*)file.data;
+	const char* end = c + file.size;
+	ImportedMaterial* material = NULL;
+
+	while (c < end)
+	{
+		c = SkipSpaces(c, end);
+
+		if (StartsWithKeyword(c, end, "newmtl", 6)) {
+			material = &materials[FindOrAddMaterial(materials, materialIndices, ParseName(c + 6, end))];
+		}
+		else if (material && (StartsWithKeyword(c, end, "Kd", 2) || StartsWithKeyword(c, end, "Ke", 2))) {
+			vec3& color = c[1] == 'd' ? material->material.albedo : material->material.emissive;
+			c = ParseFloat(c + 2, end, color.r);
+			c = ParseFloat(c, end, color.g);
+			c = ParseFloat(c, end, color.b);
+		}
+		else if (material && StartsWithKeyword(c, end, "Ns", 2)) {
+			f32 shininess;
+			c = ParseFloat(c + 2, end, shininess);
+			material->material.smoothness = shininess / 256.0f;
+		}
+		else if (material) {
+			for (const TextureKeyword& textureKeyword : textureKeywords) {
+				if (!StartsWithKeyword(c, end, textureKeyword.keyword, textureKeyword.length)) continue;
+
+				// the file name is the last word, after options like "-bm 1.0"
+				std::string arguments = ParseName(c + textureKeyword.length, end);
+				const size_t separator = arguments.find_last_of(" \t");
+				const std::string filename = separator != std::string::npos ? arguments.substr(separator + 1) : arguments;
+				material->texturePaths[textureKeyword.texture] = directory + "/" + filename;
+				break;
+			}
+		}
+
+		c = SkipLine(c, end);
+	}
+
+	UnmapFile(file);
+}
+
+// Unique (position, texCoord, normal) of a submesh. Missing components are UINT32_MAX.
+struct ObjVertexKey
+{
+	u32 position;
+	u32 texCoord;
+	u32 normal;
+};
+
+struct ObjSubmeshBuild
+{
+	u32                          materialIndex;
+	std::vector<const ObjCorner*> corners;
+	std::vector<ObjVertexKey>     vertices;
+	std::vector<u32>              indices;
+	bool                          hasTexCoords;
+};
+
+// Open addressing table of vertex indices, sized for all the corners so it never grows
+static void DeduplicateVertices(ObjSubmeshBuild& build)
+{
+	u32 capacity = 16;
+	while (capacity < build.corners.size() * 2) capacity *= 2;
+	std::vector<u32> table(capacity, UINT32_MAX);
+
+	build.indices.resize(build.corners.size());
+	build.vertices.reserve(build.corners.size() / 2);
+
+	for (u32 i = 0; i < build.corners.size(); ++i)
+	{
+		const ObjCorner& corner = *build.corners[i];
+		ObjVertexKey key;
+		key.position = (u32)corner.position;
+		key.texCoord = corner.flags & ObjCorner_HasTexCoord ? (u32)corner.texCoord : UINT32_MAX;
+		key.normal = corner.flags & ObjCorner_HasNormal ? (u32)corner.normal : UINT32_MAX;
+		build.hasTexCoords |= key.texCoord != UINT32_MAX;
+
+		u32 hash = key.position * 73856093u ^ key.texCoord * 19349663u ^ key.normal * 83492791u;
+		hash ^= hash >> 16;
+
+		for (u32 slot = hash & (capacity - 1);; slot = (slot + 1) & (capacity - 1))
+		{
+			const u32 vertexIndex = table[slot];
+			if (vertexIndex == UINT32_MAX) {
+				table[slot] = (u32)build.vertices.size();
+				build.indices[i] = (u32)build.vertices.size();
+				build.vertices.push_back(key);
+				break;
+			}
+
+			const ObjVertexKey& other = build.vertices[vertexIndex];
+			if (other.position == key.position && other.texCoord == key.texCoord && other.normal == key.normal) {
+				build.indices[i] = vertexIndex;
+				break;
+			}
+		}
+	}
+}
+
+static vec3 AnyPerpendicular(const vec3& normal)
+{
+	return glm::normalize(fabsf(normal.x) < 0.9f ? glm::cross(normal, vec3(1, 0, 0)) : glm::cross(normal, vec3(0, 1, 0)));
+}
+
+// Interleaves the vertices with the layout of ProcessAssimpMesh()
+static void BuildSubmesh(ObjSubmeshBuild& build, const std::vector<vec3>& positions, const std::vector<vec2>& texCoords,
+	const std::vector<vec3>& normals, const std::vector<vec3>& generatedNormals, Submesh& submesh)
+{
+	const u32 vertexCount = (u32)build.vertices.size();
+
+	std::vector<vec3> vertexNormals(vertexCount);
+	for (u32 i = 0; i < vertexCount; ++i) {
+		const ObjVertexKey& key = build.vertices[i];
+		vertexNormals[i] = key.normal != UINT32_MAX ? normals[key.normal] : generatedNormals[key.position];
+	}
+
+	std::vector<vec3> tangents;
+	std::vector<vec3> bitangents;
+	if (build.hasTexCoords)
+	{
+		tangents.assign(vertexCount, vec3(0.0f));
+		bitangents.assign(vertexCount, vec3(0.0f));
+
+		for (u32 i = 0; i + 2 < build.indices.size(); i += 3)
+		{
+			const u32 v[3] = { build.indices[i], build.indices[i + 1], build.indices[i + 2] };
+			vec2 uv[3];
+			for (u32 j = 0; j < 3; ++j)
+				uv[j] = build.vertices[v[j]].texCoord != UINT32_MAX ? texCoords[build.vertices[v[j]].texCoord] : vec2(0.0f);
+
+			const vec3 edge1 = positions[build.vertices[v[1]].position] - positions[build.vertices[v[0]].position];
+			const vec3 edge2 = positions[build.vertices[v[2]].position] - positions[build.vertices[v[0]].position];
+			const vec2 deltaUV1 = uv[1] - uv[0];
+			const vec2 deltaUV2 = uv[2] - uv[0];
+
+			const f32 determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+			if (fabsf(determinant) < 1e-12f) continue;
+
+			const f32 r = 1.0f / determinant;
+			const vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * r;
+			const vec3 bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * r;
+			for (u32 j = 0; j < 3; ++j) {
+				tangents[v[j]] += tangent;
+				bitangents[v[j]] += bitangent;
+			}
+		}
+
+		// Gram-Schmidt against the normal; tangent along +u and bitangent along +v
+		for (u32 i = 0; i < vertexCount; ++i) {
+			const vec3& normal = vertexNormals[i];
+			vec3 tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+			tangent = glm::dot(tangent, tangent) > 1e-20f ? glm::normalize(tangent) : AnyPerpendicular(normal);
+
+			vec3 bitangent = glm::cross(normal, tangent);
+			if (glm::dot(bitangent, bitangents[i]) < 0.0f) bitangent = -bitangent;
+
+			tangents[i] = tangent;
+			bitangents[i] = bitangent;
+		}
+	}
+
+	VertexBufferLayout& layout = submesh.vertexBufferLayout;
+	layout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+	layout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+	layout.stride = 6 * sizeof(float);
+	if (build.hasTexCoords)
+	{
+		layout.attributes.push_back(VertexBufferAttribute{ 2, 2, layout.stride });
+		layout.stride += 2 * sizeof(float);
+		layout.attributes.push_back(VertexBufferAttribute{ 3, 3, layout.stride });
+		layout.stride += 3 * sizeof(float);
+		layout.attributes.push_back(VertexBufferAttribute{ 4, 3, layout.stride });
+		layout.stride += 3 * sizeof(float);
+	}
+
+	const u32 floatsPerVertex = layout.stride / sizeof(float);
+	submesh.vertices.resize((size_t)vertexCount * floatsPerVertex);
+	float* out = submesh.vertices.data();
+
+	for (u32 i = 0; i < vertexCount; ++i)
+	{
+		const ObjVertexKey& key = build.vertices[i];
+		const vec3& position = positions[key.position];
+		const vec3& normal = vertexNormals[i];
+		*out++ = position.x; *out++ = position.y; *out++ = position.z;
+		*out++ = normal.x;   *out++ = normal.y;   *out++ = normal.z;
+
+		if (build.hasTexCoords) {
+			const vec2 texCoord = key.texCoord != UINT32_MAX ? texCoords[key.texCoord] : vec2(0.0f);
+			*out++ = texCoord.x;       *out++ = texCoord.y;
+			*out++ = tangents[i].x;    *out++ = tangents[i].y;    *out++ = tangents[i].z;
+			*out++ = bitangents[i].x;  *out++ = bitangents[i].y;  *out++ = bitangents[i].z;
+		}
+	}
+
+	submesh.indices.swap(build.indices);
+	submesh.vertexCount = vertexCount;
+	submesh.indexCount = (u32)submesh.indices.size();
+	submesh.indexType = GL_UNSIGNED_INT;
+	ComputeSubmeshBounds(submesh);
+}
+
+bool ImportObj(const char* filename, ImportedModel& model)
+{
+	MappedFile file;
+	if (!MapFile(filename, file)) {
+		ELOG("Error loading mesh %s: could not open the file", filename);
+		return false;
+	}
+
+	// split at line ends close to every OBJ_PARSE_CHUNK_SIZE bytes
+	const char* text = (const char*)file.data;
+	const char* textEnd = text + file.size;
+
+	std::vector<ObjChunk> chunks;
+	for (const char* begin = text; begin < textEnd;)
+	{
+		const char* end = (u64)(textEnd - begin) > OBJ_PARSE_CHUNK_SIZE ? SkipLine(begin + OBJ_PARSE_CHUNK_SIZE, textEnd) : textEnd;
+		chunks.push_back(ObjChunk{});
+		chunks.back().begin = begin;
+		chunks.back().end = end;
+		begin = end;
+	}
+
+	ParallelFor((u32)chunks.size(), 1, [&chunks](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) ParseChunk(chunks[i]);
+	});
+
+	UnmapFile(file);
+
+	// concatenate the attributes and make every index absolute
+	u32 positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+	for (ObjChunk& chunk : chunks) {
+		chunk.positionBase = positionCount;
+		chunk.texCoordBase = texCoordCount;
+		chunk.normalBase = normalCount;
+		positionCount += (u32)chunk.positions.size();
+		texCoordCount += (u32)chunk.texCoords.size();
+		normalCount += (u32)chunk.normals.size();
+		cornerCount += (u32)chunk.corners.size();
+	}
+
+	std::vector<vec3> positions;
+	std::vector<vec2> texCoords;
+	std::vector<vec3> normals;
+	positions.reserve(positionCount);
+	texCoords.reserve(texCoordCount);
+	normals.reserve(normalCount);
+	for (ObjChunk& chunk : chunks) {
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		std::vector<vec3>().swap(chunk.positions);
+		std::vector<vec2>().swap(chunk.texCoords);
+		std::vector<vec3>().swap(chunk.normals);
+	}
+
+	ParallelFor((u32)chunks.size(), 1, [&](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) ResolveCorners(chunks[i], positionCount, texCoordCount, normalCount);
+	});
+
+	for (const ObjChunk& chunk : chunks) {
+		if (chunk.invalidIndices) {
+			ELOG("Error loading mesh %s: a face refers to a vertex attribute that does not exist", filename);
+			return false;
+		}
+	}
+
+	if (cornerCount == 0) {
+		ELOG("Error loading mesh %s: the file has no faces", filename);
+		return false;
+	}
+
+	// materials
+	std::string directory = filename;
+	const size_t separator = directory.find_last_of("/\\");
+	directory = separator != std::string::npos ? directory.substr(0, separator) : std::string(".");
+
+	std::unordered_map<std::string, u32> materialIndices;
+	for (const ObjChunk& chunk : chunks)
+		for (const std::string& library : chunk.materialLibraries)
+			ParseMtl(directory + "/" + library, directory, model.materials, materialIndices);
+
+	// group the triangles by material, one submesh each
+	std::vector<ObjSubmeshBuild> builds;
+	std::vector<u32> materialBuild;
+	u32 currentMaterial = UINT32_MAX;
+	bool needsGeneratedNormals = false;
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		u32 run = 0;
+		for (u32 i = 0; i < chunk.corners.size(); ++i)
+		{
+			for (; run < chunk.materialRuns.size() && chunk.materialRuns[run].firstCorner == i; ++run)
+				currentMaterial = FindOrAddMaterial(model.materials, materialIndices, chunk.materialRuns[run].material);
+
+			if (currentMaterial == UINT32_MAX)
+				currentMaterial = FindOrAddMaterial(model.materials, materialIndices, "DefaultMaterial");
+
+			if (materialBuild.size() <= currentMaterial)
+				materialBuild.resize(currentMaterial + 1, UINT32_MAX);
+			if (materialBuild[currentMaterial] == UINT32_MAX) {
+				materialBuild[currentMaterial] = (u32)builds.size();
+				builds.push_back(ObjSubmeshBuild{});
+				builds.back().materialIndex = currentMaterial;
+			}
+
+			builds[materialBuild[currentMaterial]].corners.push_back(&chunk.corners[i]);
+			needsGeneratedNormals |= !(chunk.corners[i].flags & ObjCorner_HasNormal);
+		}
+
+		// runs after the last face of the chunk still apply to the next one
+		for (; run < chunk.materialRuns.size(); ++run)
+			currentMaterial = FindOrAddMaterial(model.materials, materialIndices, chunk.materialRuns[run].material);
+	}
+
+	// smooth normals shared by every corner of a position, weighted by the triangle areas
+	std::vector<vec3> generatedNormals;
+	if (needsGeneratedNormals)
+	{
+		generatedNormals.assign(positionCount, vec3(0.0f));
+		for (const ObjChunk& chunk : chunks) {
+			for (u32 i = 0; i + 2 < chunk.corners.size(); i += 3) {
+				const ObjCorner* corners = &chunk.corners[i];
+				const vec3& p0 = positions[corners[0].position];
+				const vec3 faceNormal = glm::cross(positions[corners[1].position] - p0, positions[corners[2].position] - p0);
+				for (u32 j = 0; j < 3; ++j)
+					generatedNormals[corners[j].position] += faceNormal;
+			}
+		}
+		for (vec3& normal : generatedNormals)
+			normal = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	model.mesh.submeshes.resize(builds.size());
+	ParallelFor((u32)builds.size(), 1, [&](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			DeduplicateVertices(builds[i]);
+			BuildSubmesh(builds[i], positions, texCoords, normals, generatedNormals, model.mesh.submeshes[i]);
+		}
+	});
+
+	for (const ObjSubmeshBuild& build : builds)
+		model.submeshMaterialIndices.push_back(build.materialIndex);
+
+	return true;
+}
@@ -0,0 +1,16 @@
+//
+// obj_loader.h: Native Wavefront OBJ/MTL importer. The file is memory mapped and split into chunks
+// of whole lines that the job system parses in parallel, then the corners of each material are
+// turned into indexed vertices in parallel too. It fills the same ImportedModel as the Assimp
+// import, with the same vertex layout (positions, normals, and texture coordinates, tangents
+// and bitangents when the mesh has texture coordinates).
+//
+
+#pragma once
+
+#include "asset_loader.h"
+
+// Bytes of OBJ text parsed by each job
+#define OBJ_PARSE_CHUNK_SIZE KB(512)
+
+bool ImportObj(const char* filename, ImportedModel& model);
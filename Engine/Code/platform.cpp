@@ -12,10 +12,16 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
 #include "engine.h"
+#include "benchmark.h"
+#include "gl_state.h"
+#include "job_system.h"
+#include "asset_loader.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
@@ -115,8 +121,42 @@ void OnGlfwCloseWindow(GLFWwindow* window)
 	app->isRunning = false;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	Benchmark benchmark = {};
+	if (!ParseBenchmarkArguments(benchmark, argc, argv))
+	{
+		ELOG("Usage: Engine [--benchmark camera_path.txt] [--frames N] [--warmup N] [--report file.json|file.csv] [--size WxH]\n");
+		return -1;
+	}
+
+	if (benchmark.sceneBenchmark)
+	{
+		RunSceneUpdateBenchmark();
+		return 0;
+	}
+
+	if (!benchmark.objBenchmarkFile.empty())
+	{
+		InitJobSystem(0);
+		RunObjLoaderBenchmark(benchmark.objBenchmarkFile.c_str());
+		ShutdownJobSystem();
+		return 0;
+	}
+
+	if (benchmark.occlusionBenchmark)
+	{
+		InitJobSystem(0);
+		RunSoftwareOcclusionBenchmark();
+		ShutdownJobSystem();
+		return 0;
+	}
+
+	if (benchmark.enabled && !LoadCameraPath(benchmark, benchmark.cameraPathFile.c_str()))
+	{
+		return -1;
+	}
+
 	glfwSetErrorCallback(OnGlfwError);
 
 	if (!glfwInit())
@@ -130,7 +170,18 @@ int main()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+	ivec2 windowSize = ivec2(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+	// The benchmark renders to a hidden window, so it also runs on machines without a
+	// display attached (e.g. Mesa llvmpipe under a virtual framebuffer)
+	if (benchmark.enabled)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		if (benchmark.windowSize.x > 0 && benchmark.windowSize.y > 0)
+			windowSize = benchmark.windowSize;
+	}
+
+	GLFWwindow* window = glfwCreateWindow(windowSize.x, windowSize.y, WINDOW_TITLE, NULL, NULL);
 	if (!window)
 	{
 		ELOG("glfwCreateWindow() failed\n");
@@ -154,6 +205,8 @@ int main()
 		return -1;
 	}
 
+	LoadBufferStorageExtension((GLADloadproc)glfwGetProcAddress);
+
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 
@@ -161,7 +214,8 @@ int main()
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
 	//io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
 	io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-	io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;         // Enable Multi-Viewport / Platform Windows
+	if (!benchmark.enabled)
+		io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;     // Enable Multi-Viewport / Platform Windows
 	//io.ConfigViewportsNoAutoMerge = true;
 	//io.ConfigViewportsNoTaskBarIcon = true;
 
@@ -193,26 +247,52 @@ int main()
 
 	GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
 
+	InitJobSystem(0);
+
 	App app = {};
 	app.deltaTime = 1.0f / 60.0f;
-	app.displaySize = ivec2(WINDOW_WIDTH, WINDOW_HEIGHT);
+	app.displaySize = windowSize;
 	app.isRunning = true;
 
 	glfwSetWindowUserPointer(window, &app);
 
 	Init(&app);
 
+	if (benchmark.enabled)
+	{
+		// frames are recorded with the whole scene loaded
+		WaitForAssetLoads(&app);
+
+		InitBenchmark(benchmark);
+		app.deltaTime = benchmark.frameDeltaTime;
+		ILOG("Benchmark: replaying %s for %u frames (%u warmup frames) at %dx%d",
+			benchmark.cameraPathFile.c_str(), benchmark.frameCount, benchmark.warmupFrames, app.displaySize.x, app.displaySize.y);
+	}
+
 	while (app.isRunning)
 	{
+		f64 frameStartTime = glfwGetTime();
+
 		// Tell GLFW to call platform callbacks
 		glfwPollEvents();
 
-		// ImGui
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
-		Gui(&app);
-		ImGui::Render();
+		// ImGui (the benchmark measures the engine alone, so it skips the editor UI)
+		if (!benchmark.enabled)
+		{
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+			Gui(&app);
+			ImGui::Render();
+		}
+		else
+		{
+			// Replay the camera path with a fixed timestep so runs are comparable
+			vec3 cameraPosition, cameraRotation;
+			SampleCameraPath(benchmark, benchmark.frameIndex * benchmark.frameDeltaTime, cameraPosition, cameraRotation);
+			app.scene.camera.transform.setPosition(cameraPosition);
+			app.scene.camera.transform.setRotation(cameraRotation);
+		}
 
 		// Clear input state if required by ImGui
 		if (ImGui::GetIO().WantCaptureKeyboard)
@@ -224,7 +304,9 @@ int main()
 				app.input.mouseButtons[i] = BUTTON_IDLE;
 
 		// Update
+		f64 updateStartTime = glfwGetTime();
 		Update(&app);
+		f64 updateEndTime = glfwGetTime();
 
 		// Transition input key/button states
 		if (!ImGui::GetIO().WantCaptureKeyboard)
@@ -240,15 +322,25 @@ int main()
 		app.input.mouseDelta = glm::vec2(0.0f, 0.0f);
 
 		// Render
+		if (benchmark.enabled) BeginGpuTimer(benchmark);
+		f64 renderStartTime = glfwGetTime();
 		Render(&app);
+		f64 renderEndTime = glfwGetTime();
+		if (benchmark.enabled) EndGpuTimer(benchmark);
 
 		// ImGui Render
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-			GLFWwindow* backup_current_context = glfwGetCurrentContext();
-			ImGui::UpdatePlatformWindows();
-			ImGui::RenderPlatformWindowsDefault();
-			glfwMakeContextCurrent(backup_current_context);
+		if (!benchmark.enabled)
+		{
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+				GLFWwindow* backup_current_context = glfwGetCurrentContext();
+				ImGui::UpdatePlatformWindows();
+				ImGui::RenderPlatformWindowsDefault();
+				glfwMakeContextCurrent(backup_current_context);
+			}
+
+			// ImGui sets its own program, VAO, textures and blend state
+			InvalidateGLState();
 		}
 
 		// Present image on screen
@@ -256,13 +348,38 @@ int main()
 
 		// Frame time
 		f64 currentFrameTime = glfwGetTime();
-		app.deltaTime = (f32)(currentFrameTime - lastFrameTime);
+		if (benchmark.enabled)
+		{
+			FrameTiming timing = {};
+			timing.frameMs     = (f32)((currentFrameTime - frameStartTime) * 1000.0);
+			timing.cpuUpdateMs = (f32)((updateEndTime - updateStartTime) * 1000.0);
+			timing.cpuRenderMs = (f32)((renderEndTime - renderStartTime) * 1000.0);
+			RecordBenchmarkFrame(benchmark, timing);
+
+			if (IsBenchmarkFinished(benchmark))
+				app.isRunning = false;
+		}
+		else
+		{
+			app.deltaTime = (f32)(currentFrameTime - lastFrameTime);
+		}
 		lastFrameTime = currentFrameTime;
 
 		// Reset frame allocator
 		GlobalFrameArenaHead = 0;
 	}
 
+	int exitCode = 0;
+	if (benchmark.enabled)
+	{
+		if (!WriteBenchmarkReport(benchmark, (const char*)app.glRenderer))
+			exitCode = -1;
+		ShutdownBenchmark(benchmark);
+	}
+
+	ShutdownAssetLoader();
+	ShutdownJobSystem();
+
 	free(GlobalFrameArenaMemory);
 
 	ImGui_ImplOpenGL3_Shutdown();
@@ -272,7 +389,7 @@ int main()
 
 	glfwTerminate();
 
-	return 0;
+	return exitCode;
 }
 
 u32 Strlen(const char* string)
@@ -350,6 +467,81 @@ String GetDirectoryPart(String path)
 	return str;
 }
 
+// Without going through the locale like strtod(), which reads "1,5" in some of them
+const char* ParseDecimal(const char* c, const char* end, f64& value)
+{
+	static const f64 PowersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* start = c;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		++c;
+	}
+
+	// at most 19 significant digits fit in the mantissa, the rest only move the exponent
+	u64 mantissa = 0;
+	u32 significantDigits = 0;
+	i32 exponent = 0;
+	u32 digits = 0;
+
+	for (; c < end && *c >= '0' && *c <= '9'; ++c, ++digits) {
+		if (significantDigits < 19) {
+			mantissa = mantissa * 10 + (u64)(*c - '0');
+			if (mantissa != 0) significantDigits++;
+		}
+		else {
+			exponent++;
+		}
+	}
+
+	if (c < end && *c == '.') {
+		for (++c; c < end && *c >= '0' && *c <= '9'; ++c, ++digits) {
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + (u64)(*c - '0');
+				if (mantissa != 0) significantDigits++;
+				exponent--;
+			}
+		}
+	}
+
+	if (digits == 0) {
+		value = 0.0;
+		return start;
+	}
+
+	// an 'e' without digits is not part of the number
+	const char* exponentStart = c;
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		++c;
+		bool negativeExponent = false;
+		if (c < end && (*c == '-' || *c == '+')) {
+			negativeExponent = *c == '-';
+			++c;
+		}
+		const char* exponentDigits = c;
+		i32 explicitExponent = 0;
+		for (; c < end && *c >= '0' && *c <= '9'; ++c)
+			if (explicitExponent < 1000) explicitExponent = explicitExponent * 10 + (*c - '0');
+		if (c == exponentDigits)
+			c = exponentStart;
+		else
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	f64 result = (f64)mantissa;
+	while (exponent > 22)  { result *= 1e22; exponent -= 22; }
+	while (exponent < -22) { result /= 1e22; exponent += 22; }
+	result = exponent >= 0 ? result * PowersOf10[exponent] : result / PowersOf10[-exponent];
+
+	value = negative ? -result : result;
+	return c;
+}
+
+
 String ReadTextFile(const char* filepath)
 {
 	String fileText = {};
@@ -400,6 +592,71 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
 	return 0;
 }
 
+bool MapFile(const char* filepath, MappedFile& file)
+{
+	file = {};
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!data) {
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file.data = (const u8*)data;
+	file.size = (u64)size.QuadPart;
+	file.handle = handle;
+	file.mapping = mapping;
+#else
+	int descriptor = open(filepath, O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	struct stat attrib;
+	if (fstat(descriptor, &attrib) != 0 || attrib.st_size == 0) {
+		close(descriptor);
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)attrib.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor); // the mapping keeps the file alive
+	if (data == MAP_FAILED)
+		return false;
+
+	file.data = (const u8*)data;
+	file.size = (u64)attrib.st_size;
+#endif
+
+	return true;
+}
+
+void UnmapFile(MappedFile& file)
+{
+	if (!file.data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(file.data);
+	CloseHandle((HANDLE)file.mapping);
+	CloseHandle((HANDLE)file.handle);
+#else
+	munmap((void*)file.data, (size_t)file.size);
+#endif
+
+	file = {};
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
@@ -69,6 +69,12 @@ String MakePath(String dir, String filename);
 
 String GetDirectoryPart(String path);
 
+/**
+ * Parses a decimal number as written by exporters ([-]digits[.digits][e[-]digits]) starting at c,
+ * the same in every locale. Returns the first character after it, c itself if there is no number.
+ */
+const char* ParseDecimal(const char* c, const char* end, f64& value);
+
 /**
  * Reads a whole file and returns a string with its contents. The returned string
  * is temporary and should be copied if it needs to persist for several frames.
@@ -81,6 +87,23 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+struct MappedFile
+{
+	const u8* data;
+	u64       size;
+	void*     handle; // OS objects kept until UnmapFile()
+	void*     mapping;
+};
+
+/**
+ * Maps a whole file read-only into memory. Pages are read from disk on first access, so it
+ * is cheaper than reading the file when only some parts are needed. Returns false on failure.
+ */
+bool MapFile(const char* filepath, MappedFile& file);
+
+// Does nothing on a file that is not mapped
+void UnmapFile(MappedFile& file);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -0,0 +1,235 @@
+#include "render_queue.h"
+#include "gl_state.h"
+#include <string.h>
+#include <algorithm>
+
+#define KEY_MASK(bits) ((1ull << (bits)) - 1)
+
+u64 MakeDrawKey(u32 programIdx, GLuint vao, u32 materialIdx, f32 depth)
+{
+	const u64 depthBucket = (u64)(glm::clamp(depth, 0.0f, 1.0f) * KEY_MASK(DRAW_KEY_DEPTH_BITS));
+
+	u64 key = (u64)programIdx & KEY_MASK(DRAW_KEY_PROGRAM_BITS);
+	key = key << DRAW_KEY_VAO_BITS      | ((u64)vao & KEY_MASK(DRAW_KEY_VAO_BITS));
+	key = key << DRAW_KEY_MATERIAL_BITS | ((u64)materialIdx & KEY_MASK(DRAW_KEY_MATERIAL_BITS));
+	key = key << DRAW_KEY_DEPTH_BITS    | depthBucket;
+	return key;
+}
+
+void ClearRenderQueue(RenderQueue& queue)
+{
+	queue.items.clear();
+	queue.order.clear();
+}
+
+void PushDrawItem(RenderQueue& queue, const DrawItem& item)
+{
+	queue.items.push_back(item);
+}
+
+void SortRenderQueue(RenderQueue& queue, bool sort)
+{
+	const u32 count = (u32)queue.items.size();
+
+	queue.order.resize(count);
+	for (u32 i = 0; i < count; ++i)
+		queue.order[i] = i;
+
+	if (!sort || count < 2)
+		return;
+
+	queue.keys.resize(count);
+	queue.keysScratch.resize(count);
+	queue.orderScratch.resize(count);
+	for (u32 i = 0; i < count; ++i)
+		queue.keys[i] = queue.items[i].key;
+
+	// LSD radix sort, one byte per pass. It is stable, so equal keys keep the push order.
+	u64* keysIn = queue.keys.data();
+	u64* keysOut = queue.keysScratch.data();
+	u32* orderIn = queue.order.data();
+	u32* orderOut = queue.orderScratch.data();
+
+	for (u32 shift = 0; shift < 64; shift += 8)
+	{
+		u32 histogram[256];
+		memset(histogram, 0, sizeof(histogram));
+		for (u32 i = 0; i < count; ++i)
+			histogram[(keysIn[i] >> shift) & 0xff]++;
+
+		// every key has the same byte: this pass would not move anything
+		if (histogram[(keysIn[0] >> shift) & 0xff] == count)
+			continue;
+
+		u32 offset = 0;
+		for (u32 b = 0; b < 256; ++b) {
+			u32 bucketCount = histogram[b];
+			histogram[b] = offset;
+			offset += bucketCount;
+		}
+
+		for (u32 i = 0; i < count; ++i) {
+			u32 dst = histogram[(keysIn[i] >> shift) & 0xff]++;
+			keysOut[dst] = keysIn[i];
+			orderOut[dst] = orderIn[i];
+		}
+
+		std::swap(keysIn, keysOut);
+		std::swap(orderIn, orderOut);
+	}
+
+	if (orderIn != queue.order.data())
+		memcpy(queue.order.data(), orderIn, count * sizeof(u32));
+}
+
+void SubmitRenderQueue(RenderQueue& queue, const UniformArena& arena, u32 instancesBinding)
+{
+	RenderQueueStats& stats = queue.stats;
+	stats = {};
+
+	GLuint currentProgram = 0;
+	GLuint currentVAO = 0;
+	GLuint currentTexture = 0;
+	const UniformBlock* currentInstances = NULL;
+
+	for (u32 index : queue.order)
+	{
+		const DrawItem& item = queue.items[index];
+
+		if (item.program != currentProgram) {
+			UseProgram(item.program);
+			currentProgram = item.program;
+			stats.programChanges++;
+		}
+
+		if (item.vao != currentVAO) {
+			BindVertexArray(item.vao);
+			currentVAO = item.vao;
+			stats.vaoChanges++;
+		}
+
+		if (item.texture != currentTexture) {
+			BindTexture2D(0, item.texture);
+			currentTexture = item.texture;
+			stats.textureChanges++;
+		}
+
+		if (!currentInstances || currentInstances->page != item.instances.page || currentInstances->offset != item.instances.offset) {
+			BindStorageBlock(arena, item.instances, instancesBinding);
+			currentInstances = &item.instances;
+			stats.instanceBufferChanges++;
+		}
+
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, (void*)(u64)item.indexOffset, item.instanceCount, item.baseVertex);
+
+		stats.drawCount++;
+		stats.instanceCount += item.instanceCount;
+	}
+}
+
+static void ReserveIndirectCommands(Buffer& buffer, u32 commandCount)
+{
+	const u32 size = commandCount * sizeof(DrawElementsIndirectCommand);
+	if (buffer.handle && size <= buffer.regionSize)
+		return;
+
+	u32 regionSize = buffer.regionSize ? buffer.regionSize : INDIRECT_COMMANDS_REGION_SIZE;
+	while (regionSize < size)
+		regionSize *= 2;
+
+	// the GL keeps the old buffer alive until the draws still reading it are done
+	if (buffer.handle)
+	{
+		for (GLsync fence : buffer.fences)
+			if (fence) glDeleteSync(fence);
+		glDeleteBuffers(1, &buffer.handle);
+	}
+
+	buffer = CreateRingBuffer(regionSize, GL_DRAW_INDIRECT_BUFFER, sizeof(u32));
+}
+
+static bool SharesIndirectRun(const DrawItem& a, const DrawItem& b)
+{
+	return a.program == b.program && a.vao == b.vao && a.texture == b.texture &&
+		a.indexType == b.indexType && a.instances.page == b.instances.page;
+}
+
+void SubmitRenderQueueIndirect(RenderQueue& queue, const UniformArena& arena, u32 instancesBinding, u32 instanceSize)
+{
+	RenderQueueStats& stats = queue.stats;
+	stats = {};
+
+	const u32 count = (u32)queue.order.size();
+	if (count == 0)
+		return;
+
+	Buffer& buffer = queue.indirectCommands;
+	ReserveIndirectCommands(buffer, count);
+	BeginRingFrame(buffer);
+
+	// write the commands of the whole queue, split in runs where the state changes
+	DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)buffer.data;
+	queue.indirectRuns.clear();
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		const DrawItem& item = queue.items[queue.order[i]];
+
+		if (queue.indirectRuns.empty() || !SharesIndirectRun(queue.items[queue.order[queue.indirectRuns.back().firstItem]], item))
+			queue.indirectRuns.push_back(IndirectDrawRun{ i, i, 0 });
+		queue.indirectRuns.back().commandCount++;
+
+		const u32 indexSize = item.indexType == GL_UNSIGNED_INT ? 4 : item.indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+		ASSERT(item.indexOffset % indexSize == 0 && item.instances.offset % instanceSize == 0, "Indirect draws need whole index and instance offsets");
+
+		DrawElementsIndirectCommand& command = commands[i];
+		command.count = item.indexCount;
+		command.instanceCount = item.instanceCount;
+		command.firstIndex = item.indexOffset / indexSize;
+		command.baseVertex = item.baseVertex;
+		command.baseInstance = item.instances.offset / instanceSize;
+
+		stats.drawCount++;
+		stats.instanceCount += item.instanceCount;
+	}
+
+	EndRingFrame(buffer);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.handle);
+
+	const DrawItem* previous = NULL;
+	for (const IndirectDrawRun& run : queue.indirectRuns)
+	{
+		const DrawItem& item = queue.items[queue.order[run.firstItem]];
+
+		if (!previous || item.program != previous->program) {
+			UseProgram(item.program);
+			stats.programChanges++;
+		}
+
+		if (!previous || item.vao != previous->vao) {
+			BindVertexArray(item.vao);
+			stats.vaoChanges++;
+		}
+
+		if (!previous || item.texture != previous->texture) {
+			BindTexture2D(0, item.texture);
+			stats.textureChanges++;
+		}
+
+		if (!previous || item.instances.page != previous->instances.page) {
+			BindStoragePage(arena, item.instances.page, instancesBinding);
+			stats.instanceBufferChanges++;
+		}
+
+		const u32 offset = buffer.regionBase + run.firstCommand * sizeof(DrawElementsIndirectCommand);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, item.indexType, (void*)(u64)offset, run.commandCount, 0);
+
+		stats.multiDrawCount++;
+		previous = &item;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	FenceRingFrame(buffer);
+}
@@ -0,0 +1,112 @@
+//
+// render_queue.h: Draw items collected after Update(), sorted by a 64-bit key and submitted
+// in that order so consecutive draws share as much GL state as possible.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "buffer.h"
+#include <glad/glad.h>
+
+// Initial size of each ring region of the indirect command buffer of a queue, it doubles when a frame needs more
+#define INDIRECT_COMMANDS_REGION_SIZE KB(16)
+
+// Sort key layout, from the most to the least significant bits:
+// program (12) | VAO (16) | material (20) | depth bucket (16)
+#define DRAW_KEY_PROGRAM_BITS  12
+#define DRAW_KEY_VAO_BITS      16
+#define DRAW_KEY_MATERIAL_BITS 20
+#define DRAW_KEY_DEPTH_BITS    16
+
+struct DrawItem
+{
+	u64          key;
+	GLuint       program;
+	GLuint       vao;
+	GLuint       texture;
+	u32          indexCount;
+	GLenum       indexType;
+	u32          indexOffset;   // in bytes
+	i32          baseVertex;
+	u32          instanceCount;
+	UniformBlock instances;     // bound to the Instances storage block
+	glm::vec4    boundingSphere; // model space center and radius of the submesh, for GPU culling
+};
+
+// Layout of the commands read by glMultiDrawElementsIndirect()
+struct DrawElementsIndirectCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 firstIndex;
+	i32 baseVertex;
+	u32 baseInstance;
+};
+
+// Consecutive draw items sharing their state, submitted with one glMultiDrawElementsIndirect()
+struct IndirectDrawRun
+{
+	u32 firstItem;    // index into RenderQueue::order
+	u32 firstCommand;
+	u32 commandCount;
+};
+
+struct RenderQueueStats
+{
+	u32 drawCount;
+	u32 multiDrawCount; // glMultiDrawElementsIndirect() calls, 0 when submitted with direct draws
+	u32 instanceCount;
+	u32 programChanges;
+	u32 vaoChanges;
+	u32 textureChanges;
+	u32 instanceBufferChanges;
+};
+
+struct RenderQueue
+{
+	std::vector<DrawItem> items;
+	std::vector<u32>      order; // submission order, indices into items
+
+	// radix sort scratch memory
+	std::vector<u64> keys;
+	std::vector<u64> keysScratch;
+	std::vector<u32> orderScratch;
+
+	// indirect submission
+	Buffer                       indirectCommands; // ring buffer, created by the first indirect submission
+	std::vector<IndirectDrawRun> indirectRuns;
+
+	RenderQueueStats stats; // of the last submission
+};
+
+/**
+ * Packs the draw state into a sort key. Depth is normalized to [0, 1] between the camera
+ * planes, so draws sharing all their state are submitted front to back.
+ */
+u64 MakeDrawKey(u32 programIdx, GLuint vao, u32 materialIdx, f32 depth);
+
+void ClearRenderQueue(RenderQueue& queue);
+
+void PushDrawItem(RenderQueue& queue, const DrawItem& item);
+
+/**
+ * Fills the submission order. With sort disabled, items are submitted in the order they
+ * were pushed.
+ */
+void SortRenderQueue(RenderQueue& queue, bool sort);
+
+/**
+ * Issues the draws of the queue, skipping the program, VAO, texture and instance buffer
+ * bindings that are already set by the previous item. The texture is bound to unit 0.
+ */
+void SubmitRenderQueue(RenderQueue& queue, const UniformArena& arena, u32 instancesBinding);
+
+/**
+ * Same, with one glMultiDrawElementsIndirect() per run of items sharing program, VAO, texture,
+ * index type and instance page, so the GL calls depend on the state changes and not on the
+ * number of draws. Each command selects its instances with baseInstance, the index of its first
+ * InstanceData in the page, which is bound as a whole. Shaders read it from the instance index
+ * attribute (see INSTANCE_INDEX_LOCATION), as gl_BaseInstance needs GL 4.6.
+ */
+void SubmitRenderQueueIndirect(RenderQueue& queue, const UniformArena& arena, u32 instancesBinding, u32 instanceSize);
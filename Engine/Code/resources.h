@@ -38,9 +38,12 @@ struct VertexV3V3
 
 struct VertexBufferAttribute
 {
-	u8 location;
-	u8 componentCount;
-	u8 offset;
+	u8     location;
+	u8     componentCount;
+	u32    offset;
+	u8     stride; // 0 for the stride of the layout, set when the attributes are not interleaved (GLB files)
+	GLenum type = GL_FLOAT;  // of the components: GL_FLOAT, GL_HALF_FLOAT or GL_SHORT (see vertex_quantization.h)
+	bool   normalized = false; // integer components read as [-1, 1]
 };
 
 struct VertexBufferLayout
@@ -49,10 +52,34 @@ struct VertexBufferLayout
 	u8                                  stride;
 };
 
-struct VAO
+// VAOs are shared by every submesh and program that would configure them the same way
+struct VAOKey
 {
-	GLuint handle;
-	GLuint programHandle;
+	GLuint vertexBufferHandle;
+	GLuint indexBufferHandle;
+	u64    vertexLayoutHash;
+	u32    programInputMask;      // bit per linked attribute location
+	u32    vertexOffsetRemainder; // part of the vertex offset that is not a whole vertex
+
+	bool operator==(const VAOKey& other) const
+	{
+		return vertexBufferHandle == other.vertexBufferHandle && indexBufferHandle == other.indexBufferHandle &&
+			vertexLayoutHash == other.vertexLayoutHash && programInputMask == other.programInputMask &&
+			vertexOffsetRemainder == other.vertexOffsetRemainder;
+	}
+};
+
+struct VAOKeyHasher
+{
+	size_t operator()(const VAOKey& key) const
+	{
+		u64 h = key.vertexLayoutHash;
+		h = h * 31 + key.vertexBufferHandle;
+		h = h * 31 + key.indexBufferHandle;
+		h = h * 31 + key.programInputMask;
+		h = h * 31 + key.vertexOffsetRemainder;
+		return (size_t)(h ^ (h >> 32));
+	}
 };
 
 struct VertexShaderAttribute
@@ -66,28 +93,65 @@ struct VertexShaderLayout
 	std::vector<VertexShaderAttribute> attributes;
 };
 
+// What stays in CPU memory once the geometry of a mesh is in its GL buffers
+enum GeometryRetention
+{
+	GeometryRetention_Drop,           // nothing, the mesh is only drawn
+	GeometryRetention_Keep,           // the vertices and indices as uploaded
+	GeometryRetention_KeepCompressed, // positions and indices only, for picking and collision (see CompressedGeometry)
+};
+
+// Positions quantized to 16 bits per component inside the submesh AABB, and indices narrowed to
+// 16 bits when the submesh has few enough vertices. Read them with GetCompressedPosition/Index().
+struct CompressedGeometry
+{
+	std::vector<u16> positions; // 3 per vertex
+	std::vector<u16> indices16;
+	std::vector<u32> indices32; // instead of indices16 above 65536 vertices
+};
+
+// Submesh::geometryPoolIdx of the submeshes in the buffers of their mesh
+#define GEOMETRY_POOL_NONE UINT32_MAX
+
 struct Submesh
 {
 	VertexBufferLayout  vertexBufferLayout;
-	std::vector<float>  vertices;
+	std::vector<float>  vertices; // empty after the upload unless the mesh keeps its geometry
 	std::vector<u32>    indices;
-	u32                 vertexOffset;
+	std::vector<u16>    indices16; // instead of indices when indexType is GL_UNSIGNED_SHORT (see NarrowMeshIndices)
+	CompressedGeometry  compressed;
+	u32                 vertexCount;
+	u32                 geometryPoolIdx = GEOMETRY_POOL_NONE; // when the geometry is in the buffers of the mesh
+	u32                 vertexOffset;    // in bytes, from the start of the vertex buffer
 	u32                 indexOffset;
+	u32                 indexCount;
+	GLenum              indexType; // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+	u64                 vertexLayoutHash; // 0 until the first VAO lookup
 
-	std::vector<VAO>    vaos;
+	// bounds in model space
+	vec3                aabbMin;
+	vec3                aabbMax;
+	vec3                boundingSphereCenter;
+	f32                 boundingSphereRadius;
 };
 
 struct Mesh
 {
 	std::vector<Submesh>    submeshes;
-	GLuint                  vertexBufferHandle;
+	GLuint                  vertexBufferHandle; // 0 when every submesh is in a GeometryPool
 	GLuint					indexBufferHandle;
+	u32                     vertexBufferSize; // in bytes
+	u32                     indexBufferSize;
+	GeometryRetention       retention;
+	bool                    sharesGeometry; // a copy of the placeholder: its buffers and pool blocks are not its own to free
 };
 
 struct Model
 {
 	u32				 meshIdx;
 	std::vector<u32> materialIdx;
+	std::string      filepath; // empty for the models built in code, which cannot be reloaded
 };
 
 struct Material
@@ -110,4 +174,6 @@ struct Program
 	std::string        programName;
 	u64                lastWriteTimestamp; // What is this for?
 	VertexBufferLayout vertexInputLayout;
+	u32                vertexInputMask; // bit per attribute location read by the vertex shader
+	u32                quantizedVariantIdx; // the same program for the quantized vertex format, UINT32_MAX if there is none
 };
\ No newline at end of file
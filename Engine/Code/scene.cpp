@@ -0,0 +1,174 @@
+#include "scene.h"
+
+u32 GetCount(const HandleTable& table)
+{
+	return (u32)table.denseSlot.size();
+}
+
+bool IsAlive(const HandleTable& table, Handle handle)
+{
+	return handle.slot < table.slotGeneration.size() && table.slotGeneration[handle.slot] == handle.generation;
+}
+
+u32 GetDenseIndex(const HandleTable& table, Handle handle)
+{
+	ASSERT(IsAlive(table, handle), "Handle of a removed element");
+	return table.slotDenseIndex[handle.slot];
+}
+
+Handle GetHandle(const HandleTable& table, u32 denseIndex)
+{
+	const u32 slot = table.denseSlot[denseIndex];
+	return Handle{ slot, table.slotGeneration[slot] };
+}
+
+static Handle AllocateHandle(HandleTable& table)
+{
+	const u32 denseIndex = (u32)table.denseSlot.size();
+
+	u32 slot;
+	if (!table.freeSlots.empty()) {
+		slot = table.freeSlots.back();
+		table.freeSlots.pop_back();
+	}
+	else {
+		slot = (u32)table.slotGeneration.size();
+		table.slotGeneration.push_back(1);
+		table.slotDenseIndex.push_back(0);
+	}
+
+	table.slotDenseIndex[slot] = denseIndex;
+	table.denseSlot.push_back(slot);
+	return Handle{ slot, table.slotGeneration[slot] };
+}
+
+// Frees the slot of the handle. The last dense element moves into the hole, the arrays of
+// the store have to do the same with SwapRemove(). Returns the dense index to remove.
+static u32 ReleaseHandle(HandleTable& table, Handle handle)
+{
+	const u32 denseIndex = GetDenseIndex(table, handle);
+	const u32 lastSlot = table.denseSlot.back();
+
+	table.denseSlot[denseIndex] = lastSlot;
+	table.slotDenseIndex[lastSlot] = denseIndex;
+	table.denseSlot.pop_back();
+
+	table.slotGeneration[handle.slot]++;
+	table.freeSlots.push_back(handle.slot);
+	return denseIndex;
+}
+
+template <typename T>
+static void SwapRemove(std::vector<T>& elements, u32 index)
+{
+	elements[index] = elements.back();
+	elements.pop_back();
+}
+
+static void AddTransform(TransformArrays& transforms, const Transform& transform)
+{
+	transforms.positions.push_back(transform.getPosition());
+	transforms.rotations.push_back(transform.getRotation());
+	transforms.orientations.push_back(transform.getOrientation());
+	transforms.scales.push_back(transform.getScale());
+	transforms.worldMatrices.push_back(glm::mat4(1.0f));
+	transforms.dirty.push_back(1);
+}
+
+static void RemoveTransform(TransformArrays& transforms, u32 index)
+{
+	SwapRemove(transforms.positions, index);
+	SwapRemove(transforms.rotations, index);
+	SwapRemove(transforms.orientations, index);
+	SwapRemove(transforms.scales, index);
+	SwapRemove(transforms.worldMatrices, index);
+	SwapRemove(transforms.dirty, index);
+}
+
+void SetPosition(TransformArrays& transforms, u32 index, glm::vec3 position)
+{
+	if (transforms.positions[index] == position) return;
+	transforms.positions[index] = position;
+	transforms.dirty[index] = 1;
+}
+
+void SetRotation(TransformArrays& transforms, u32 index, glm::vec3 rotation)
+{
+	transforms.rotations[index] = rotation;
+	transforms.orientations[index] = glm::quat(glm::radians(rotation));
+	transforms.dirty[index] = 1;
+}
+
+void SetScale(TransformArrays& transforms, u32 index, glm::vec3 scale)
+{
+	if (transforms.scales[index] == scale) return;
+	transforms.scales[index] = scale;
+	transforms.dirty[index] = 1;
+}
+
+void UpdateWorldMatrices(TransformArrays& transforms)
+{
+	const u32 count = (u32)transforms.dirty.size();
+	const glm::vec3* positions = transforms.positions.data();
+	const glm::quat* orientations = transforms.orientations.data();
+	const glm::vec3* scales = transforms.scales.data();
+	glm::mat4* worldMatrices = transforms.worldMatrices.data();
+	u8* dirty = transforms.dirty.data();
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		if (!dirty[i]) continue;
+
+		// translate * rotate * scale, built directly from the columns of the rotation
+		const glm::mat3 rotation = glm::mat3_cast(orientations[i]);
+		worldMatrices[i] = glm::mat4(
+			glm::vec4(rotation[0] * scales[i].x, 0.0f),
+			glm::vec4(rotation[1] * scales[i].y, 0.0f),
+			glm::vec4(rotation[2] * scales[i].z, 0.0f),
+			glm::vec4(positions[i], 1.0f));
+		dirty[i] = 0;
+		GlobalTransformMatrixRecomputeCount++;
+	}
+}
+
+Handle AddGameObject(GameObjectStore& store, const GameObject& gameObject, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	Handle handle = AllocateHandle(store.handles);
+	AddTransform(store.transforms, gameObject.transform);
+	store.modelIDs.push_back(gameObject.modelID);
+	store.programIDs.push_back(gameObject.programID);
+	store.boundsMin.push_back(boundsMin);
+	store.boundsMax.push_back(boundsMax);
+	store.occluders.push_back(gameObject.isOccluder ? 1 : 0);
+	return handle;
+}
+
+void RemoveGameObject(GameObjectStore& store, Handle handle)
+{
+	const u32 index = ReleaseHandle(store.handles, handle);
+	RemoveTransform(store.transforms, index);
+	SwapRemove(store.modelIDs, index);
+	SwapRemove(store.programIDs, index);
+	SwapRemove(store.boundsMin, index);
+	SwapRemove(store.boundsMax, index);
+	SwapRemove(store.occluders, index);
+}
+
+Handle AddLight(LightStore& store, const Light& light)
+{
+	Handle handle = AllocateHandle(store.handles);
+	AddTransform(store.transforms, light.transform);
+	store.types.push_back(light.type);
+	store.colors.push_back(light.color);
+	store.radii.push_back(light.radius);
+	return handle;
+}
+
+void RemoveLight(LightStore& store, Handle handle)
+{
+	const u32 index = ReleaseHandle(store.handles, handle);
+	RemoveTransform(store.transforms, index);
+	SwapRemove(store.types, index);
+	SwapRemove(store.colors, index);
+	SwapRemove(store.radii, index);
+}
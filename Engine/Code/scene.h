@@ -1,3 +1,9 @@
+//
+// scene.h: Scene storage. Game objects and lights live in dense SoA arrays addressed by
+// generational handles, so the per-frame loops stream contiguous memory and the handles
+// kept by the editor never dangle when the arrays grow or elements are removed.
+//
+
 #pragma once
 
 #include "platform.h"
@@ -6,10 +12,77 @@
 #include "camera.h"
 #include <vector>
 
-class Scene 
+// Refers to an element of a store. It stops being alive when the element is removed, even if its slot is reused.
+struct Handle
+{
+	u32 slot;
+	u32 generation;
+};
+
+#define NULL_HANDLE Handle{ UINT32_MAX, 0 }
+
+struct HandleTable
+{
+	std::vector<u32> slotDenseIndex;
+	std::vector<u32> slotGeneration;
+	std::vector<u32> denseSlot;      // slot of each dense element
+	std::vector<u32> freeSlots;
+};
+
+// Transforms of the elements of a store, indexed by dense index
+struct TransformArrays
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;     // degrees, as edited
+	std::vector<glm::quat> orientations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<u8>        dirty;
+};
+
+struct GameObjectStore
+{
+	HandleTable            handles;
+	TransformArrays        transforms;
+	std::vector<u32>       modelIDs;
+	std::vector<u32>       programIDs;
+	std::vector<glm::vec3> boundsMin;  // model space, union of the bounds of the submeshes
+	std::vector<glm::vec3> boundsMax;
+	std::vector<u8>        occluders;  // 1 for the objects rasterized by the software occlusion culling
+};
+
+struct LightStore
+{
+	HandleTable            handles;
+	TransformArrays        transforms;
+	std::vector<LightType> types;
+	std::vector<glm::vec3> colors;
+	std::vector<f32>       radii;
+};
+
+class Scene
 {
 public:
 	Camera camera;
-	std::vector<GameObject> gameObjects;
-	std::vector<Light> lights;
-};
\ No newline at end of file
+	GameObjectStore gameObjects;
+	LightStore lights;
+};
+
+u32    GetCount(const HandleTable& table);
+bool   IsAlive(const HandleTable& table, Handle handle);
+u32    GetDenseIndex(const HandleTable& table, Handle handle);
+Handle GetHandle(const HandleTable& table, u32 denseIndex);
+
+void SetPosition(TransformArrays& transforms, u32 index, glm::vec3 position);
+void SetRotation(TransformArrays& transforms, u32 index, glm::vec3 rotation);
+void SetScale(TransformArrays& transforms, u32 index, glm::vec3 scale);
+
+// Rebuilds the world matrices of the transforms changed since the last call
+void UpdateWorldMatrices(TransformArrays& transforms);
+
+// Elements are created from the AoS descriptions in game_object.h and light.h
+Handle AddGameObject(GameObjectStore& store, const GameObject& gameObject, glm::vec3 boundsMin, glm::vec3 boundsMax);
+void   RemoveGameObject(GameObjectStore& store, Handle handle);
+
+Handle AddLight(LightStore& store, const Light& light);
+void   RemoveLight(LightStore& store, Handle handle);
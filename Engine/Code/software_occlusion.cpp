@@ -0,0 +1,440 @@
+#include "software_occlusion.h"
+#include "geometry.h"
+#include "vertex_quantization.h"
+#include "job_system.h"
+#include <float.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define SOFTWARE_OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#else
+#define SOFTWARE_OCCLUSION_SSE 0
+#endif
+
+void BeginSoftwareOcclusion(SoftwareOcclusionBuffer& buffer, const glm::mat4& viewProjection, f32 aspectRatio)
+{
+	buffer.width = SOFTWARE_OCCLUSION_WIDTH;
+	buffer.height = glm::max((u32)(SOFTWARE_OCCLUSION_WIDTH / glm::max(aspectRatio, 0.01f) + 0.5f), 1u);
+	buffer.stride = (buffer.width + 3) & ~3u;
+	buffer.depth.assign(buffer.stride * buffer.height, 1.0f);
+
+	buffer.viewProjection = viewProjection;
+	buffer.triangles.clear();
+
+	buffer.occluderCount = 0;
+	buffer.triangleCount = 0;
+	buffer.skippedTriangleCount = 0;
+	buffer.occludersWithoutGeometryCount = 0;
+}
+
+/**
+ * a * x + b * y + c, positive on the left of v0 -> v1. It is computed from the endpoints in the
+ * same order whichever way the edge goes, so the two triangles sharing it get exactly opposite
+ * values at every pixel center and the top-left rule gives each center to one of them.
+ */
+static glm::vec3 MakeEdge(const glm::vec3& v0, const glm::vec3& v1)
+{
+	if (v1.x < v0.x || (v1.x == v0.x && v1.y < v0.y))
+		return -MakeEdge(v1, v0);
+
+	const f32 a = v0.y - v1.y;
+	const f32 b = v1.x - v0.x;
+	return glm::vec3(a, b, -(a * v0.x + b * v0.y));
+}
+
+// Counter clockwise with y up, the left edges go down and the top edges go left
+static bool IsTopLeftEdge(const glm::vec3& edge)
+{
+	return edge.x > 0.0f || (edge.x == 0.0f && edge.y < 0.0f);
+}
+
+static bool IsInsideEdge(const glm::vec3& edge, bool topLeft, f32 x, f32 y)
+{
+	const f32 distance = edge.x * x + (edge.y * y + edge.z);
+	return distance > 0.0f || (distance == 0.0f && topLeft);
+}
+
+// Screen space position and depth of a clip space position in front of the near plane
+static glm::vec3 ToScreen(const SoftwareOcclusionBuffer& buffer, const glm::vec4& clip)
+{
+	const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+	return glm::vec3((ndc.x * 0.5f + 0.5f) * buffer.width, (ndc.y * 0.5f + 0.5f) * buffer.height, ndc.z * 0.5f + 0.5f);
+}
+
+// Edge bits of OccluderTriangle::topLeftEdges and of the silhouette masks, in the order of the vertices
+#define EDGE_AB 1
+#define EDGE_BC 2
+#define EDGE_CA 4
+
+static void SetupTriangle(SoftwareOcclusionBuffer& buffer, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, u32 silhouetteEdges)
+{
+	// both windings are rasterized, counter clockwise on the screen after this
+	f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+	if (area < 0.0f) {
+		std::swap(v1, v2);
+		area = -area;
+		// AB is now the old CA, CA the old AB
+		silhouetteEdges = (silhouetteEdges & EDGE_BC) | (silhouetteEdges & EDGE_AB ? EDGE_CA : 0) | (silhouetteEdges & EDGE_CA ? EDGE_AB : 0);
+	}
+
+	const glm::vec3 boundsMin = glm::min(v0, glm::min(v1, v2));
+	const glm::vec3 boundsMax = glm::max(v0, glm::max(v1, v2));
+
+	// the pixels with their centers inside the bounds, clamped to the screen
+	OccluderTriangle triangle;
+	triangle.minX = glm::max((i32)ceilf(boundsMin.x - 0.5f), 0);
+	triangle.minY = glm::max((i32)ceilf(boundsMin.y - 0.5f), 0);
+	triangle.maxX = glm::min((i32)floorf(boundsMax.x - 0.5f), (i32)buffer.width - 1);
+	triangle.maxY = glm::min((i32)floorf(boundsMax.y - 0.5f), (i32)buffer.height - 1);
+
+	if (area < 1e-6f || triangle.minX > triangle.maxX || triangle.minY > triangle.maxY || boundsMin.z > 1.0f) {
+		buffer.skippedTriangleCount++;
+		return;
+	}
+
+	triangle.edgeA = MakeEdge(v0, v1);
+	triangle.edgeB = MakeEdge(v1, v2);
+	triangle.edgeC = MakeEdge(v2, v0);
+	triangle.topLeftEdges = (IsTopLeftEdge(triangle.edgeA) ? EDGE_AB : 0) | (IsTopLeftEdge(triangle.edgeB) ? EDGE_BC : 0) | (IsTopLeftEdge(triangle.edgeC) ? EDGE_CA : 0);
+
+	// silhouettes only keep the pixels completely inside them
+	glm::vec3* edges[3] = { &triangle.edgeA, &triangle.edgeB, &triangle.edgeC };
+	for (u32 i = 0; i < 3; ++i) {
+		if (!(silhouetteEdges & (1u << i))) continue;
+		glm::vec3& edge = *edges[i];
+		edge.z -= 0.5f * (fabsf(edge.x) + fabsf(edge.y));
+		triangle.topLeftEdges |= 1u << i;
+	}
+
+	// depth is affine on the screen, the farthest over a pixel is half a pixel away from its center
+	const f32 px = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+	const f32 py = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+	triangle.depthPlane = glm::vec3(px, py, v0.z - px * v0.x - py * v0.y + 0.5f * (fabsf(px) + fabsf(py)));
+	triangle.maxDepth = boundsMax.z;
+
+	buffer.triangles.push_back(triangle);
+	buffer.triangleCount++;
+}
+
+// Polygon edges along the near plane, instead of the index of the edge of the triangle they are part of
+#define NEAR_PLANE_EDGE 3
+
+/**
+ * Clips a triangle against the near plane (z >= -w) into a triangle or a quad, like the large
+ * ground planes around the camera, and projects it. sourceEdges tells which edge of the triangle
+ * each edge of the polygon (from each vertex to the next) lies on. Returns the vertex count.
+ */
+static u32 ClipTriangle(const SoftwareOcclusionBuffer& buffer, const glm::vec4 clip[3], glm::vec3 polygon[4], u32 sourceEdges[4])
+{
+	u32 count = 0;
+	for (u32 k = 0; k < 3; ++k)
+	{
+		const glm::vec4& a = clip[k];
+		const glm::vec4& b = clip[(k + 1) % 3];
+		const f32 distanceA = a.z + a.w;
+		const f32 distanceB = b.z + b.w;
+
+		if (distanceA >= 0.0f) {
+			sourceEdges[count] = k;
+			polygon[count++] = ToScreen(buffer, a);
+		}
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f)) {
+			// from the vertex in front whichever way the edge goes, so the triangles sharing it get the same point
+			const bool aInFront = distanceA >= 0.0f;
+			const glm::vec4& front = aInFront ? a : b;
+			const glm::vec4& behind = aInFront ? b : a;
+			const f32 distanceFront = aInFront ? distanceA : distanceB;
+			const f32 distanceBehind = aInFront ? distanceB : distanceA;
+
+			// going out of the frustum the polygon follows the near plane, coming back in the edge
+			sourceEdges[count] = aInFront ? NEAR_PLANE_EDGE : k;
+			polygon[count++] = ToScreen(buffer, glm::mix(front, behind, distanceFront / (distanceFront - distanceBehind)));
+		}
+	}
+	return count;
+}
+
+static u64 MakeDirectedEdge(u32 from, u32 to)
+{
+	return ((u64)from << 32) | to;
+}
+
+void AddOccluderTriangles(SoftwareOcclusionBuffer& buffer, const glm::mat4& worldMatrix, const glm::vec3* positions, const u32* indices, u32 indexCount)
+{
+	const glm::mat4 worldViewProjection = buffer.viewProjection * worldMatrix;
+	indexCount -= indexCount % 3;
+
+	buffer.occluderCount++;
+
+	// the vertices at the same position share their edges, wherever the mesh split them
+	u32 vertexCount = 0;
+	for (u32 i = 0; i < indexCount; ++i)
+		vertexCount = glm::max(vertexCount, indices[i] + 1);
+
+	std::vector<u32>& order = buffer.vertexOrder;
+	order.resize(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+		order[v] = v;
+	std::sort(order.begin(), order.end(), [=](u32 a, u32 b) {
+		const glm::vec3& pa = positions[a];
+		const glm::vec3& pb = positions[b];
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	});
+
+	std::vector<u32>& welded = buffer.weldedVertices;
+	welded.resize(vertexCount);
+	for (u32 i = 0; i < vertexCount; ++i)
+		welded[order[i]] = i > 0 && positions[order[i]] == positions[order[i - 1]] ? welded[order[i - 1]] : order[i];
+
+	// the edges of every triangle as seen on the screen, counter clockwise: an edge is interior when
+	// a triangle on the other side of it has it the other way
+	std::vector<u64>& directedEdges = buffer.directedEdges;
+	directedEdges.clear();
+
+	for (u32 pass = 0; pass < 2; ++pass)
+	{
+		for (u32 i = 0; i < indexCount; i += 3)
+		{
+			glm::vec4 clip[3];
+			for (u32 k = 0; k < 3; ++k)
+				clip[k] = worldViewProjection * glm::vec4(positions[indices[i + k]], 1.0f);
+
+			glm::vec3 polygon[4];
+			u32 sourceEdges[4];
+			const u32 polygonCount = ClipTriangle(buffer, clip, polygon, sourceEdges);
+
+			f32 area = 0.0f;
+			for (u32 k = 0; k < polygonCount; ++k) {
+				const glm::vec3& a = polygon[k];
+				const glm::vec3& b = polygon[(k + 1) % polygonCount];
+				area += a.x * b.y - b.x * a.y;
+			}
+
+			const u32 vertex[3] = { welded[indices[i]], welded[indices[i + 1]], welded[indices[i + 2]] };
+
+			if (pass == 0)
+			{
+				if (polygonCount < 3 || area == 0.0f) continue;
+				for (u32 k = 0; k < 3; ++k) {
+					const u32 from = vertex[k], to = vertex[(k + 1) % 3];
+					directedEdges.push_back(area > 0.0f ? MakeDirectedEdge(from, to) : MakeDirectedEdge(to, from));
+				}
+				continue;
+			}
+
+			if (polygonCount < 3) {
+				buffer.skippedTriangleCount++;
+				continue;
+			}
+
+			u32 triangleSilhouettes = 0;
+			for (u32 k = 0; k < 3; ++k) {
+				const u32 from = vertex[k], to = vertex[(k + 1) % 3];
+				const u64 reversed = area > 0.0f ? MakeDirectedEdge(to, from) : MakeDirectedEdge(from, to);
+				if (!std::binary_search(directedEdges.begin(), directedEdges.end(), reversed))
+					triangleSilhouettes |= 1u << k;
+			}
+
+			u32 polygonSilhouettes = 0;
+			for (u32 k = 0; k < polygonCount; ++k)
+				if (sourceEdges[k] == NEAR_PLANE_EDGE || (triangleSilhouettes & (1u << sourceEdges[k])))
+					polygonSilhouettes |= 1u << k;
+
+			// a fan: the diagonals between its triangles are interior
+			for (u32 k = 1; k + 1 < polygonCount; ++k)
+			{
+				u32 silhouetteEdges = polygonSilhouettes & (1u << k) ? EDGE_BC : 0;
+				if (k == 1 && (polygonSilhouettes & 1)) silhouetteEdges |= EDGE_AB;
+				if (k + 2 == polygonCount && (polygonSilhouettes & (1u << (polygonCount - 1)))) silhouetteEdges |= EDGE_CA;
+				SetupTriangle(buffer, polygon[0], polygon[k], polygon[k + 1], silhouetteEdges);
+			}
+		}
+
+		if (pass == 0)
+			std::sort(directedEdges.begin(), directedEdges.end());
+	}
+}
+
+bool AddOccluderSubmesh(SoftwareOcclusionBuffer& buffer, const glm::mat4& worldMatrix, const Submesh& submesh)
+{
+	std::vector<glm::vec3>& positions = buffer.positions;
+	std::vector<u32>& indices = buffer.indices;
+	positions.resize(submesh.vertexCount);
+
+	if (!submesh.vertices.empty() && (!submesh.indices.empty() || !submesh.indices16.empty()))
+	{
+		const u8* vertexData = (const u8*)submesh.vertices.data();
+		for (u32 i = 0; i < submesh.vertexCount; ++i)
+			positions[i] = ReadVertexPosition(submesh.vertexBufferLayout, vertexData, i);
+
+		if (submesh.indexType == GL_UNSIGNED_SHORT) {
+			indices.assign(submesh.indices16.begin(), submesh.indices16.end());
+			AddOccluderTriangles(buffer, worldMatrix, positions.data(), indices.data(), (u32)indices.size());
+		}
+		else
+			AddOccluderTriangles(buffer, worldMatrix, positions.data(), submesh.indices.data(), (u32)submesh.indices.size());
+		return true;
+	}
+
+	if (!submesh.compressed.positions.empty())
+	{
+		for (u32 i = 0; i < submesh.vertexCount; ++i)
+			positions[i] = GetCompressedPosition(submesh, i);
+
+		indices.resize(submesh.indexCount);
+		for (u32 i = 0; i < submesh.indexCount; ++i)
+			indices[i] = GetCompressedIndex(submesh, i);
+
+		AddOccluderTriangles(buffer, worldMatrix, positions.data(), indices.data(), submesh.indexCount);
+		return true;
+	}
+
+	return false;
+}
+
+bool HasOccluderGeometry(const Mesh& mesh)
+{
+	for (const Submesh& submesh : mesh.submeshes)
+		if (!submesh.vertices.empty() || !submesh.compressed.positions.empty())
+			return true;
+	return false;
+}
+
+static void RasterizeBand(SoftwareOcclusionBuffer& buffer, i32 bandMinY, i32 bandMaxY)
+{
+	for (const OccluderTriangle& triangle : buffer.triangles)
+	{
+		const i32 minY = glm::max(triangle.minY, bandMinY);
+		const i32 maxY = glm::min(triangle.maxY, bandMaxY);
+		if (minY > maxY) continue;
+
+		// whole groups of 4 pixels, the lanes out of the triangle fail the edge tests
+		const i32 minX = triangle.minX & ~3;
+		const i32 maxX = triangle.maxX;
+
+		for (i32 y = minY; y <= maxY; ++y)
+		{
+			f32* row = &buffer.depth[y * buffer.stride];
+			const f32 cy = y + 0.5f;
+
+#if SOFTWARE_OCCLUSION_SSE
+			const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 lastX = _mm_set1_ps((f32)maxX + 0.5f);
+			const __m128 maxDepth = _mm_set1_ps(triangle.maxDepth);
+			const __m128 aA = _mm_set1_ps(triangle.edgeA.x), rowA = _mm_set1_ps(triangle.edgeA.y * cy + triangle.edgeA.z);
+			const __m128 aB = _mm_set1_ps(triangle.edgeB.x), rowB = _mm_set1_ps(triangle.edgeB.y * cy + triangle.edgeB.z);
+			const __m128 aC = _mm_set1_ps(triangle.edgeC.x), rowC = _mm_set1_ps(triangle.edgeC.y * cy + triangle.edgeC.z);
+			// all lanes set where the pixel centers exactly on the edge are inside
+			const __m128 onA = _mm_cmpneq_ps(_mm_set1_ps((f32)(triangle.topLeftEdges & 1)), zero);
+			const __m128 onB = _mm_cmpneq_ps(_mm_set1_ps((f32)(triangle.topLeftEdges & 2)), zero);
+			const __m128 onC = _mm_cmpneq_ps(_mm_set1_ps((f32)(triangle.topLeftEdges & 4)), zero);
+			const __m128 aZ = _mm_set1_ps(triangle.depthPlane.x), rowZ = _mm_set1_ps(triangle.depthPlane.y * cy + triangle.depthPlane.z);
+
+			for (i32 x = minX; x <= maxX; x += 4)
+			{
+				const __m128 cx = _mm_add_ps(_mm_set1_ps((f32)x), laneOffsets);
+
+				const __m128 distanceA = _mm_add_ps(_mm_mul_ps(aA, cx), rowA);
+				const __m128 distanceB = _mm_add_ps(_mm_mul_ps(aB, cx), rowB);
+				const __m128 distanceC = _mm_add_ps(_mm_mul_ps(aC, cx), rowC);
+
+				__m128 inside = _mm_cmple_ps(cx, lastX);
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(distanceA, zero), _mm_and_ps(_mm_cmpeq_ps(distanceA, zero), onA)));
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(distanceB, zero), _mm_and_ps(_mm_cmpeq_ps(distanceB, zero), onB)));
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(distanceC, zero), _mm_and_ps(_mm_cmpeq_ps(distanceC, zero), onC)));
+				if (_mm_movemask_ps(inside) == 0) continue;
+
+				const __m128 depth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(aZ, cx), rowZ), maxDepth);
+				const __m128 current = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(current, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+			}
+#else
+			for (i32 x = triangle.minX; x <= maxX; ++x)
+			{
+				const f32 cx = x + 0.5f;
+				if (!IsInsideEdge(triangle.edgeA, (triangle.topLeftEdges & 1) != 0, cx, cy)) continue;
+				if (!IsInsideEdge(triangle.edgeB, (triangle.topLeftEdges & 2) != 0, cx, cy)) continue;
+				if (!IsInsideEdge(triangle.edgeC, (triangle.topLeftEdges & 4) != 0, cx, cy)) continue;
+
+				const f32 depth = glm::min(glm::dot(triangle.depthPlane, glm::vec3(cx, cy, 1.0f)), triangle.maxDepth);
+				row[x] = glm::min(row[x], depth);
+			}
+#endif
+		}
+	}
+}
+
+void RasterizeOccluders(SoftwareOcclusionBuffer& buffer)
+{
+	if (buffer.triangles.empty())
+		return;
+
+	// every band writes its own rows only, so the result does not depend on the scheduling
+	const u32 bandCount = (buffer.height + SOFTWARE_OCCLUSION_BAND_HEIGHT - 1) / SOFTWARE_OCCLUSION_BAND_HEIGHT;
+	SoftwareOcclusionBuffer* target = &buffer;
+	ParallelFor(bandCount, 1, [=](u32 begin, u32 end)
+	{
+		for (u32 band = begin; band < end; ++band)
+			RasterizeBand(*target, band * SOFTWARE_OCCLUSION_BAND_HEIGHT, glm::min((band + 1) * SOFTWARE_OCCLUSION_BAND_HEIGHT, target->height) - 1);
+	});
+}
+
+bool IsOccludedBySoftware(const SoftwareOcclusionBuffer& buffer, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// screen rectangle and nearest depth of the box
+	glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+	f32 nearestDepth = 1.0f;
+	for (u32 corner = 0; corner < 8; ++corner)
+	{
+		const glm::vec3 position(corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z);
+		const glm::vec4 clip = buffer.viewProjection * glm::vec4(position, 1.0f);
+
+		// crossing the near plane: it covers the camera
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return false;
+
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		const glm::vec2 screen = (glm::vec2(ndc) * 0.5f + 0.5f) * glm::vec2(buffer.width, buffer.height);
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+		nearestDepth = glm::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	// every pixel the rectangle touches must be nearer than the box
+	const i32 minX = glm::max((i32)floorf(screenMin.x), 0);
+	const i32 minY = glm::max((i32)floorf(screenMin.y), 0);
+	const i32 maxX = glm::min((i32)ceilf(screenMax.x) - 1, (i32)buffer.width - 1);
+	const i32 maxY = glm::min((i32)ceilf(screenMax.y) - 1, (i32)buffer.height - 1);
+	if (minX > maxX || minY > maxY)
+		return false;
+
+	for (i32 y = minY; y <= maxY; ++y)
+	{
+		const f32* row = &buffer.depth[y * buffer.stride];
+
+#if SOFTWARE_OCCLUSION_SSE
+		const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 first = _mm_set1_ps((f32)minX);
+		const __m128 last = _mm_set1_ps((f32)maxX);
+		const __m128 nearest = _mm_set1_ps(nearestDepth);
+
+		for (i32 x = minX & ~3; x <= maxX; x += 4)
+		{
+			const __m128 lanes = _mm_add_ps(_mm_set1_ps((f32)x), laneOffsets);
+			const __m128 inRect = _mm_and_ps(_mm_cmpge_ps(lanes, first), _mm_cmple_ps(lanes, last));
+			const __m128 visible = _mm_and_ps(inRect, _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest));
+			if (_mm_movemask_ps(visible) != 0)
+				return false;
+		}
+#else
+		for (i32 x = minX; x <= maxX; ++x)
+			if (row[x] >= nearestDepth)
+				return false;
+#endif
+	}
+
+	return true;
+}
@@ -0,0 +1,87 @@
+//
+// software_occlusion.h: Occlusion culling on the CPU, in the same frame and without the GPU. The
+// triangles of the objects tagged as occluders are rasterized into a low resolution depth buffer,
+// four pixels at a time with SSE, by the job workers one band of rows each. The boxes of the
+// other objects are then tested against it before their draws are built.
+//
+// The coverage of a triangle depends on its edges:
+//  - interior edges, shared with a triangle of the same mesh on the other side of it on the
+//    screen: the pixels whose centers it covers, with a top-left rule, so the triangles leave no
+//    crack between them. A pixel across such an edge gets the depth of the triangle holding its
+//    center, the farthest of its plane over the pixel.
+//  - silhouette edges (the border of the mesh, folds, the cut of the near plane): only the pixels
+//    it covers completely, so a box peeking past an occluder is never hidden by it.
+// The depth written is the farthest of the triangle over the pixel. Triangles crossing the near
+// plane are clipped against it. The vertices are welded by position to find the shared edges, so
+// seams where an imported mesh duplicates its vertices stay interior.
+//
+// Occluders are rasterized from the geometry their mesh keeps on the CPU (GeometryRetention), at
+// full resolution: there is no simplification step, so dense meshes are better tagged through a
+// low polygon proxy.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+#define SOFTWARE_OCCLUSION_WIDTH 256
+
+// Rows rasterized by each job
+#define SOFTWARE_OCCLUSION_BAND_HEIGHT 8
+
+// Screen space triangle, after the setup
+struct OccluderTriangle
+{
+	glm::vec3 edgeA;     // per edge: a * x + b * y + c > 0 inside
+	glm::vec3 edgeB;
+	glm::vec3 edgeC;
+	u32       topLeftEdges; // bit per edge (A, B, C) that also owns the pixel centers exactly on it
+	                        // (always set for silhouettes, whose edges are moved half a pixel inside)
+	glm::vec3 depthPlane; // depth = x * px + y * py + z
+	f32       maxDepth;
+	i32       minX, minY, maxX, maxY; // pixel bounds, inclusive
+};
+
+struct SoftwareOcclusionBuffer
+{
+	u32              width;
+	u32              height;
+	u32              stride; // pixels per row, a multiple of 4
+	std::vector<f32> depth;  // nearest occluder depth of each pixel, 1 where there is none
+
+	glm::mat4                     viewProjection;
+	std::vector<OccluderTriangle> triangles;
+	std::vector<glm::vec3>        positions; // scratch: positions and 32 bit indices of the submesh being added
+	std::vector<u32>              indices;
+	std::vector<u32>              vertexOrder;    // scratch: the vertices sorted by position
+	std::vector<u32>              weldedVertices; // scratch: first vertex at the same position, per vertex
+	std::vector<u64>              directedEdges;  // scratch: welded (from, to) of the edges, counter clockwise on the screen
+
+	// stats of the frame
+	u32 occluderCount;
+	u32 triangleCount; // set up for the rasterization
+	u32 skippedTriangleCount; // behind the near plane or covering no pixel center
+	u32 occludersWithoutGeometryCount; // tagged, but their mesh keeps no CPU geometry
+};
+
+// Starts a frame: the buffer keeps the aspect ratio of the display and is cleared to the far plane
+void BeginSoftwareOcclusion(SoftwareOcclusionBuffer& buffer, const glm::mat4& viewProjection, f32 aspectRatio);
+
+// Sets up the indexed triangles of model space positions, transformed by worldMatrix
+void AddOccluderTriangles(SoftwareOcclusionBuffer& buffer, const glm::mat4& worldMatrix, const glm::vec3* positions, const u32* indices, u32 indexCount);
+
+/**
+ * Same, from the geometry the submesh kept on the CPU (see GeometryRetention). Returns false when
+ * it has none, so the object cannot occlude anything.
+ */
+bool AddOccluderSubmesh(SoftwareOcclusionBuffer& buffer, const glm::mat4& worldMatrix, const Submesh& submesh);
+
+// Whether the mesh keeps the CPU geometry AddOccluderSubmesh() needs
+bool HasOccluderGeometry(const Mesh& mesh);
+
+// Rasterizes the triangles added since BeginSoftwareOcclusion(), in parallel
+void RasterizeOccluders(SoftwareOcclusionBuffer& buffer);
+
+// Tests a world space box against the rasterized occluders
+bool IsOccludedBySoftware(const SoftwareOcclusionBuffer& buffer, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
@@ -1,57 +1,81 @@
 #pragma once
 
 #include "platform.h"
+#include <glm/gtc/quaternion.hpp>
 
 enum TransformOrientation {
 	LOCAL,
 	GLOBAL
 };
 
+// Matrices rebuilt by getTransformationMatrix() since the counter was last reset (defined in engine.cpp)
+extern u32 GlobalTransformMatrixRecomputeCount;
+
 class Transform
 {
 public:
 	Transform() 
 	{ 
 		_position = glm::vec3(0, 0, 0);
-		_rotation = glm::vec3(0, 0, 0);
+		setRotation(glm::vec3(0, 0, 0));
 		_scale = glm::vec3(1, 1, 1);
+		_dirty = true;
 	}
 	Transform(glm::vec3 position)
 	{
 		_position = position;
-		_rotation = glm::vec3(0, 0, 0);
+		setRotation(glm::vec3(0, 0, 0));
 		_scale = glm::vec3(1, 1, 1);
+		_dirty = true;
 	}
 
 	glm::vec3 getPosition() const { return _position; }
 	glm::vec3 getRotation() const {	return _rotation; }
+	glm::quat getOrientation() const { return _orientation; }
 	glm::vec3 getScale() const { return _scale; }
 
 	void setPosition(glm::vec3 position)
 	{
+		if (position == _position) return;
 		_position = position;
+		_dirty = true;
 	}
 
 	void setRotation(glm::vec3 rotation)
 	{
+		// the euler angles are kept as edited, the matrix is built from the quaternion
 		_rotation = rotation;
+		_orientation = glm::quat(glm::radians(rotation));
+		_dirty = true;
 	}
 
 	void setScale(glm::vec3 scale)
 	{
+		if (scale == _scale) return;
 		_scale = scale;
+		_dirty = true;
 	}
 
-	glm::mat4 getTransformationMatrix() 
+	const glm::mat4& getTransformationMatrix() const
 	{
-		return glm::translate(glm::mat4(1.0f), _position) 
-			* glm::mat4_cast(glm::quat(glm::radians(_rotation))) 
-			* glm::scale(glm::mat4(1.0f), _scale);
+		if (_dirty)
+		{
+			_matrix = glm::translate(glm::mat4(1.0f), _position) 
+				* glm::mat4_cast(_orientation) 
+				* glm::scale(glm::mat4(1.0f), _scale);
+			_dirty = false;
+			GlobalTransformMatrixRecomputeCount++;
+		}
+		return _matrix;
 	}
 
 private:
 	glm::vec3 _position;
 	glm::vec3 _rotation; // degrees
+	glm::quat _orientation;
 	glm::vec3 _scale;
 
+	// cached result of getTransformationMatrix()
+	mutable glm::mat4 _matrix;
+	mutable bool      _dirty;
 };
@@ -0,0 +1,233 @@
+#include "vertex_quantization.h"
+#include <glm/gtc/packing.hpp>
+#include <string.h>
+
+static f32 SignNotZero(f32 value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 EncodeOctahedral(const glm::vec3& n)
+{
+	// onto the octahedron, then the lower half folded over the corners
+	const glm::vec3 p = n / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+	if (p.z >= 0.0f)
+		return glm::vec2(p.x, p.y);
+	return glm::vec2((1.0f - fabsf(p.y)) * SignNotZero(p.x), (1.0f - fabsf(p.x)) * SignNotZero(p.y));
+}
+
+glm::vec3 DecodeOctahedral(const glm::vec2& e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - fabsf(e.y)) * SignNotZero(e.x);
+		n.y = (1.0f - fabsf(e.x)) * SignNotZero(e.y);
+	}
+	return glm::normalize(n);
+}
+
+// Rounded like the GL reads normalized shorts back: max(value / 32767, -1)
+static i16 ToSnorm16(f32 value)
+{
+	return (i16)roundf(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+static f32 FromSnorm16(i16 value)
+{
+	return glm::max(value / 32767.0f, -1.0f);
+}
+
+static f32 AngleDegrees(const glm::vec3& a, const glm::vec3& b)
+{
+	// acos() loses the small angles to the rounding of the dot product
+	return glm::degrees(atan2f(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+}
+
+static const VertexBufferAttribute* FindAttribute(const VertexBufferLayout& layout, u32 location)
+{
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+		if (attribute.location == location) return &attribute;
+	return NULL;
+}
+
+bool IsQuantizedVertexLayout(const VertexBufferLayout& layout)
+{
+	const VertexBufferAttribute* normal = FindAttribute(layout, 1);
+	return normal && normal->type == GL_SHORT;
+}
+
+glm::vec3 ReadVertexPosition(const VertexBufferLayout& layout, const u8* vertices, u32 vertex)
+{
+	const VertexBufferAttribute* position = FindAttribute(layout, 0);
+	if (!position)
+		return glm::vec3(0.0f);
+
+	const u8* data = vertices + position->offset + vertex * (position->stride ? position->stride : layout.stride);
+	if (position->type == GL_HALF_FLOAT)
+	{
+		u16 halves[3];
+		memcpy(halves, data, sizeof(halves));
+		return glm::vec3(glm::unpackHalf1x16(halves[0]), glm::unpackHalf1x16(halves[1]), glm::unpackHalf1x16(halves[2]));
+	}
+
+	glm::vec3 p;
+	memcpy(&p, data, sizeof(p));
+	return p;
+}
+
+bool QuantizeSubmesh(Submesh& submesh, VertexQuantizationStats* stats)
+{
+	const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+	if (submesh.vertices.empty())
+		return false;
+
+	// the float layouts of the importers and the procedural shapes, interleaved
+	const VertexBufferAttribute* attributes[5] = {};
+	for (const VertexBufferAttribute& attribute : layout.attributes)
+	{
+		if (attribute.location >= ARRAY_COUNT(attributes) || attribute.type != GL_FLOAT || attribute.stride != 0)
+			return false;
+		attributes[attribute.location] = &attribute;
+	}
+
+	const VertexBufferAttribute* positionAttribute = attributes[0];
+	const VertexBufferAttribute* normalAttribute = attributes[1];
+	const VertexBufferAttribute* texCoordAttribute = attributes[2];
+	const bool hasTangentSpace = attributes[3] && attributes[4];
+	if (!positionAttribute || !normalAttribute || positionAttribute->componentCount != 3 || normalAttribute->componentCount != 3 ||
+		(texCoordAttribute && texCoordAttribute->componentCount != 2))
+		return false;
+
+	const u32 vertexCount = submesh.vertexCount;
+	const u8* source = (const u8*)submesh.vertices.data();
+	auto Read = [&](const VertexBufferAttribute* attribute, u32 vertex) -> const f32* {
+		return (const f32*)(source + vertex * layout.stride + attribute->offset);
+	};
+
+	// halves keep about 11 bits of the magnitude: enough unless the submesh is far from the origin for its size
+	const f32 diameter = glm::max(2.0f * submesh.boundingSphereRadius, 1e-6f);
+	f32 halfError = 0.0f;
+	for (u32 i = 0; i < vertexCount; ++i)
+	{
+		const f32* p = Read(positionAttribute, i);
+		for (u32 c = 0; c < 3; ++c)
+			halfError = glm::max(halfError, fabsf(glm::unpackHalf1x16(glm::packHalf1x16(p[c])) - p[c]));
+	}
+	const bool halfPositions = halfError <= VERTEX_HALF_POSITION_TOLERANCE * diameter;
+
+	VertexBufferLayout quantized;
+	quantized.stride = 0;
+	auto Add = [&](u8 location, u8 componentCount, GLenum type, bool normalized, u32 size) {
+		VertexBufferAttribute attribute = { location, componentCount, quantized.stride, 0 };
+		attribute.type = type;
+		attribute.normalized = normalized;
+		quantized.attributes.push_back(attribute);
+		quantized.stride += (u8)size;
+	};
+
+	Add(0, 4, halfPositions ? GL_HALF_FLOAT : GL_FLOAT, false, halfPositions ? 4 * sizeof(u16) : 4 * sizeof(f32));
+	Add(1, 2, GL_SHORT, true, 2 * sizeof(i16));
+	if (texCoordAttribute) Add(2, 2, GL_HALF_FLOAT, false, 2 * sizeof(u16));
+	if (hasTangentSpace)   Add(3, 2, GL_SHORT, true, 2 * sizeof(i16));
+
+	std::vector<float> vertices(vertexCount * quantized.stride / sizeof(float));
+	u8* out = (u8*)vertices.data();
+
+	VertexQuantizationStats errors = {};
+	for (u32 i = 0; i < vertexCount; ++i)
+	{
+		const glm::vec3 position = glm::make_vec3(Read(positionAttribute, i));
+		// degenerate faces and "vn 0 0 0" leave zero normals, which would encode as NaN
+		glm::vec3 normal = glm::make_vec3(Read(normalAttribute, i));
+		normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		f32 bitangentSign = 1.0f;
+		glm::vec3 tangent;
+		if (hasTangentSpace)
+		{
+			tangent = glm::make_vec3(Read(attributes[3], i));
+			tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(1.0f, 0.0f, 0.0f);
+			bitangentSign = SignNotZero(glm::dot(glm::cross(normal, tangent), glm::make_vec3(Read(attributes[4], i))));
+		}
+
+		// position, w: bitangent sign
+		glm::vec3 decodedPosition;
+		if (halfPositions)
+		{
+			const u16 halves[4] = { glm::packHalf1x16(position.x), glm::packHalf1x16(position.y), glm::packHalf1x16(position.z), glm::packHalf1x16(bitangentSign) };
+			memcpy(out, halves, sizeof(halves));
+			out += sizeof(halves);
+			decodedPosition = glm::vec3(glm::unpackHalf1x16(halves[0]), glm::unpackHalf1x16(halves[1]), glm::unpackHalf1x16(halves[2]));
+		}
+		else
+		{
+			const f32 floats[4] = { position.x, position.y, position.z, bitangentSign };
+			memcpy(out, floats, sizeof(floats));
+			out += sizeof(floats);
+			decodedPosition = position;
+		}
+		errors.positionError = glm::max(errors.positionError, glm::length(decodedPosition - position));
+
+		// normal
+		{
+			const glm::vec2 e = EncodeOctahedral(normal);
+			const i16 shorts[2] = { ToSnorm16(e.x), ToSnorm16(e.y) };
+			memcpy(out, shorts, sizeof(shorts));
+			out += sizeof(shorts);
+			errors.normalErrorDegrees = glm::max(errors.normalErrorDegrees, AngleDegrees(normal, DecodeOctahedral(glm::vec2(FromSnorm16(shorts[0]), FromSnorm16(shorts[1])))));
+		}
+
+		if (texCoordAttribute)
+		{
+			const glm::vec2 texCoord = glm::make_vec2(Read(texCoordAttribute, i));
+			const u16 halves[2] = { glm::packHalf1x16(texCoord.x), glm::packHalf1x16(texCoord.y) };
+			memcpy(out, halves, sizeof(halves));
+			out += sizeof(halves);
+			const glm::vec2 decoded(glm::unpackHalf1x16(halves[0]), glm::unpackHalf1x16(halves[1]));
+			errors.texCoordError = glm::max(errors.texCoordError, glm::max(fabsf(decoded.x - texCoord.x), fabsf(decoded.y - texCoord.y)));
+		}
+
+		if (hasTangentSpace)
+		{
+			const glm::vec2 e = EncodeOctahedral(tangent);
+			const i16 shorts[2] = { ToSnorm16(e.x), ToSnorm16(e.y) };
+			memcpy(out, shorts, sizeof(shorts));
+			out += sizeof(shorts);
+			errors.tangentErrorDegrees = glm::max(errors.tangentErrorDegrees, AngleDegrees(tangent, DecodeOctahedral(glm::vec2(FromSnorm16(shorts[0]), FromSnorm16(shorts[1])))));
+		}
+	}
+
+	if (stats)
+	{
+		stats->vertexCount += vertexCount;
+		stats->bytesBefore += vertexCount * layout.stride;
+		stats->bytesAfter += vertexCount * quantized.stride;
+		stats->floatPositionSubmeshCount += halfPositions ? 0 : 1;
+		stats->positionError = glm::max(stats->positionError, errors.positionError);
+		stats->positionRelativeError = glm::max(stats->positionRelativeError, errors.positionError / diameter);
+		stats->normalErrorDegrees = glm::max(stats->normalErrorDegrees, errors.normalErrorDegrees);
+		stats->tangentErrorDegrees = glm::max(stats->tangentErrorDegrees, errors.tangentErrorDegrees);
+		stats->texCoordError = glm::max(stats->texCoordError, errors.texCoordError);
+	}
+
+	submesh.vertexBufferLayout = quantized;
+	submesh.vertices.swap(vertices);
+	submesh.vertexLayoutHash = 0;
+	return true;
+}
+
+void QuantizeMesh(Mesh& mesh, const char* name)
+{
+	VertexQuantizationStats stats = {};
+	for (Submesh& submesh : mesh.submeshes)
+		QuantizeSubmesh(submesh, &stats);
+
+	if (stats.vertexCount == 0)
+		return;
+
+	ILOG("%s: vertices quantized, %.1f KB -> %.1f KB (%.0f%% less), %u of %u submeshes keep float positions",
+		name, stats.bytesBefore / 1024.0, stats.bytesAfter / 1024.0, 100.0 * (1.0 - (f64)stats.bytesAfter / stats.bytesBefore),
+		stats.floatPositionSubmeshCount, (u32)mesh.submeshes.size());
+	ILOG("%s: largest errors, position %.2g (%.4f%% of the bounds), normal %.3f deg, tangent %.3f deg, texture coordinates %.2g",
+		name, stats.positionError, 100.0f * stats.positionRelativeError, stats.normalErrorDegrees, stats.tangentErrorDegrees, stats.texCoordError);
+}
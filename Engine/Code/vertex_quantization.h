@@ -0,0 +1,54 @@
+//
+// vertex_quantization.h: Compact vertex format of the meshes, built from the float vertices at
+// import time (after the mesh optimizer, so the model cache stores it too):
+//  - location 0, positions: 4 halves, w holding the sign of the bitangent. Submeshes too far from
+//    the origin for the precision of a half keep 4 floats instead.
+//  - location 1, normals: octahedral, 2 normalized shorts
+//  - location 2, texture coordinates: 2 halves
+//  - location 3, tangents: octahedral, 2 normalized shorts. The bitangent is not stored, the
+//    shaders rebuild it as cross(normal, tangent) * position.w.
+// 56 bytes become 20 for a vertex with tangent space, and 24 become 12 without texture coordinates.
+// The mesh programs have a QUANTIZED_VERTICES variant reading this format, see LoadMeshProgram().
+//
+
+#pragma once
+
+#include "platform.h"
+#include "resources.h"
+
+// Largest error of the half positions, relative to the diameter of the bounding sphere of the submesh
+#define VERTEX_HALF_POSITION_TOLERANCE (1.0f / 2048.0f)
+
+struct VertexQuantizationStats
+{
+	u32 vertexCount;
+	u32 bytesBefore;
+	u32 bytesAfter;
+	u32 floatPositionSubmeshCount; // kept 32 bit positions
+
+	// largest errors of the decoded vertices
+	f32 positionError;        // in model units
+	f32 positionRelativeError; // to the bounding sphere diameter
+	f32 normalErrorDegrees;
+	f32 tangentErrorDegrees;
+	f32 texCoordError;
+};
+
+// Unit vector to the [-1, 1] square and back
+glm::vec2 EncodeOctahedral(const glm::vec3& n);
+glm::vec3 DecodeOctahedral(const glm::vec2& e);
+
+bool IsQuantizedVertexLayout(const VertexBufferLayout& layout);
+
+// Position (location 0) of a vertex, decoded from any of the formats of the layout
+glm::vec3 ReadVertexPosition(const VertexBufferLayout& layout, const u8* vertices, u32 vertex);
+
+/**
+ * Converts the float vertices of the submesh (positions and normals, and optionally texture
+ * coordinates, tangents and bitangents, as the importers write them) to the compact format.
+ * Returns false when it has no CPU vertices or another layout. The errors are accumulated.
+ */
+bool QuantizeSubmesh(Submesh& submesh, VertexQuantizationStats* stats = NULL);
+
+// Quantizes every submesh and logs the memory saved and the largest errors
+void QuantizeMesh(Mesh& mesh, const char* name);
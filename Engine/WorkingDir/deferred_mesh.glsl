@@ -4,27 +4,54 @@
 struct Light
 {
 	unsigned int type;
+	float radius;
 	vec3 color;
 	vec3 direction;
 	vec3 position;
 };
 
+#ifdef QUANTIZED_VERTICES
+
+// Normals and tangents of the quantized vertex format (vertex_quantization.h)
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+#endif
+
 ///////////////////////////////////////////////////////////////////////
 
 #ifdef TEXTURED_MESH
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
+#ifdef QUANTIZED_VERTICES
+layout(location = 0) in vec4 aPosition; // w: sign of the bitangent
+layout(location = 1) in vec2 aNormal;   // octahedral
+layout(location = 2) in vec2 aTexCoord;
+//layout(location = 3) in vec2 aTangent; // octahedral, the bitangent is cross(normal, tangent) * aPosition.w
+#else
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 //layout(location = 3) in vec3 aTangent;
 //layout(location = 4) in vec3 aBitangent;
+#endif
+layout(location = 5) in uint aInstanceIndex; // baseInstance + gl_InstanceID
+
+struct Instance
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
 
-layout(binding = 1, std140) uniform LocalParams
+layout(binding = 3, std430) readonly buffer Instances
 {
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
+	Instance uInstances[];
 };
 
 out vec2 vTexCoord;
@@ -35,10 +62,20 @@ void main()
 {
 	vTexCoord = aTexCoord;
 
-	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
-	vNormal = normalize(vec3(uWorldMatrix * vec4(aNormal, 0.0)));
+	Instance instance = uInstances[aInstanceIndex];
+
+#ifdef QUANTIZED_VERTICES
+	vec3 position = aPosition.xyz;
+	vec3 normal = DecodeOctahedral(aNormal);
+#else
+	vec3 position = aPosition;
+	vec3 normal = aNormal;
+#endif
+
+	vPosition = vec3(instance.worldMatrix * vec4(position, 1.0));
+	vNormal = normalize(vec3(instance.worldMatrix * vec4(normal, 0.0)));
 
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+	gl_Position = instance.worldViewProjectionMatrix * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -53,7 +90,14 @@ layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount;
-	Light uLight[256];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;   // xyz: cluster count per axis, w: directional light count
+	vec4 uClusterParams;  // xy: tile size in pixels, z: slice scale, w: slice bias
+};
+
+layout(binding = 0, std430) readonly buffer Lights
+{
+	Light uLight[]; // directional lights first
 };
 
 layout(location = 0) out vec4 oColor;
@@ -88,13 +132,24 @@ void main()
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
+#ifdef QUANTIZED_VERTICES
+layout(location = 0) in vec4 aPosition; // w: sign of the bitangent
+layout(location = 1) in vec2 aNormal;   // octahedral
+#else
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
+#endif
+layout(location = 5) in uint aInstanceIndex; // baseInstance + gl_InstanceID
 
-layout(binding = 1, std140) uniform LocalParams
+struct Instance
 {
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+layout(binding = 3, std430) readonly buffer Instances
+{
+	Instance uInstances[];
 };
 
 out vec3 vPosition; // in worldspace
@@ -102,10 +157,20 @@ out vec3 vNormal;   // in worldspace
 
 void main()
 {
-	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
-	vNormal = normalize(vec3(uWorldMatrix * vec4(aNormal, 0.0)));
+	Instance instance = uInstances[aInstanceIndex];
+
+#ifdef QUANTIZED_VERTICES
+	vec3 position = aPosition.xyz;
+	vec3 normal = DecodeOctahedral(aNormal);
+#else
+	vec3 position = aPosition;
+	vec3 normal = aNormal;
+#endif
+
+	vPosition = vec3(instance.worldMatrix * vec4(position, 1.0));
+	vNormal = normalize(vec3(instance.worldMatrix * vec4(normal, 0.0)));
 
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+	gl_Position = instance.worldViewProjectionMatrix * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -117,7 +182,14 @@ layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount;
-	Light uLight[256];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;   // xyz: cluster count per axis, w: directional light count
+	vec4 uClusterParams;  // xy: tile size in pixels, z: slice scale, w: slice bias
+};
+
+layout(binding = 0, std430) readonly buffer Lights
+{
+	Light uLight[]; // directional lights first
 };
 
 layout(location = 0) out vec4 oColor;
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////
+
+struct Instance
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+struct DrawElementsIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int  baseVertex;
+	uint baseInstance;
+};
+
+struct CullingDraw
+{
+	vec4 boundingSphere; // model space
+	uint firstInstance;
+	uint firstVisibleInstance;
+	uint padding0;
+	uint padding1;
+};
+
+struct CullingJob
+{
+	uint draw;
+	uint firstInstance;
+	uint instanceCount;
+	uint padding;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+#ifdef FRUSTUM_CULLING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 64) in; // GPU_CULLING_GROUP_SIZE
+
+layout(binding = 0, std430) readonly buffer Instances
+{
+	Instance uInstances[];
+};
+
+layout(binding = 1, std430) readonly buffer Draws
+{
+	CullingDraw uDraws[];
+};
+
+layout(binding = 2, std430) readonly buffer Jobs
+{
+	CullingJob uJobs[];
+};
+
+layout(binding = 3, std430) buffer Commands
+{
+	DrawElementsIndirectCommand uCommands[];
+};
+
+layout(binding = 4, std430) writeonly buffer VisibleInstances
+{
+	Instance uVisibleInstances[];
+};
+
+layout(binding = 5, std430) buffer Counters
+{
+	uint uFrustumCulledCount;
+	uint uOcclusionCulledCount;
+};
+
+uniform vec4 uFrustumPlanes[6]; // xyz: normal pointing inside, w: distance
+uniform uint uFirstJob;
+
+// Hi-Z pyramid of the last frame (min, max depth per texel) and the view projection it was rendered with
+layout(binding = 0) uniform sampler2D uHiZ;
+uniform uint  uOcclusionCulling;
+uniform mat4  uHiZViewProjection;
+uniform ivec2 uHiZSize;
+uniform uint  uHiZLevelCount;
+
+bool IsOccluded(vec3 boundsMin, vec3 boundsMax)
+{
+	// screen rectangle and nearest depth of the box
+	vec2 uvMin = vec2(1e30);
+	vec2 uvMax = vec2(-1e30);
+	float nearestDepth = 1.0;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		vec3 position = mix(boundsMin, boundsMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+		vec4 clip = uHiZViewProjection * vec4(position, 1.0);
+		if (clip.w <= 0.0)
+			return false; // crossing the near plane
+
+		vec3 ndc = clip.xyz / clip.w;
+		uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+		uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+		nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+	}
+
+	// outside the depth that was rendered, nothing is known about it
+	if (any(lessThan(uvMax, vec2(0.0))) || any(greaterThan(uvMin, vec2(1.0))))
+		return false;
+
+	uvMin = clamp(uvMin, 0.0, 1.0);
+	uvMax = clamp(uvMax, 0.0, 1.0);
+
+	// the level where the rectangle touches at most 2x2 texels
+	vec2 extent = (uvMax - uvMin) * vec2(uHiZSize);
+	int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+	level = min(level, int(uHiZLevelCount) - 1);
+
+	ivec2 levelSize = max(uHiZSize >> level, ivec2(1));
+	ivec2 texelMin = min(min(ivec2(uvMin * vec2(uHiZSize)), uHiZSize - 1) >> level, levelSize - 1);
+	ivec2 texelMax = min(min(ivec2(uvMax * vec2(uHiZSize)), uHiZSize - 1) >> level, levelSize - 1);
+
+	float farthestDepth = 0.0;
+	for (int y = texelMin.y; y <= texelMax.y; ++y)
+		for (int x = texelMin.x; x <= texelMax.x; ++x)
+			farthestDepth = max(farthestDepth, texelFetch(uHiZ, ivec2(x, y), level).y);
+
+	return nearestDepth > farthestDepth;
+}
+
+void main()
+{
+	CullingJob job = uJobs[uFirstJob + gl_WorkGroupID.x];
+	if (gl_LocalInvocationID.x >= job.instanceCount)
+		return;
+
+	CullingDraw draw = uDraws[job.draw];
+	Instance instance = uInstances[draw.firstInstance + job.firstInstance + gl_LocalInvocationID.x];
+
+	// world space sphere, scaled by the largest axis of the matrix
+	mat4 world = instance.worldMatrix;
+	vec3 center = vec3(world * vec4(draw.boundingSphere.xyz, 1.0));
+	float scale = sqrt(max(dot(world[0].xyz, world[0].xyz), max(dot(world[1].xyz, world[1].xyz), dot(world[2].xyz, world[2].xyz))));
+	float radius = draw.boundingSphere.w * scale;
+
+	for (int i = 0; i < 6; ++i)
+	{
+		if (dot(uFrustumPlanes[i].xyz, center) + uFrustumPlanes[i].w < -radius)
+		{
+			atomicAdd(uFrustumCulledCount, 1u);
+			return;
+		}
+	}
+
+	if (uOcclusionCulling != 0u && IsOccluded(center - radius, center + radius))
+	{
+		atomicAdd(uOcclusionCulledCount, 1u);
+		return;
+	}
+
+	uint slot = atomicAdd(uCommands[job.draw].instanceCount, 1u);
+	uVisibleInstances[draw.firstVisibleInstance + slot] = instance;
+}
+
+#endif
+#endif
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////
+
+// Texels of the pyramid hold the min (x) and max (y) depth below them
+
+///////////////////////////////////////////////////////////////////////
+
+#ifdef HIZ_COPY
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 8, local_size_y = 8) in; // HIZ_GROUP_SIZE
+
+layout(binding = 0) uniform sampler2D uDepth;
+layout(binding = 0, rg32f) writeonly uniform image2D uDestination;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, imageSize(uDestination))))
+		return;
+
+	float depth = texelFetch(uDepth, texel, 0).r;
+	imageStore(uDestination, texel, vec4(depth, depth, 0.0, 0.0));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+
+#ifdef HIZ_REDUCE
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 8, local_size_y = 8) in; // HIZ_GROUP_SIZE
+
+layout(binding = 0, rg32f) readonly uniform image2D uSource;
+layout(binding = 1, rg32f) writeonly uniform image2D uDestination;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 destinationSize = imageSize(uDestination);
+	if (any(greaterThanEqual(texel, destinationSize)))
+		return;
+
+	// 2x2 source texels, 3 in an axis for the last texel when the source size is odd
+	ivec2 sourceSize = imageSize(uSource);
+	ivec2 first = texel * 2;
+	ivec2 last = first + 1 + ivec2(equal(texel, destinationSize - 1)) * (sourceSize & 1);
+	last = min(last, sourceSize - 1);
+
+	vec2 minMax = vec2(1.0, 0.0);
+	for (int y = first.y; y <= last.y; ++y)
+	{
+		for (int x = first.x; x <= last.x; ++x)
+		{
+			vec2 source = imageLoad(uSource, ivec2(x, y)).xy;
+			minMax = vec2(min(minMax.x, source.x), max(minMax.y, source.y));
+		}
+	}
+
+	imageStore(uDestination, texel, vec4(minMax, 0.0, 0.0));
+}
+
+#endif
+#endif
@@ -3,6 +3,7 @@
 struct Light
 {
 	unsigned int type;
+	float radius;
 	vec3 color;
 	vec3 direction;
 	vec3 position;
@@ -43,7 +44,24 @@ layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount;
-	Light uLight[256];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;   // xyz: cluster count per axis, w: directional light count
+	vec4 uClusterParams;  // xy: tile size in pixels, z: slice scale, w: slice bias
+};
+
+layout(binding = 0, std430) readonly buffer Lights
+{
+	Light uLight[]; // directional lights first
+};
+
+layout(binding = 1, std430) readonly buffer Clusters
+{
+	uvec2 uCluster[]; // x: first index in uClusterLightIndex, y: light count
+};
+
+layout(binding = 2, std430) readonly buffer ClusterLightIndices
+{
+	uint uClusterLightIndex[];
 };
 
 float near = 0.1f;
@@ -55,6 +73,41 @@ float linearizeDepth(float depth)
     return (2.0 * near * far) / (far + near - z * (far - near));	
 }
 
+vec3 computeLight(Light light, vec3 normals, vec3 position)
+{
+	vec3 diffuse = vec3(0.0f, 0.0f, 0.0f);
+	switch (light.type)
+	{
+	case 0: // point light
+		float distanceToPoint = distance(light.position, position);
+		vec3 directionVector = position - light.position;
+
+		// fade to zero at the radius so clusters can skip the light outside of it
+		float falloff = clamp(1.0f - pow(distanceToPoint / light.radius, 4.0f), 0.0f, 1.0f);
+
+		diffuse = max(0.0f, -dot(normals, normalize(directionVector))) * light.color / distanceToPoint * falloff * falloff;
+		break;
+	case 1: // directional
+		diffuse = max(0.0f, -dot(normals, normalize(light.direction))) * light.color;
+		break;
+	default:
+		break;
+	}
+	return diffuse;
+}
+
+uint findCluster(vec3 position)
+{
+	float viewDepth = -(uViewMatrix * vec4(position, 1.0f)).z;
+
+	uvec3 cluster;
+	cluster.xy = uvec2(gl_FragCoord.xy / uClusterParams.xy);
+	cluster.z = uint(max(floor(log(max(viewDepth, 1e-6f)) * uClusterParams.z - uClusterParams.w), 0.0f));
+	cluster = min(cluster, uClusterGrid.xyz - 1u);
+
+	return (cluster.z * uClusterGrid.y + cluster.y) * uClusterGrid.x + cluster.x;
+}
+
 void main()
 {
 
@@ -63,28 +116,19 @@ void main()
 	vec3 position = texture(uPosition, vTexCoord).xyz;
 	float depth = linearizeDepth(texture(uDepth, vTexCoord).r) / far;
 
-	vec3 lightColor = vec3(0.0f, 0.0f, 0.0f);	
-	for (int i = 0; i < uLightCount; ++i)
+	vec3 lightColor = vec3(0.0f, 0.0f, 0.0f);
+
+	// directional lights reach every pixel
+	for (uint i = 0; i < uClusterGrid.w; ++i)
+	{
+		lightColor += computeLight(uLight[i], normals, position);
+	}
+
+	// point lights: only the ones assigned to the cluster of this pixel
+	uvec2 cluster = uCluster[findCluster(position)];
+	for (uint i = 0; i < cluster.y; ++i)
 	{
-		vec3 diffuse;
-		switch (uLight[i].type)
-		{
-		case 0: // point light
-			float distanceToPoint = distance(uLight[i].position, position);
-			vec3 directionVector = position - uLight[i].position;
-
-			diffuse = max(0.0f, -dot(normals, normalize(directionVector))) * uLight[i].color / distanceToPoint;
-
-			lightColor += diffuse;
-			break;
-		case 1: // directional
-			diffuse = max(0.0f, -dot(normals, normalize(uLight[i].direction))) * uLight[i].color;
-
-			lightColor += diffuse;
-			break;
-		default:
-			break;
-		}
+		lightColor += computeLight(uLight[uClusterLightIndex[cluster.x + i]], normals, position);
 	}
 
 	switch (usedFramebuffer)